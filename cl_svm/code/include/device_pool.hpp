@@ -0,0 +1,330 @@
+// guard
+#ifndef DEVICE_POOL_H_
+#define DEVICE_POOL_H_
+
+// inclusions
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <CL/cl.h>
+
+// definitions
+#define	DEVICE_POOL_SLAB_SIZE	((size_t)64 << 20)
+#define	DEVICE_POOL_MIN_CLASS	8
+#define	DEVICE_POOL_CLASS_COUNT	48
+
+// Device buffers are carved as sub-buffers out of a few large slabs, with
+// their size rounded up to a power of two class. Releasing a buffer puts it
+// on its class's free list instead of handing it back to the driver, so once
+// the classes SMO keeps asking for are populated, training creates and
+// destroys no cl_mem objects at all. Buffers of another context, and any
+// buffer the pool did not carve, go straight to clCreateBuffer and
+// clReleaseMemObject.
+class DevicePool
+{
+private:
+	struct Slab
+	{
+		cl_mem buffer;
+		size_t size;
+		size_t used;
+		// sub-buffers carved from this slab that still exist
+		uint32_t live;
+	};
+
+	// variables
+	cl_context context;
+	size_t alignment;
+	Slab * slabTable;
+	uint32_t slabCount;
+	uint32_t slabCapacity;
+	cl_mem * freeTable[ DEVICE_POOL_CLASS_COUNT ];
+	uint32_t freeCount[ DEVICE_POOL_CLASS_COUNT ];
+	uint32_t freeCapacity[ DEVICE_POOL_CLASS_COUNT ];
+
+public:
+
+	// profiling
+	uint32_t poolHits;
+	uint32_t poolMisses;
+	size_t bytesReserved;
+
+	// methods
+
+	// constructor
+	DevicePool()
+	{
+		// variables
+		uint32_t i;
+
+		// function body
+		context = NULL;
+		alignment = 1 << DEVICE_POOL_MIN_CLASS;
+		slabTable = NULL;
+		slabCount = 0;
+		slabCapacity = 0;
+		for ( i = 0; i < DEVICE_POOL_CLASS_COUNT; i++ )
+		{
+			freeTable[ i ] = NULL;
+			freeCount[ i ] = 0;
+			freeCapacity[ i ] = 0;
+		}
+		poolHits = 0;
+		poolMisses = 0;
+		bytesReserved = 0;
+
+		// clean up
+	}
+
+	~DevicePool()
+	{
+		// variables
+		uint32_t i;
+
+		// function body
+		Trim();
+		// sub-buffers still out keep their slab's memory alive until released
+		for ( i = 0; i < slabCount; i++ )
+		{
+			clReleaseMemObject( slabTable[ i ].buffer );
+		}
+
+		// clean up
+		free( slabTable );
+		for ( i = 0; i < DEVICE_POOL_CLASS_COUNT; i++ )
+		{
+			free( freeTable[ i ] );
+		}
+	}
+
+	// bind the pool to a context, whose device decides sub-buffer alignment
+	inline void Initialize( cl_context inputContext, cl_device_id device )
+	{
+		// variables
+		cl_uint alignmentBits;
+
+		// function body
+		context = inputContext;
+		if ( CL_SUCCESS == clGetDeviceInfo( device, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(cl_uint), &alignmentBits, NULL ) )
+		{
+			if ( alignmentBits / 8 > alignment )
+			{
+				alignment = alignmentBits / 8;
+			}
+		}
+
+		// clean up
+	}
+
+	// main interface
+	inline cl_mem Acquire( cl_context inputContext, size_t bytes, cl_int * errorCode )
+	{
+		// variables
+		uint32_t sizeClass;
+		size_t classBytes;
+		size_t origin;
+		uint32_t i;
+		int trimmed;
+		cl_buffer_region region;
+		cl_mem output;
+
+		// function body
+		if ( NULL == context || inputContext != context )
+		{
+			return clCreateBuffer( inputContext, CL_MEM_READ_WRITE, bytes, NULL, errorCode );
+		}
+		// find the size class
+		sizeClass = DEVICE_POOL_MIN_CLASS;
+		while ( ( (size_t)1 << sizeClass ) < bytes || ( (size_t)1 << sizeClass ) < alignment )
+		{
+			sizeClass++;
+		}
+		if ( sizeClass >= DEVICE_POOL_CLASS_COUNT )
+		{
+			return clCreateBuffer( inputContext, CL_MEM_READ_WRITE, bytes, NULL, errorCode );
+		}
+		classBytes = (size_t)1 << sizeClass;
+		// recycle a released buffer of that class
+		if ( 0 != freeCount[ sizeClass ] )
+		{
+			poolHits++;
+			*errorCode = CL_SUCCESS;
+			return freeTable[ sizeClass ][ --freeCount[ sizeClass ] ];
+		}
+		poolMisses++;
+		// otherwise carve one from the first slab with room, adding a slab
+		// (after trimming once, if the device is full) when none has any
+		trimmed = 0;
+		for ( i = 0; i < slabCount; i++ )
+		{
+			origin = ( slabTable[ i ].used + alignment - 1 ) / alignment * alignment;
+			if ( origin + classBytes <= slabTable[ i ].size )
+			{
+				break;
+			}
+		}
+		while ( i == slabCount )
+		{
+			if ( 0 == AddSlab( classBytes > DEVICE_POOL_SLAB_SIZE ? classBytes : DEVICE_POOL_SLAB_SIZE, errorCode ) )
+			{
+				origin = 0;
+			}
+			else if ( !trimmed )
+			{
+				trimmed = 1;
+				Trim();
+				i = slabCount;
+			}
+			else
+			{
+				return NULL;
+			}
+		}
+		region.origin = origin;
+		region.size = classBytes;
+		output = clCreateSubBuffer( slabTable[ i ].buffer, CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, errorCode );
+		if ( CL_SUCCESS != *errorCode )
+		{
+			// sub-buffers unsupported or misaligned, do without
+			return clCreateBuffer( inputContext, CL_MEM_READ_WRITE, bytes, NULL, errorCode );
+		}
+		slabTable[ i ].used = origin + classBytes;
+		slabTable[ i ].live++;
+
+		// clean up
+		return output;
+	}
+
+	inline void Release( cl_mem buffer )
+	{
+		// variables
+		cl_mem parent;
+		size_t bytes;
+		uint32_t sizeClass;
+		uint32_t i;
+		cl_mem * table;
+
+		// function body
+		parent = NULL;
+		clGetMemObjectInfo( buffer, CL_MEM_ASSOCIATED_MEMOBJECT, sizeof(cl_mem), &parent, NULL );
+		for ( i = 0; i < slabCount; i++ )
+		{
+			if ( parent == slabTable[ i ].buffer )
+			{
+				break;
+			}
+		}
+		if ( NULL == parent || i == slabCount ||
+			CL_SUCCESS != clGetMemObjectInfo( buffer, CL_MEM_SIZE, sizeof(size_t), &bytes, NULL ) )
+		{
+			clReleaseMemObject( buffer );
+			return;
+		}
+		sizeClass = DEVICE_POOL_MIN_CLASS;
+		while ( ( (size_t)1 << sizeClass ) < bytes )
+		{
+			sizeClass++;
+		}
+		// grow the free list
+		if ( freeCount[ sizeClass ] == freeCapacity[ sizeClass ] )
+		{
+			table = (cl_mem*) realloc( freeTable[ sizeClass ], sizeof(cl_mem) * ( 2 * freeCapacity[ sizeClass ] + 8 ) );
+			if ( NULL == table )
+			{
+				clReleaseMemObject( buffer );
+				slabTable[ i ].live--;
+				return;
+			}
+			freeTable[ sizeClass ] = table;
+			freeCapacity[ sizeClass ] = 2 * freeCapacity[ sizeClass ] + 8;
+		}
+		freeTable[ sizeClass ][ freeCount[ sizeClass ]++ ] = buffer;
+
+		// clean up
+	}
+
+	// give free buffers back to the driver, and with them every slab that
+	// has nothing carved out anymore
+	inline void Trim()
+	{
+		// variables
+		uint32_t i;
+		uint32_t k;
+		uint32_t kept;
+		cl_mem parent;
+
+		// function body
+		for ( i = 0; i < DEVICE_POOL_CLASS_COUNT; i++ )
+		{
+			while ( 0 != freeCount[ i ] )
+			{
+				parent = NULL;
+				clGetMemObjectInfo( freeTable[ i ][ --freeCount[ i ] ], CL_MEM_ASSOCIATED_MEMOBJECT, sizeof(cl_mem), &parent, NULL );
+				for ( k = 0; k < slabCount; k++ )
+				{
+					if ( parent == slabTable[ k ].buffer )
+					{
+						slabTable[ k ].live--;
+					}
+				}
+				clReleaseMemObject( freeTable[ i ][ freeCount[ i ] ] );
+			}
+		}
+		kept = 0;
+		for ( k = 0; k < slabCount; k++ )
+		{
+			if ( 0 == slabTable[ k ].live )
+			{
+				bytesReserved -= slabTable[ k ].size;
+				clReleaseMemObject( slabTable[ k ].buffer );
+			}
+			else
+			{
+				slabTable[ kept++ ] = slabTable[ k ];
+			}
+		}
+		slabCount = kept;
+
+		// clean up
+	}
+
+private:
+
+	inline int AddSlab( size_t bytes, cl_int * errorCode )
+	{
+		// variables
+		Slab * table;
+		cl_mem buffer;
+
+		// function body
+		if ( slabCount == slabCapacity )
+		{
+			table = (Slab*) realloc( slabTable, sizeof(Slab) * ( 2 * slabCapacity + 4 ) );
+			if ( NULL == table )
+			{
+				*errorCode = CL_OUT_OF_HOST_MEMORY;
+				return -1;
+			}
+			slabTable = table;
+			slabCapacity = 2 * slabCapacity + 4;
+		}
+		buffer = clCreateBuffer( context, CL_MEM_READ_WRITE, bytes, NULL, errorCode );
+		if ( CL_SUCCESS != *errorCode )
+		{
+			return -1;
+		}
+		slabTable[ slabCount ].buffer = buffer;
+		slabTable[ slabCount ].size = bytes;
+		slabTable[ slabCount ].used = 0;
+		slabTable[ slabCount ].live = 0;
+		slabCount++;
+		bytesReserved += bytes;
+
+		// clean up
+		return 0;
+	}
+
+};
+
+#endif
@@ -10,19 +10,31 @@
 
 #include <CL/cl.h>
 
+#include "device_pool.hpp"
+
 // definitions
 #define	DEFAULT_CACHE_SIZE	10
 
+// Buffers are kept in up to cacheSize slots and, when a byte budget is set,
+// in at most byteBudget bytes of device memory. Replacement is CLOCK: a hit
+// sets the slot's reference bit, and the hand passes over referenced slots
+// once (clearing the bit) before evicting, so the columns SMO keeps coming
+// back to survive while one-off ones are recycled.
 class GPUCache
 {
 private:
 	// variables
-	// start with the naive approach
 	cl_mem * cacheDataTable;
 	int * cacheIndexTable;
 	int * cacheOwnerTable;
+	size_t * cacheBytesTable;
+	char * cacheReferenceTable;
 	uint32_t cacheSize;
+	// clock hand
 	uint32_t currentCacheIndex;
+	// 0 for no byte limit
+	size_t byteBudget;
+	size_t bytesCached;
 	// space for A matrix
 	uint32_t lastStartJ;
 	uint32_t lastEndJ;
@@ -33,19 +45,23 @@ private:
 	// space for y (that's labels, folks)
 	cl_mem y_data;
 	int y_data_allocated;
+	// where released buffers go, NULL to hand them to the driver
+	DevicePool * pool;
 	
 public:
 
 	// variables
 	uint32_t maxIndex;
 	// profiling
+	uint32_t cacheHits;
 	uint32_t cacheMisses;
 	uint32_t cacheInvalidations;
+	uint32_t cacheEvictions;
 
 	// methods
 	
 	// constructor
-	GPUCache( uint32_t inputMaxIndex, uint32_t inputCacheSize = DEFAULT_CACHE_SIZE )
+	GPUCache( uint32_t inputMaxIndex, uint32_t inputCacheSize = DEFAULT_CACHE_SIZE, size_t inputByteBudget = 0 )
 	{
 		// variables
 		uint32_t i;
@@ -55,8 +71,13 @@ public:
 		lastEndJ = 0;
 		g_data_allocated = 0;
 		y_data_allocated = 0;
+		cacheHits = 0;
 		cacheMisses = 0;
 		cacheInvalidations = 0;
+		cacheEvictions = 0;
+		byteBudget = inputByteBudget;
+		bytesCached = 0;
+		pool = NULL;
 		// remember the cache size
 		cacheSize = inputCacheSize;
 		maxIndex = inputMaxIndex;
@@ -82,9 +103,18 @@ public:
 		currentCacheIndex = 0;
 		// set all the slots as unowned
 		cacheOwnerTable = (int*) malloc( sizeof(int) * cacheSize );
+		cacheBytesTable = (size_t*) malloc( sizeof(size_t) * cacheSize );
+		cacheReferenceTable = (char*) malloc( sizeof(char) * cacheSize );
+		if ( NULL == cacheOwnerTable || NULL == cacheBytesTable || NULL == cacheReferenceTable )
+		{
+			fprintf( stderr, "Error: Failed to allocate GPU cache slot tables. Exiting\n" );
+			exit( -1 );
+		}
 		for ( i = 0; i < cacheSize; i++ )
 		{
 			cacheOwnerTable[ i ] = -1;
+			cacheBytesTable[ i ] = 0;
+			cacheReferenceTable[ i ] = 0;
 		}
 		
 		
@@ -106,7 +136,7 @@ public:
 			if ( -1 != cacheIndexTable[ i ] )
 			{
 				//fprintf( stdout, "Releasing\n" );
-				clReleaseMemObject( cacheDataTable[ cacheIndexTable[ i ] ] );
+				ReleaseBuffer( cacheDataTable[ cacheIndexTable[ i ] ] );
 				//fprintf( stdout, "Finished releasing\n" );
 			}
 		}
@@ -114,25 +144,30 @@ public:
 		if ( 0 != lastStartJ || 0 != lastEndJ )
 		{
 			//fprintf( stdout, "Release single saved data\n" );
-			clReleaseMemObject( singleSavedData );
+			ReleaseBuffer( singleSavedData );
 			//fprintf( stdout, "Finished Release single saved data\n" );
 		}
 		
 		if ( g_data_allocated )
 		{
 			//fprintf( stdout, "Releasing G\n" );
-			clReleaseMemObject( g_data );
+			ReleaseBuffer( g_data );
 			//fprintf( stdout, "Finished releasing G\n" );
 		}
 		
 		if ( y_data_allocated )
 		{
 			//fprintf( stdout, "Releasing y\n" );
-			clReleaseMemObject( y_data );
+			ReleaseBuffer( y_data );
 			//fprintf( stdout, "Finished Releasing y\n" );
 		}
 		
 		// clean up
+		free( cacheIndexTable );
+		free( cacheDataTable );
+		free( cacheOwnerTable );
+		free( cacheBytesTable );
+		free( cacheReferenceTable );
 		// debugging
 		//fprintf( stdout, "Finished Deconstructing GPU cache\n" );
 		
@@ -149,26 +184,58 @@ public:
 		{
 			if ( -1 != cacheIndexTable[ i ] )
 			{
-				clReleaseMemObject( cacheDataTable[ cacheIndexTable[ i ] ] );
+				ReleaseBuffer( cacheDataTable[ cacheIndexTable[ i ] ] );
 				cacheIndexTable[ i ] = -1;
 			}
 		}
 		if ( 0 != lastStartJ || 0 != lastEndJ )
 		{
-			clReleaseMemObject( singleSavedData );
+			ReleaseBuffer( singleSavedData );
 			lastStartJ = lastEndJ = 0;
 		}
 		
 		for ( i = 0; i < cacheSize; i++ )
 		{
 			cacheOwnerTable[ i ] = -1;
+			cacheBytesTable[ i ] = 0;
+			cacheReferenceTable[ i ] = 0;
 		}
 		
 		currentCacheIndex = 0;
+		bytesCached = 0;
 		
 		// clean up
 	}
 	
+	// return dropped buffers to inputPool instead of releasing them
+	inline void SetPool( DevicePool * inputPool )
+	{
+		pool = inputPool;
+	}
+	
+	inline void ReleaseBuffer( cl_mem buffer )
+	{
+		if ( NULL != pool )
+		{
+			pool->Release( buffer );
+		}
+		else
+		{
+			clReleaseMemObject( buffer );
+		}
+	}
+	
+	// device memory limit for the cached buffers, 0 for none
+	inline void SetByteBudget( size_t inputByteBudget )
+	{
+		byteBudget = inputByteBudget;
+	}
+	
+	inline size_t GetBytesCached()
+	{
+		return bytesCached;
+	}
+	
 	// main interface
 	inline int CheckCache( uint32_t index, cl_mem * output )
 	{
@@ -196,9 +263,11 @@ public:
 		{
 			// debugging
 			//fprintf( stdout, "GPU Cache hit\n" );
+			cacheHits++;
 			// set output accordingly
 			cacheDataIndex = cacheIndexTable[ index ];
 			*output = cacheDataTable[ cacheDataIndex ];
+			cacheReferenceTable[ cacheDataIndex ] = 1;
 		}
 		
 		
@@ -212,31 +281,71 @@ public:
 		// debugging
 		//fprintf( stdout, "CACHING: %x\n", this );
 		// variables
-		uint32_t currentOwner;
+		int slot;
+		size_t inputBytes;
 		
 		// function body
-		// if there is valid memory in the table at the current index
-		currentOwner = cacheOwnerTable[ currentCacheIndex ];
-		if ( -1 != currentOwner && index != currentOwner )
+		if ( CL_SUCCESS != clGetMemObjectInfo( input, CL_MEM_SIZE, sizeof(size_t), &inputBytes, NULL ) )
 		{
-			// find out who it belongs to
-			// mark the owner as uncached
-			cacheIndexTable[ currentOwner ] = -1;
-			// free the cached memory
-			clReleaseMemObject( cacheDataTable[ currentCacheIndex ] );
+			inputBytes = 0;
+		}
+		slot = cacheIndexTable[ index ];
+		// replacing this index's own buffer keeps its slot
+		if ( -1 != slot )
+		{
+			if ( cacheDataTable[ slot ] != input )
+			{
+				ReleaseBuffer( cacheDataTable[ slot ] );
+			}
+			bytesCached -= cacheBytesTable[ slot ];
+		}
+		// otherwise sweep the clock hand until an empty slot fits the budget,
+		// evicting unreferenced slots on the way (an oversized buffer is still
+		// cached once the cache is empty)
+		while ( -1 == slot )
+		{
+			if ( -1 == cacheOwnerTable[ currentCacheIndex ] )
+			{
+				if ( 0 == byteBudget || 0 == bytesCached || bytesCached + inputBytes <= byteBudget )
+				{
+					slot = currentCacheIndex;
+				}
+			}
+			else if ( cacheReferenceTable[ currentCacheIndex ] )
+			{
+				cacheReferenceTable[ currentCacheIndex ] = 0;
+			}
+			else
+			{
+				Evict( currentCacheIndex );
+				continue;
+			}
+			currentCacheIndex = ( currentCacheIndex + 1 ) % cacheSize;
 		}
 		// save the input to memory
-		cacheDataTable[ currentCacheIndex ] = input;
-		// mark the owner of the current slot as the current index
-		cacheOwnerTable[ currentCacheIndex ] = index;
-		cacheIndexTable[ index ] = currentCacheIndex;
-		// increment the current index
-		currentCacheIndex = ( currentCacheIndex + 1 ) % cacheSize;
+		cacheDataTable[ slot ] = input;
+		cacheBytesTable[ slot ] = inputBytes;
+		cacheReferenceTable[ slot ] = 0;
+		bytesCached += inputBytes;
+		// mark the owner of the slot as the current index
+		cacheOwnerTable[ slot ] = index;
+		cacheIndexTable[ index ] = slot;
 		
 		// clean up
 		return 0;
 	}
 	
+	inline void Evict( uint32_t slot )
+	{
+		// function body
+		cacheIndexTable[ cacheOwnerTable[ slot ] ] = -1;
+		ReleaseBuffer( cacheDataTable[ slot ] );
+		cacheOwnerTable[ slot ] = -1;
+		bytesCached -= cacheBytesTable[ slot ];
+		cacheBytesTable[ slot ] = 0;
+		cacheEvictions++;
+	}
+	
 	// maintain validity
 	inline int SwapIndices( uint32_t i, uint32_t j )
 	{
@@ -266,7 +375,7 @@ public:
 		// kill large block
 		/*if ( 0 != lastStartJ || 0 != lastEndJ )
 		{
-			clReleaseMemObject( singleSavedData );
+			ReleaseBuffer( singleSavedData );
 			lastStartJ = lastEndJ = 0;
 		}*/
 		
@@ -300,7 +409,7 @@ public:
 		// function body
 		if ( 0 != lastStartJ || 0 != lastEndJ )
 		{
-			clReleaseMemObject( singleSavedData );
+			ReleaseBuffer( singleSavedData );
 		}
 		lastStartJ = startJ;
 		lastEndJ = endJ;
@@ -338,7 +447,7 @@ public:
 		if ( g_data_allocated )
 		{
 			// deallocate it
-			clReleaseMemObject( g_data );
+			ReleaseBuffer( g_data );
 		}
 		// remember this new space
 		g_data = input;
@@ -373,7 +482,7 @@ public:
 		if ( y_data_allocated )
 		{
 			// deallocate it
-			clReleaseMemObject( y_data );
+			ReleaseBuffer( y_data );
 		}
 		// remember this new space
 		y_data = input;
@@ -0,0 +1,1095 @@
+// guard
+#ifndef SIMD_KERNELS_H_
+#define SIMD_KERNELS_H_
+
+// inclusions
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#include "svm.h"
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+	#include <immintrin.h>
+	#define SIMD_TARGET(x)
+#elif defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+	#include <immintrin.h>
+	#define SIMD_TARGET(x) __attribute__((target(x)))
+#else
+	#define SIMD_NO_X86
+#endif
+
+// definitions
+// instruction set levels, ordered so that a higher level implies the lower ones
+enum { SIMD_LEVEL_SCALAR = 0, SIMD_LEVEL_SSE4 = 1, SIMD_LEVEL_AVX2 = 2, SIMD_LEVEL_AVX512 = 3 };
+
+typedef double (*simd_dot_function)( const svm_feature * a, const svm_feature * b, int n );
+typedef double (*simd_norm_function)( const svm_feature * a, int n );
+typedef void (*simd_dot4_function)( const svm_feature * a, const svm_feature * const * b, int n, double * out );
+typedef void (*simd_row_function)( double * v, int n );
+typedef double (*simd_sparse_dot_function)( const int * index, const svm_feature * value, int nnz, const svm_feature * dense );
+typedef void (*simd_axpy_function)( double * y, const float * a, double alpha, int n );
+typedef void (*simd_axpy2_function)( double * y, const float * a, double alpha, const float * b, double beta, int n );
+typedef double (*simd_gather_dot_function)( const int * index, const double * weight, int n, const float * x );
+typedef void (*simd_half_decode_function)( const unsigned short * src, float * dst, int n );
+typedef void (*simd_half_encode_function)( const float * src, unsigned short * dst, int n );
+
+// 16 bit float formats for cached kernel columns
+enum { SIMD_HALF_FP16, SIMD_HALF_BF16 };
+
+//
+// Dense vector primitives used by the CPU kernels. Every routine comes in a
+// scalar version plus SSE4.1, AVX2 and AVX-512 versions; the widest one the
+// processor supports is picked once at startup by simd_select(). Inputs are
+// svm_feature (double, or float with SVM_FLOAT_FEATURES) and are widened to
+// double on load, so the sums are always accumulated in double precision.
+//
+
+// scalar versions, also the fallback on non-x86 targets
+static double simd_dot_scalar( const svm_feature * a, const svm_feature * b, int n )
+{
+	double sum = 0;
+	for( int i = 0; i < n; i++ )
+		sum += (double) a[i] * b[i];
+	return sum;
+}
+
+static double simd_distance_scalar( const svm_feature * a, const svm_feature * b, int n )
+{
+	double sum = 0;
+	for( int i = 0; i < n; i++ )
+	{
+		double d = (double) a[i] - b[i];
+		sum += d * d;
+	}
+	return sum;
+}
+
+static double simd_norm_scalar( const svm_feature * a, int n )
+{
+	return simd_dot_scalar( a, a, n );
+}
+
+// four dot products sharing the left operand, the building block of the row sweeps
+static void simd_dot4_scalar( const svm_feature * a, const svm_feature * const * b, int n, double * out )
+{
+	double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	for( int i = 0; i < n; i++ )
+	{
+		double v = a[i];
+		s0 += v * b[0][i];
+		s1 += v * b[1][i];
+		s2 += v * b[2][i];
+		s3 += v * b[3][i];
+	}
+	out[0] = s0;
+	out[1] = s1;
+	out[2] = s2;
+	out[3] = s3;
+}
+
+// sparse (CSR row) times dense vector: sum of value[k] * dense[index[k]]
+static double simd_sparse_dot_scalar( const int * index, const svm_feature * value, int nnz, const svm_feature * dense )
+{
+	double sum = 0;
+	for( int k = 0; k < nnz; k++ )
+		sum += (double) value[k] * dense[ index[k] ];
+	return sum;
+}
+
+// solver gradient updates: kernel columns (float) scaled into a double vector
+static void simd_axpy_scalar( double * y, const float * a, double alpha, int n )
+{
+	for( int i = 0; i < n; i++ )
+		y[i] += a[i] * alpha;
+}
+
+static void simd_axpy2_scalar( double * y, const float * a, double alpha, const float * b, double beta, int n )
+{
+	for( int i = 0; i < n; i++ )
+		y[i] += a[i] * alpha + b[i] * beta;
+}
+
+// sum of weight[k] * x[index[k]]
+static double simd_gather_dot_scalar( const int * index, const double * weight, int n, const float * x )
+{
+	double sum = 0;
+	for( int k = 0; k < n; k++ )
+		sum += weight[k] * x[ index[k] ];
+	return sum;
+}
+
+// libm row transforms; these are the exact versions at every level
+static void simd_exp_row_exact( double * v, int n )
+{
+	for( int i = 0; i < n; i++ )
+		v[i] = exp( v[i] );
+}
+
+static void simd_tanh_row_exact( double * v, int n )
+{
+	for( int i = 0; i < n; i++ )
+		v[i] = tanh( v[i] );
+}
+
+// v[i] = v[i]^times by the same square-and-multiply steps as powi(), run across
+// a block of the row at a time so the compiler can vectorise it
+static void simd_powi_row( double * v, int n, int times )
+{
+	double ret[64], tmp[64];
+	for( int b = 0; b < n; b += 64 )
+	{
+		int m = n - b < 64 ? n - b : 64;
+		int k;
+		for( k = 0; k < m; k++ )
+		{
+			tmp[k] = v[b + k];
+			ret[k] = 1.0;
+		}
+		for( int t = times; t > 0; t /= 2 )
+		{
+			if( t % 2 == 1 )
+				for( k = 0; k < m; k++ )
+					ret[k] *= tmp[k];
+			for( k = 0; k < m; k++ )
+				tmp[k] *= tmp[k];
+		}
+		for( k = 0; k < m; k++ )
+			v[b + k] = ret[k];
+	}
+}
+
+//
+// 16 bit floats. fp16 is IEEE binary16 (10 bit mantissa, range 6e-8..65504),
+// bf16 the top half of a binary32 (7 bit mantissa, float range). Both round
+// to nearest even.
+//
+static inline unsigned short simd_float_to_fp16( float f )
+{
+	unsigned int x, sign, abs, h, rem, half;
+	memcpy( &x, &f, sizeof(x) );
+	sign = ( x >> 16 ) & 0x8000;
+	abs = x & 0x7fffffff;
+	if( abs >= 0x7f800000 )	// inf, nan
+		return (unsigned short)( sign | 0x7c00 | ( abs > 0x7f800000 ? 0x200 : 0 ) );
+	if( abs >= 0x477ff000 )	// rounds past 65504
+		return (unsigned short)( sign | 0x7c00 );
+	if( abs < 0x38800000 )	// subnormal in fp16
+	{
+		if( abs < 0x33000000 )
+			return (unsigned short) sign;
+		unsigned int shift = 126 - ( abs >> 23 ), m = ( abs & 0x7fffff ) | 0x800000;
+		h = m >> shift;
+		rem = m & ( ( 1u << shift ) - 1 );
+		half = 1u << ( shift - 1 );
+		if( rem > half || ( rem == half && ( h & 1 ) ) )
+			h++;
+		return (unsigned short)( sign | h );
+	}
+	h = ( abs - 0x38000000 ) >> 13;
+	rem = abs & 0x1fff;
+	if( rem > 0x1000 || ( rem == 0x1000 && ( h & 1 ) ) )
+		h++;
+	return (unsigned short)( sign | h );
+}
+
+static inline float simd_fp16_to_float( unsigned short h )
+{
+	unsigned int sign = ( h & 0x8000u ) << 16, e = ( h >> 10 ) & 0x1f, m = h & 0x3ff, x;
+	float f;
+	if( e == 0 )
+	{
+		if( m == 0 )
+			x = sign;
+		else
+		{
+			// normalise the subnormal
+			e = 113;
+			while( !( m & 0x400 ) )
+			{
+				m <<= 1;
+				e--;
+			}
+			x = sign | ( e << 23 ) | ( ( m & 0x3ff ) << 13 );
+		}
+	}
+	else if( e == 31 )
+		x = sign | 0x7f800000 | ( m << 13 );
+	else
+		x = sign | ( ( e + 112 ) << 23 ) | ( m << 13 );
+	memcpy( &f, &x, sizeof(f) );
+	return f;
+}
+
+static inline unsigned short simd_float_to_bf16( float f )
+{
+	unsigned int x;
+	memcpy( &x, &f, sizeof(x) );
+	if( ( x & 0x7fffffff ) > 0x7f800000 )	// keep nan a quiet nan
+		return (unsigned short)( ( x >> 16 ) | 0x40 );
+	return (unsigned short)( ( x + 0x7fff + ( ( x >> 16 ) & 1 ) ) >> 16 );
+}
+
+static inline float simd_bf16_to_float( unsigned short h )
+{
+	unsigned int x = (unsigned int) h << 16;
+	float f;
+	memcpy( &f, &x, sizeof(f) );
+	return f;
+}
+
+static void simd_fp16_decode_scalar( const unsigned short * src, float * dst, int n )
+{
+	for( int i = 0; i < n; i++ )
+		dst[i] = simd_fp16_to_float( src[i] );
+}
+
+static void simd_fp16_encode_scalar( const float * src, unsigned short * dst, int n )
+{
+	for( int i = 0; i < n; i++ )
+		dst[i] = simd_float_to_fp16( src[i] );
+}
+
+static void simd_bf16_decode_scalar( const unsigned short * src, float * dst, int n )
+{
+	for( int i = 0; i < n; i++ )
+		dst[i] = simd_bf16_to_float( src[i] );
+}
+
+static void simd_bf16_encode_scalar( const float * src, unsigned short * dst, int n )
+{
+	for( int i = 0; i < n; i++ )
+		dst[i] = simd_float_to_bf16( src[i] );
+}
+
+//
+// Fast exp: x = n*ln2 + r with |r| <= ln2/2 (Cody-Waite split of ln2), exp(r) by a
+// degree 7 Taylor polynomial, then scaled by 2^n. Relative error stays below 1e-8,
+// well inside float precision, which is all a Qfloat cache entry keeps.
+//
+#define SIMD_EXP_MIN	-708.0
+#define SIMD_EXP_MAX	708.0
+#define SIMD_LOG2E		1.4426950408889634
+#define SIMD_LN2_HI		6.93145751953125e-1
+#define SIMD_LN2_LO		1.42860682030941723212e-6
+
+#ifndef SIMD_NO_X86
+
+// SSE4.1 versions, two lanes, scalar tail
+SIMD_TARGET("sse4.1")
+static inline __m128d simd_load2_sse4( const double * p )
+{
+	return _mm_loadu_pd( p );
+}
+
+SIMD_TARGET("sse4.1")
+static inline __m128d simd_load2_sse4( const float * p )
+{
+	return _mm_cvtps_pd( _mm_castpd_ps( _mm_load_sd( (const double *) p ) ) );
+}
+
+SIMD_TARGET("sse4.1")
+static double simd_dot_sse4( const svm_feature * a, const svm_feature * b, int n )
+{
+	__m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+	int i = 0;
+	for( ; i + 4 <= n; i += 4 )
+	{
+		acc0 = _mm_add_pd( acc0, _mm_mul_pd( simd_load2_sse4( a + i ), simd_load2_sse4( b + i ) ) );
+		acc1 = _mm_add_pd( acc1, _mm_mul_pd( simd_load2_sse4( a + i + 2 ), simd_load2_sse4( b + i + 2 ) ) );
+	}
+	acc0 = _mm_add_pd( acc0, acc1 );
+	acc0 = _mm_add_pd( acc0, _mm_unpackhi_pd( acc0, acc0 ) );
+	double sum = _mm_cvtsd_f64( acc0 );
+	for( ; i < n; i++ )
+		sum += (double) a[i] * b[i];
+	return sum;
+}
+
+SIMD_TARGET("sse4.1")
+static double simd_distance_sse4( const svm_feature * a, const svm_feature * b, int n )
+{
+	__m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+	int i = 0;
+	for( ; i + 4 <= n; i += 4 )
+	{
+		__m128d d0 = _mm_sub_pd( simd_load2_sse4( a + i ), simd_load2_sse4( b + i ) );
+		__m128d d1 = _mm_sub_pd( simd_load2_sse4( a + i + 2 ), simd_load2_sse4( b + i + 2 ) );
+		acc0 = _mm_add_pd( acc0, _mm_mul_pd( d0, d0 ) );
+		acc1 = _mm_add_pd( acc1, _mm_mul_pd( d1, d1 ) );
+	}
+	acc0 = _mm_add_pd( acc0, acc1 );
+	acc0 = _mm_add_pd( acc0, _mm_unpackhi_pd( acc0, acc0 ) );
+	double sum = _mm_cvtsd_f64( acc0 );
+	for( ; i < n; i++ )
+	{
+		double d = (double) a[i] - b[i];
+		sum += d * d;
+	}
+	return sum;
+}
+
+SIMD_TARGET("sse4.1")
+static double simd_norm_sse4( const svm_feature * a, int n )
+{
+	return simd_dot_sse4( a, a, n );
+}
+
+SIMD_TARGET("sse4.1")
+static void simd_dot4_sse4( const svm_feature * a, const svm_feature * const * b, int n, double * out )
+{
+	__m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd(), acc2 = _mm_setzero_pd(), acc3 = _mm_setzero_pd();
+	int i = 0;
+	for( ; i + 2 <= n; i += 2 )
+	{
+		__m128d v = simd_load2_sse4( a + i );
+		acc0 = _mm_add_pd( acc0, _mm_mul_pd( v, simd_load2_sse4( b[0] + i ) ) );
+		acc1 = _mm_add_pd( acc1, _mm_mul_pd( v, simd_load2_sse4( b[1] + i ) ) );
+		acc2 = _mm_add_pd( acc2, _mm_mul_pd( v, simd_load2_sse4( b[2] + i ) ) );
+		acc3 = _mm_add_pd( acc3, _mm_mul_pd( v, simd_load2_sse4( b[3] + i ) ) );
+	}
+	// pairwise horizontal sums
+	_mm_storeu_pd( out, _mm_hadd_pd( acc0, acc1 ) );
+	_mm_storeu_pd( out + 2, _mm_hadd_pd( acc2, acc3 ) );
+	for( ; i < n; i++ )
+	{
+		out[0] += (double) a[i] * b[0][i];
+		out[1] += (double) a[i] * b[1][i];
+		out[2] += (double) a[i] * b[2][i];
+		out[3] += (double) a[i] * b[3][i];
+	}
+}
+
+// AVX2 versions, four lanes with fused multiply-add, masked tail
+SIMD_TARGET("avx2,fma")
+static inline __m256d simd_exp_pd_avx2( __m256d x )
+{
+	const __m256d magic = _mm256_set1_pd( 6755399441055744.0 );	// 1.5 * 2^52
+	x = _mm256_min_pd( _mm256_max_pd( x, _mm256_set1_pd( SIMD_EXP_MIN ) ), _mm256_set1_pd( SIMD_EXP_MAX ) );
+	__m256d n = _mm256_round_pd( _mm256_mul_pd( x, _mm256_set1_pd( SIMD_LOG2E ) ), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC );
+	__m256d r = _mm256_fnmadd_pd( n, _mm256_set1_pd( SIMD_LN2_HI ), x );
+	r = _mm256_fnmadd_pd( n, _mm256_set1_pd( SIMD_LN2_LO ), r );
+	__m256d p = _mm256_set1_pd( 1.0 / 5040 );
+	p = _mm256_fmadd_pd( p, r, _mm256_set1_pd( 1.0 / 720 ) );
+	p = _mm256_fmadd_pd( p, r, _mm256_set1_pd( 1.0 / 120 ) );
+	p = _mm256_fmadd_pd( p, r, _mm256_set1_pd( 1.0 / 24 ) );
+	p = _mm256_fmadd_pd( p, r, _mm256_set1_pd( 1.0 / 6 ) );
+	p = _mm256_fmadd_pd( p, r, _mm256_set1_pd( 0.5 ) );
+	p = _mm256_fmadd_pd( p, r, _mm256_set1_pd( 1.0 ) );
+	p = _mm256_fmadd_pd( p, r, _mm256_set1_pd( 1.0 ) );
+	// 2^n built directly in the exponent field
+	__m256i e = _mm256_sub_epi64( _mm256_castpd_si256( _mm256_add_pd( n, magic ) ), _mm256_castpd_si256( magic ) );
+	e = _mm256_slli_epi64( _mm256_add_epi64( e, _mm256_set1_epi64x( 1023 ) ), 52 );
+	return _mm256_mul_pd( p, _mm256_castsi256_pd( e ) );
+}
+
+SIMD_TARGET("avx2,fma")
+static void simd_exp_row_avx2( double * v, int n )
+{
+	int i = 0;
+	for( ; i + 4 <= n; i += 4 )
+		_mm256_storeu_pd( v + i, simd_exp_pd_avx2( _mm256_loadu_pd( v + i ) ) );
+	for( ; i < n; i++ )
+		v[i] = exp( v[i] );
+}
+
+SIMD_TARGET("avx2,fma")
+static void simd_tanh_row_avx2( double * v, int n )
+{
+	// tanh(x) = 1 - 2 / (exp(2x) + 1)
+	const __m256d one = _mm256_set1_pd( 1.0 ), two = _mm256_set1_pd( 2.0 );
+	int i = 0;
+	for( ; i + 4 <= n; i += 4 )
+	{
+		__m256d e = simd_exp_pd_avx2( _mm256_mul_pd( two, _mm256_loadu_pd( v + i ) ) );
+		_mm256_storeu_pd( v + i, _mm256_sub_pd( one, _mm256_div_pd( two, _mm256_add_pd( e, one ) ) ) );
+	}
+	for( ; i < n; i++ )
+		v[i] = tanh( v[i] );
+}
+
+SIMD_TARGET("avx2,fma")
+static inline __m256d simd_load4_avx2( const double * p )
+{
+	return _mm256_loadu_pd( p );
+}
+
+SIMD_TARGET("avx2,fma")
+static inline __m256d simd_load4_avx2( const float * p )
+{
+	return _mm256_cvtps_pd( _mm_loadu_ps( p ) );
+}
+
+// loads the first remaining (< 4) elements, the other lanes are zero
+SIMD_TARGET("avx2,fma")
+static inline __m256d simd_maskload4_avx2( const double * p, int remaining )
+{
+	return _mm256_maskload_pd( p, _mm256_cmpgt_epi64( _mm256_set1_epi64x( remaining ), _mm256_set_epi64x( 3, 2, 1, 0 ) ) );
+}
+
+SIMD_TARGET("avx2,fma")
+static inline __m256d simd_maskload4_avx2( const float * p, int remaining )
+{
+	return _mm256_cvtps_pd( _mm_maskload_ps( p, _mm_cmpgt_epi32( _mm_set1_epi32( remaining ), _mm_set_epi32( 3, 2, 1, 0 ) ) ) );
+}
+
+SIMD_TARGET("avx2,fma")
+static inline double simd_horizontal_sum_avx2( __m256d v )
+{
+	__m128d lo = _mm_add_pd( _mm256_castpd256_pd128( v ), _mm256_extractf128_pd( v, 1 ) );
+	lo = _mm_add_pd( lo, _mm_unpackhi_pd( lo, lo ) );
+	return _mm_cvtsd_f64( lo );
+}
+
+SIMD_TARGET("avx2,fma")
+static double simd_dot_avx2( const svm_feature * a, const svm_feature * b, int n )
+{
+	__m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+	int i = 0;
+	for( ; i + 8 <= n; i += 8 )
+	{
+		acc0 = _mm256_fmadd_pd( simd_load4_avx2( a + i ), simd_load4_avx2( b + i ), acc0 );
+		acc1 = _mm256_fmadd_pd( simd_load4_avx2( a + i + 4 ), simd_load4_avx2( b + i + 4 ), acc1 );
+	}
+	for( ; i + 4 <= n; i += 4 )
+		acc0 = _mm256_fmadd_pd( simd_load4_avx2( a + i ), simd_load4_avx2( b + i ), acc0 );
+	if( i < n )
+	{
+		acc1 = _mm256_fmadd_pd( simd_maskload4_avx2( a + i, n - i ), simd_maskload4_avx2( b + i, n - i ), acc1 );
+	}
+	return simd_horizontal_sum_avx2( _mm256_add_pd( acc0, acc1 ) );
+}
+
+SIMD_TARGET("avx2,fma")
+static double simd_distance_avx2( const svm_feature * a, const svm_feature * b, int n )
+{
+	__m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+	int i = 0;
+	for( ; i + 8 <= n; i += 8 )
+	{
+		__m256d d0 = _mm256_sub_pd( simd_load4_avx2( a + i ), simd_load4_avx2( b + i ) );
+		__m256d d1 = _mm256_sub_pd( simd_load4_avx2( a + i + 4 ), simd_load4_avx2( b + i + 4 ) );
+		acc0 = _mm256_fmadd_pd( d0, d0, acc0 );
+		acc1 = _mm256_fmadd_pd( d1, d1, acc1 );
+	}
+	for( ; i + 4 <= n; i += 4 )
+	{
+		__m256d d0 = _mm256_sub_pd( simd_load4_avx2( a + i ), simd_load4_avx2( b + i ) );
+		acc0 = _mm256_fmadd_pd( d0, d0, acc0 );
+	}
+	if( i < n )
+	{
+		__m256d d1 = _mm256_sub_pd( simd_maskload4_avx2( a + i, n - i ), simd_maskload4_avx2( b + i, n - i ) );
+		acc1 = _mm256_fmadd_pd( d1, d1, acc1 );
+	}
+	return simd_horizontal_sum_avx2( _mm256_add_pd( acc0, acc1 ) );
+}
+
+SIMD_TARGET("avx2,fma")
+static double simd_norm_avx2( const svm_feature * a, int n )
+{
+	return simd_dot_avx2( a, a, n );
+}
+
+SIMD_TARGET("avx2,fma")
+static void simd_dot4_avx2( const svm_feature * a, const svm_feature * const * b, int n, double * out )
+{
+	__m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd(), acc2 = _mm256_setzero_pd(), acc3 = _mm256_setzero_pd();
+	int i = 0;
+	for( ; i + 4 <= n; i += 4 )
+	{
+		__m256d v = simd_load4_avx2( a + i );
+		acc0 = _mm256_fmadd_pd( v, simd_load4_avx2( b[0] + i ), acc0 );
+		acc1 = _mm256_fmadd_pd( v, simd_load4_avx2( b[1] + i ), acc1 );
+		acc2 = _mm256_fmadd_pd( v, simd_load4_avx2( b[2] + i ), acc2 );
+		acc3 = _mm256_fmadd_pd( v, simd_load4_avx2( b[3] + i ), acc3 );
+	}
+	if( i < n )
+	{
+		__m256d v = simd_maskload4_avx2( a + i, n - i );
+		acc0 = _mm256_fmadd_pd( v, simd_maskload4_avx2( b[0] + i, n - i ), acc0 );
+		acc1 = _mm256_fmadd_pd( v, simd_maskload4_avx2( b[1] + i, n - i ), acc1 );
+		acc2 = _mm256_fmadd_pd( v, simd_maskload4_avx2( b[2] + i, n - i ), acc2 );
+		acc3 = _mm256_fmadd_pd( v, simd_maskload4_avx2( b[3] + i, n - i ), acc3 );
+	}
+	// reduce the four accumulators into one vector of sums
+	__m256d h01 = _mm256_hadd_pd( acc0, acc1 );
+	__m256d h23 = _mm256_hadd_pd( acc2, acc3 );
+	__m256d lo = _mm256_permute2f128_pd( h01, h23, 0x20 );
+	__m256d hi = _mm256_permute2f128_pd( h01, h23, 0x31 );
+	_mm256_storeu_pd( out, _mm256_add_pd( lo, hi ) );
+}
+
+SIMD_TARGET("avx2,fma")
+static inline __m256d simd_gather4_avx2( const double * base, __m128i index )
+{
+	return _mm256_i32gather_pd( base, index, 8 );
+}
+
+SIMD_TARGET("avx2,fma")
+static inline __m256d simd_gather4_avx2( const float * base, __m128i index )
+{
+	return _mm256_cvtps_pd( _mm_i32gather_ps( base, index, 4 ) );
+}
+
+SIMD_TARGET("avx2,fma")
+static double simd_sparse_dot_avx2( const int * index, const svm_feature * value, int nnz, const svm_feature * dense )
+{
+	__m256d acc = _mm256_setzero_pd();
+	int k = 0;
+	for( ; k + 4 <= nnz; k += 4 )
+	{
+		__m128i idx = _mm_loadu_si128( (const __m128i *)( index + k ) );
+		acc = _mm256_fmadd_pd( simd_load4_avx2( value + k ), simd_gather4_avx2( dense, idx ), acc );
+	}
+	double sum = simd_horizontal_sum_avx2( acc );
+	for( ; k < nnz; k++ )
+		sum += (double) value[k] * dense[ index[k] ];
+	return sum;
+}
+
+SIMD_TARGET("avx2,fma")
+static void simd_axpy_avx2( double * y, const float * a, double alpha, int n )
+{
+	const __m256d s = _mm256_set1_pd( alpha );
+	int i = 0;
+	for( ; i + 8 <= n; i += 8 )
+	{
+		_mm256_storeu_pd( y + i, _mm256_fmadd_pd( simd_load4_avx2( a + i ), s, _mm256_loadu_pd( y + i ) ) );
+		_mm256_storeu_pd( y + i + 4, _mm256_fmadd_pd( simd_load4_avx2( a + i + 4 ), s, _mm256_loadu_pd( y + i + 4 ) ) );
+	}
+	simd_axpy_scalar( y + i, a + i, alpha, n - i );
+}
+
+SIMD_TARGET("avx2,fma")
+static void simd_axpy2_avx2( double * y, const float * a, double alpha, const float * b, double beta, int n )
+{
+	const __m256d s = _mm256_set1_pd( alpha ), t = _mm256_set1_pd( beta );
+	int i = 0;
+	for( ; i + 4 <= n; i += 4 )
+	{
+		__m256d d = _mm256_fmadd_pd( simd_load4_avx2( b + i ), t, _mm256_mul_pd( simd_load4_avx2( a + i ), s ) );
+		_mm256_storeu_pd( y + i, _mm256_add_pd( _mm256_loadu_pd( y + i ), d ) );
+	}
+	simd_axpy2_scalar( y + i, a + i, alpha, b + i, beta, n - i );
+}
+
+SIMD_TARGET("avx2,fma")
+static double simd_gather_dot_avx2( const int * index, const double * weight, int n, const float * x )
+{
+	__m256d acc = _mm256_setzero_pd();
+	int k = 0;
+	for( ; k + 4 <= n; k += 4 )
+	{
+		__m128i idx = _mm_loadu_si128( (const __m128i *)( index + k ) );
+		acc = _mm256_fmadd_pd( _mm256_loadu_pd( weight + k ), simd_gather4_avx2( x, idx ), acc );
+	}
+	double sum = simd_horizontal_sum_avx2( acc );
+	for( ; k < n; k++ )
+		sum += weight[k] * x[ index[k] ];
+	return sum;
+}
+
+// AVX-512 versions, eight lanes, masked tail
+SIMD_TARGET("avx512f")
+static inline __m512d simd_load8_avx512( const double * p )
+{
+	return _mm512_loadu_pd( p );
+}
+
+SIMD_TARGET("avx512f")
+static inline __m512d simd_load8_avx512( const float * p )
+{
+	return _mm512_cvtps_pd( _mm256_loadu_ps( p ) );
+}
+
+SIMD_TARGET("avx512f")
+static inline __m512d simd_maskload8_avx512( __mmask8 mask, const double * p )
+{
+	return _mm512_maskz_loadu_pd( mask, p );
+}
+
+SIMD_TARGET("avx512f")
+static inline __m512d simd_maskload8_avx512( __mmask8 mask, const float * p )
+{
+	return _mm512_cvtps_pd( _mm512_castps512_ps256( _mm512_maskz_loadu_ps( (__mmask16) mask, p ) ) );
+}
+
+SIMD_TARGET("avx512f")
+static inline __m512d simd_exp_pd_avx512( __m512d x )
+{
+	x = _mm512_min_pd( _mm512_max_pd( x, _mm512_set1_pd( SIMD_EXP_MIN ) ), _mm512_set1_pd( SIMD_EXP_MAX ) );
+	__m512d n = _mm512_roundscale_pd( _mm512_mul_pd( x, _mm512_set1_pd( SIMD_LOG2E ) ), _MM_FROUND_TO_NEAREST_INT );
+	__m512d r = _mm512_fnmadd_pd( n, _mm512_set1_pd( SIMD_LN2_HI ), x );
+	r = _mm512_fnmadd_pd( n, _mm512_set1_pd( SIMD_LN2_LO ), r );
+	__m512d p = _mm512_set1_pd( 1.0 / 5040 );
+	p = _mm512_fmadd_pd( p, r, _mm512_set1_pd( 1.0 / 720 ) );
+	p = _mm512_fmadd_pd( p, r, _mm512_set1_pd( 1.0 / 120 ) );
+	p = _mm512_fmadd_pd( p, r, _mm512_set1_pd( 1.0 / 24 ) );
+	p = _mm512_fmadd_pd( p, r, _mm512_set1_pd( 1.0 / 6 ) );
+	p = _mm512_fmadd_pd( p, r, _mm512_set1_pd( 0.5 ) );
+	p = _mm512_fmadd_pd( p, r, _mm512_set1_pd( 1.0 ) );
+	p = _mm512_fmadd_pd( p, r, _mm512_set1_pd( 1.0 ) );
+	return _mm512_scalef_pd( p, n );
+}
+
+SIMD_TARGET("avx512f")
+static void simd_exp_row_avx512( double * v, int n )
+{
+	int i = 0;
+	for( ; i + 8 <= n; i += 8 )
+		_mm512_storeu_pd( v + i, simd_exp_pd_avx512( _mm512_loadu_pd( v + i ) ) );
+	if( i < n )
+	{
+		__mmask8 mask = (__mmask8)( ( 1u << ( n - i ) ) - 1 );
+		_mm512_mask_storeu_pd( v + i, mask, simd_exp_pd_avx512( _mm512_maskz_loadu_pd( mask, v + i ) ) );
+	}
+}
+
+SIMD_TARGET("avx512f")
+static void simd_tanh_row_avx512( double * v, int n )
+{
+	// tanh(x) = 1 - 2 / (exp(2x) + 1)
+	const __m512d one = _mm512_set1_pd( 1.0 ), two = _mm512_set1_pd( 2.0 );
+	int i = 0;
+	for( ; i < n; i += 8 )
+	{
+		__mmask8 mask = n - i >= 8 ? (__mmask8) 0xff : (__mmask8)( ( 1u << ( n - i ) ) - 1 );
+		__m512d e = simd_exp_pd_avx512( _mm512_mul_pd( two, _mm512_maskz_loadu_pd( mask, v + i ) ) );
+		_mm512_mask_storeu_pd( v + i, mask, _mm512_sub_pd( one, _mm512_div_pd( two, _mm512_add_pd( e, one ) ) ) );
+	}
+}
+
+SIMD_TARGET("avx512f")
+static double simd_dot_avx512( const svm_feature * a, const svm_feature * b, int n )
+{
+	__m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd();
+	int i = 0;
+	for( ; i + 16 <= n; i += 16 )
+	{
+		acc0 = _mm512_fmadd_pd( simd_load8_avx512( a + i ), simd_load8_avx512( b + i ), acc0 );
+		acc1 = _mm512_fmadd_pd( simd_load8_avx512( a + i + 8 ), simd_load8_avx512( b + i + 8 ), acc1 );
+	}
+	for( ; i + 8 <= n; i += 8 )
+		acc0 = _mm512_fmadd_pd( simd_load8_avx512( a + i ), simd_load8_avx512( b + i ), acc0 );
+	if( i < n )
+	{
+		__mmask8 mask = (__mmask8)( ( 1u << ( n - i ) ) - 1 );
+		acc1 = _mm512_fmadd_pd( simd_maskload8_avx512( mask, a + i ), simd_maskload8_avx512( mask, b + i ), acc1 );
+	}
+	return _mm512_reduce_add_pd( _mm512_add_pd( acc0, acc1 ) );
+}
+
+SIMD_TARGET("avx512f")
+static double simd_distance_avx512( const svm_feature * a, const svm_feature * b, int n )
+{
+	__m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd();
+	int i = 0;
+	for( ; i + 16 <= n; i += 16 )
+	{
+		__m512d d0 = _mm512_sub_pd( simd_load8_avx512( a + i ), simd_load8_avx512( b + i ) );
+		__m512d d1 = _mm512_sub_pd( simd_load8_avx512( a + i + 8 ), simd_load8_avx512( b + i + 8 ) );
+		acc0 = _mm512_fmadd_pd( d0, d0, acc0 );
+		acc1 = _mm512_fmadd_pd( d1, d1, acc1 );
+	}
+	for( ; i + 8 <= n; i += 8 )
+	{
+		__m512d d0 = _mm512_sub_pd( simd_load8_avx512( a + i ), simd_load8_avx512( b + i ) );
+		acc0 = _mm512_fmadd_pd( d0, d0, acc0 );
+	}
+	if( i < n )
+	{
+		__mmask8 mask = (__mmask8)( ( 1u << ( n - i ) ) - 1 );
+		__m512d d1 = _mm512_sub_pd( simd_maskload8_avx512( mask, a + i ), simd_maskload8_avx512( mask, b + i ) );
+		acc1 = _mm512_fmadd_pd( d1, d1, acc1 );
+	}
+	return _mm512_reduce_add_pd( _mm512_add_pd( acc0, acc1 ) );
+}
+
+SIMD_TARGET("avx512f")
+static double simd_norm_avx512( const svm_feature * a, int n )
+{
+	return simd_dot_avx512( a, a, n );
+}
+
+SIMD_TARGET("avx512f")
+static void simd_dot4_avx512( const svm_feature * a, const svm_feature * const * b, int n, double * out )
+{
+	__m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd(), acc2 = _mm512_setzero_pd(), acc3 = _mm512_setzero_pd();
+	int i = 0;
+	for( ; i + 8 <= n; i += 8 )
+	{
+		__m512d v = simd_load8_avx512( a + i );
+		acc0 = _mm512_fmadd_pd( v, simd_load8_avx512( b[0] + i ), acc0 );
+		acc1 = _mm512_fmadd_pd( v, simd_load8_avx512( b[1] + i ), acc1 );
+		acc2 = _mm512_fmadd_pd( v, simd_load8_avx512( b[2] + i ), acc2 );
+		acc3 = _mm512_fmadd_pd( v, simd_load8_avx512( b[3] + i ), acc3 );
+	}
+	if( i < n )
+	{
+		__mmask8 mask = (__mmask8)( ( 1u << ( n - i ) ) - 1 );
+		__m512d v = simd_maskload8_avx512( mask, a + i );
+		acc0 = _mm512_fmadd_pd( v, simd_maskload8_avx512( mask, b[0] + i ), acc0 );
+		acc1 = _mm512_fmadd_pd( v, simd_maskload8_avx512( mask, b[1] + i ), acc1 );
+		acc2 = _mm512_fmadd_pd( v, simd_maskload8_avx512( mask, b[2] + i ), acc2 );
+		acc3 = _mm512_fmadd_pd( v, simd_maskload8_avx512( mask, b[3] + i ), acc3 );
+	}
+	out[0] = _mm512_reduce_add_pd( acc0 );
+	out[1] = _mm512_reduce_add_pd( acc1 );
+	out[2] = _mm512_reduce_add_pd( acc2 );
+	out[3] = _mm512_reduce_add_pd( acc3 );
+}
+
+SIMD_TARGET("avx512f")
+static inline __m512d simd_gather8_avx512( const double * base, __m256i index )
+{
+	return _mm512_i32gather_pd( index, base, 8 );
+}
+
+SIMD_TARGET("avx512f")
+static inline __m512d simd_gather8_avx512( const float * base, __m256i index )
+{
+	return _mm512_cvtps_pd( _mm256_i32gather_ps( base, index, 4 ) );
+}
+
+SIMD_TARGET("avx512f")
+static double simd_sparse_dot_avx512( const int * index, const svm_feature * value, int nnz, const svm_feature * dense )
+{
+	__m512d acc = _mm512_setzero_pd();
+	int k = 0;
+	for( ; k + 8 <= nnz; k += 8 )
+	{
+		__m256i idx = _mm256_loadu_si256( (const __m256i *)( index + k ) );
+		acc = _mm512_fmadd_pd( simd_load8_avx512( value + k ), simd_gather8_avx512( dense, idx ), acc );
+	}
+	double sum = _mm512_reduce_add_pd( acc );
+	for( ; k < nnz; k++ )
+		sum += (double) value[k] * dense[ index[k] ];
+	return sum;
+}
+
+SIMD_TARGET("avx512f")
+static void simd_axpy_avx512( double * y, const float * a, double alpha, int n )
+{
+	const __m512d s = _mm512_set1_pd( alpha );
+	int i = 0;
+	for( ; i + 8 <= n; i += 8 )
+		_mm512_storeu_pd( y + i, _mm512_fmadd_pd( simd_load8_avx512( a + i ), s, _mm512_loadu_pd( y + i ) ) );
+	if( i < n )
+	{
+		__mmask8 mask = (__mmask8)( ( 1u << ( n - i ) ) - 1 );
+		_mm512_mask_storeu_pd( y + i, mask, _mm512_fmadd_pd( simd_maskload8_avx512( mask, a + i ), s, _mm512_maskz_loadu_pd( mask, y + i ) ) );
+	}
+}
+
+SIMD_TARGET("avx512f")
+static void simd_axpy2_avx512( double * y, const float * a, double alpha, const float * b, double beta, int n )
+{
+	const __m512d s = _mm512_set1_pd( alpha ), t = _mm512_set1_pd( beta );
+	int i = 0;
+	for( ; i < n; i += 8 )
+	{
+		__mmask8 mask = n - i >= 8 ? (__mmask8) 0xff : (__mmask8)( ( 1u << ( n - i ) ) - 1 );
+		__m512d d = _mm512_fmadd_pd( simd_maskload8_avx512( mask, b + i ), t, _mm512_mul_pd( simd_maskload8_avx512( mask, a + i ), s ) );
+		_mm512_mask_storeu_pd( y + i, mask, _mm512_add_pd( _mm512_maskz_loadu_pd( mask, y + i ), d ) );
+	}
+}
+
+SIMD_TARGET("avx512f")
+static double simd_gather_dot_avx512( const int * index, const double * weight, int n, const float * x )
+{
+	__m512d acc = _mm512_setzero_pd();
+	int k = 0;
+	for( ; k + 8 <= n; k += 8 )
+	{
+		__m256i idx = _mm256_loadu_si256( (const __m256i *)( index + k ) );
+		acc = _mm512_fmadd_pd( _mm512_loadu_pd( weight + k ), simd_gather8_avx512( x, idx ), acc );
+	}
+	double sum = _mm512_reduce_add_pd( acc );
+	for( ; k < n; k++ )
+		sum += weight[k] * x[ index[k] ];
+	return sum;
+}
+
+// 16 bit floats: F16C (present on every AVX2 processor) and AVX-512F convert
+// fp16 in hardware; bf16 is integer rounding on the float bits. The vector
+// bf16 encoders do not special-case nan, which kernel values never are.
+SIMD_TARGET("avx2,f16c")
+static void simd_fp16_decode_avx2( const unsigned short * src, float * dst, int n )
+{
+	int i = 0;
+	for( ; i + 8 <= n; i += 8 )
+		_mm256_storeu_ps( dst + i, _mm256_cvtph_ps( _mm_loadu_si128( (const __m128i *)( src + i ) ) ) );
+	simd_fp16_decode_scalar( src + i, dst + i, n - i );
+}
+
+SIMD_TARGET("avx2,f16c")
+static void simd_fp16_encode_avx2( const float * src, unsigned short * dst, int n )
+{
+	int i = 0;
+	for( ; i + 8 <= n; i += 8 )
+		_mm_storeu_si128( (__m128i *)( dst + i ), _mm256_cvtps_ph( _mm256_loadu_ps( src + i ), _MM_FROUND_TO_NEAREST_INT ) );
+	simd_fp16_encode_scalar( src + i, dst + i, n - i );
+}
+
+SIMD_TARGET("avx2")
+static void simd_bf16_decode_avx2( const unsigned short * src, float * dst, int n )
+{
+	int i = 0;
+	for( ; i + 8 <= n; i += 8 )
+	{
+		__m256i x = _mm256_slli_epi32( _mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i *)( src + i ) ) ), 16 );
+		_mm256_storeu_ps( dst + i, _mm256_castsi256_ps( x ) );
+	}
+	simd_bf16_decode_scalar( src + i, dst + i, n - i );
+}
+
+SIMD_TARGET("avx2")
+static void simd_bf16_encode_avx2( const float * src, unsigned short * dst, int n )
+{
+	const __m256i bias = _mm256_set1_epi32( 0x7fff );
+	const __m256i one = _mm256_set1_epi32( 1 );
+	int i = 0;
+	for( ; i + 8 <= n; i += 8 )
+	{
+		__m256i x = _mm256_castps_si256( _mm256_loadu_ps( src + i ) );
+		__m256i lsb = _mm256_and_si256( _mm256_srli_epi32( x, 16 ), one );
+		__m256i r = _mm256_srli_epi32( _mm256_add_epi32( _mm256_add_epi32( x, bias ), lsb ), 16 );
+		_mm_storeu_si128( (__m128i *)( dst + i ), _mm_packus_epi32( _mm256_castsi256_si128( r ), _mm256_extracti128_si256( r, 1 ) ) );
+	}
+	simd_bf16_encode_scalar( src + i, dst + i, n - i );
+}
+
+SIMD_TARGET("avx512f")
+static void simd_fp16_decode_avx512( const unsigned short * src, float * dst, int n )
+{
+	int i = 0;
+	for( ; i + 16 <= n; i += 16 )
+		_mm512_storeu_ps( dst + i, _mm512_cvtph_ps( _mm256_loadu_si256( (const __m256i *)( src + i ) ) ) );
+	simd_fp16_decode_avx2( src + i, dst + i, n - i );
+}
+
+SIMD_TARGET("avx512f")
+static void simd_fp16_encode_avx512( const float * src, unsigned short * dst, int n )
+{
+	int i = 0;
+	for( ; i + 16 <= n; i += 16 )
+		_mm256_storeu_si256( (__m256i *)( dst + i ), _mm512_cvtps_ph( _mm512_loadu_ps( src + i ), _MM_FROUND_TO_NEAREST_INT ) );
+	simd_fp16_encode_avx2( src + i, dst + i, n - i );
+}
+
+// CPUID based detection, including the OS support check for the wide registers
+static int simd_detect_level()
+{
+#if defined(_MSC_VER)
+	// variables
+	int info[4];
+	int level = SIMD_LEVEL_SCALAR;
+
+	// function body
+	__cpuid( info, 1 );
+	if( !( info[2] & ( 1 << 19 ) ) )
+		return SIMD_LEVEL_SCALAR;
+	level = SIMD_LEVEL_SSE4;
+	// osxsave, avx and fma, then check that the OS saves ymm/zmm state
+	if( ( info[2] & ( 1 << 27 ) ) && ( info[2] & ( 1 << 28 ) ) && ( info[2] & ( 1 << 12 ) ) )
+	{
+		unsigned long long xcr0 = _xgetbv( 0 );
+		__cpuidex( info, 7, 0 );
+		if( ( xcr0 & 0x6 ) == 0x6 && ( info[1] & ( 1 << 5 ) ) )
+			level = SIMD_LEVEL_AVX2;
+		if( ( xcr0 & 0xe6 ) == 0xe6 && ( info[1] & ( 1 << 16 ) ) )
+			level = SIMD_LEVEL_AVX512;
+	}
+	return level;
+#else
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports( "avx512f" ) )
+		return SIMD_LEVEL_AVX512;
+	if( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) )
+		return SIMD_LEVEL_AVX2;
+	if( __builtin_cpu_supports( "sse4.1" ) )
+		return SIMD_LEVEL_SSE4;
+	return SIMD_LEVEL_SCALAR;
+#endif
+}
+
+#else
+
+static int simd_detect_level()
+{
+	return SIMD_LEVEL_SCALAR;
+}
+
+#endif
+
+// dispatch table, filled once by simd_select()
+struct simd_table
+{
+	int level;
+	simd_dot_function dot;
+	simd_dot_function distance;
+	simd_norm_function norm;
+	simd_dot4_function dot4;
+	simd_sparse_dot_function sparse_dot;
+	simd_axpy_function axpy;
+	simd_axpy2_function axpy2;
+	simd_gather_dot_function gather_dot;
+	// approximate transforms for the fast mode, exact libm loops below AVX2
+	simd_row_function fast_exp;
+	simd_row_function fast_tanh;
+	simd_half_decode_function fp16_decode;
+	simd_half_encode_function fp16_encode;
+	simd_half_decode_function bf16_decode;
+	simd_half_encode_function bf16_encode;
+};
+
+static simd_table simd_select()
+{
+	// variables
+	simd_table table;
+
+	// function body
+	table.level = simd_detect_level();
+	table.dot = &simd_dot_scalar;
+	table.distance = &simd_distance_scalar;
+	table.norm = &simd_norm_scalar;
+	table.dot4 = &simd_dot4_scalar;
+	table.sparse_dot = &simd_sparse_dot_scalar;
+	table.axpy = &simd_axpy_scalar;
+	table.axpy2 = &simd_axpy2_scalar;
+	table.gather_dot = &simd_gather_dot_scalar;
+	table.fast_exp = &simd_exp_row_exact;
+	table.fast_tanh = &simd_tanh_row_exact;
+	table.fp16_decode = &simd_fp16_decode_scalar;
+	table.fp16_encode = &simd_fp16_encode_scalar;
+	table.bf16_decode = &simd_bf16_decode_scalar;
+	table.bf16_encode = &simd_bf16_encode_scalar;
+#ifndef SIMD_NO_X86
+	switch( table.level )
+	{
+		case SIMD_LEVEL_AVX512:
+			table.dot = &simd_dot_avx512;
+			table.distance = &simd_distance_avx512;
+			table.norm = &simd_norm_avx512;
+			table.dot4 = &simd_dot4_avx512;
+			table.sparse_dot = &simd_sparse_dot_avx512;
+			table.axpy = &simd_axpy_avx512;
+			table.axpy2 = &simd_axpy2_avx512;
+			table.gather_dot = &simd_gather_dot_avx512;
+			table.fast_exp = &simd_exp_row_avx512;
+			table.fast_tanh = &simd_tanh_row_avx512;
+			table.fp16_decode = &simd_fp16_decode_avx512;
+			table.fp16_encode = &simd_fp16_encode_avx512;
+			table.bf16_decode = &simd_bf16_decode_avx2;
+			table.bf16_encode = &simd_bf16_encode_avx2;
+			break;
+		case SIMD_LEVEL_AVX2:
+			table.dot = &simd_dot_avx2;
+			table.distance = &simd_distance_avx2;
+			table.norm = &simd_norm_avx2;
+			table.dot4 = &simd_dot4_avx2;
+			table.sparse_dot = &simd_sparse_dot_avx2;
+			table.axpy = &simd_axpy_avx2;
+			table.axpy2 = &simd_axpy2_avx2;
+			table.gather_dot = &simd_gather_dot_avx2;
+			table.fast_exp = &simd_exp_row_avx2;
+			table.fast_tanh = &simd_tanh_row_avx2;
+			table.fp16_decode = &simd_fp16_decode_avx2;
+			table.fp16_encode = &simd_fp16_encode_avx2;
+			table.bf16_decode = &simd_bf16_decode_avx2;
+			table.bf16_encode = &simd_bf16_encode_avx2;
+			break;
+		case SIMD_LEVEL_SSE4:
+			table.dot = &simd_dot_sse4;
+			table.distance = &simd_distance_sse4;
+			table.norm = &simd_norm_sse4;
+			table.dot4 = &simd_dot4_sse4;
+			break;
+		default:
+			break;
+	}
+#endif
+	return table;
+}
+
+static const simd_table simd = simd_select();
+
+// entry points
+static inline double simd_dot( const svm_feature * a, const svm_feature * b, int n )
+{
+	return simd.dot( a, b, n );
+}
+
+static inline double simd_squared_distance( const svm_feature * a, const svm_feature * b, int n )
+{
+	return simd.distance( a, b, n );
+}
+
+static inline double simd_squared_norm( const svm_feature * a, int n )
+{
+	return n > 0 ? simd.norm( a, n ) : 0;
+}
+
+static inline void simd_dot4( const svm_feature * a, const svm_feature * const * b, int n, double * out )
+{
+	simd.dot4( a, b, n, out );
+}
+
+static inline double simd_sparse_dot( const int * index, const svm_feature * value, int nnz, const svm_feature * dense )
+{
+	return simd.sparse_dot( index, value, nnz, dense );
+}
+
+// y += alpha * a (+ beta * b), the solver's gradient updates
+static inline void simd_axpy( double * y, const float * a, double alpha, int n )
+{
+	simd.axpy( y, a, alpha, n );
+}
+
+static inline void simd_axpy2( double * y, const float * a, double alpha, const float * b, double beta, int n )
+{
+	simd.axpy2( y, a, alpha, b, beta, n );
+}
+
+static inline double simd_gather_dot( const int * index, const double * weight, int n, const float * x )
+{
+	return simd.gather_dot( index, weight, n, x );
+}
+
+// in-place row transforms; fast != 0 trades libm accuracy for speed
+static inline void simd_exp_row( double * v, int n, int fast )
+{
+	if( fast )
+		simd.fast_exp( v, n );
+	else
+		simd_exp_row_exact( v, n );
+}
+
+static inline void simd_tanh_row( double * v, int n, int fast )
+{
+	if( fast )
+		simd.fast_tanh( v, n );
+	else
+		simd_tanh_row_exact( v, n );
+}
+
+// format is SIMD_HALF_FP16 or SIMD_HALF_BF16
+static inline void simd_half_decode( int format, const unsigned short * src, float * dst, int n )
+{
+	if( format == SIMD_HALF_BF16 )
+		simd.bf16_decode( src, dst, n );
+	else
+		simd.fp16_decode( src, dst, n );
+}
+
+static inline void simd_half_encode( int format, const float * src, unsigned short * dst, int n )
+{
+	if( format == SIMD_HALF_BF16 )
+		simd.bf16_encode( src, dst, n );
+	else
+		simd.fp16_encode( src, dst, n );
+}
+
+#endif
@@ -12,11 +12,18 @@ extern "C" {
 
 extern int libsvm_version;
 
+/* feature storage type; build with SVM_FLOAT_FEATURES for float32 features (kernel sums and the solver gradient stay double, device feature and Q buffers follow this type) */
+#ifdef SVM_FLOAT_FEATURES
+typedef float svm_feature;
+#else
+typedef double svm_feature;
+#endif
+
 #ifdef _DENSE_REP
 struct svm_node
 {
 	int dim;
-	double *values;
+	svm_feature *values;
 };
 
 struct svm_problem
@@ -42,6 +49,11 @@ struct svm_problem
 #endif
 
 enum { C_SVC, NU_SVC, ONE_CLASS, EPSILON_SVR, NU_SVR };	/* svm_type */
+enum { TRANSFORM_EXACT, TRANSFORM_FAST };	/* kernel transform accuracy: libm, or Qfloat-accurate polynomial */
+enum { CACHE_FLOAT32, CACHE_FP16, CACHE_BF16 };	/* kernel cache column storage */
+enum { NUMA_OFF, NUMA_INTERLEAVE, NUMA_PARTITION };	/* kernel cache and feature matrix placement */
+enum { SOLVER_CPU, SOLVER_DEVICE };	/* where the solver keeps the gradient */
+enum { NYSTROM_RANDOM, NYSTROM_KMEANS };	/* Nystrom landmark selection */
 enum { LINEAR = 0, POLY=1, RBF=2, SIGMOID=3, PRECOMPUTED=4, LINEAR_OPENCL=5, WIDE_LINEAR_OPENCL=6 /* 6 */, WIDE_POLY_OPENCL=7, WIDE_RBF_OPENCL=8, WIDE_SIGMOID_OPENCL=9 }; /* kernel_type */
 
 struct svm_parameter
@@ -63,6 +75,7 @@ struct svm_parameter
 	double p;	/* for EPSILON_SVR */
 	int shrinking;	/* use the shrinking heuristics */
 	int probability; /* do probability estimates */
+	int nystrom_landmarks;	/* rank of the Nystrom approximation of K, 0 for the exact kernel; the model keeps its support vectors on the landmarks */
 };
 
 //
@@ -83,6 +96,7 @@ struct svm_model
 	double *probA;		/* pariwise probability information */
 	double *probB;
 	int *sv_indices;        /* sv_indices[0,...,nSV-1] are values in [1,...,num_traning_data] to indicate SVs in the training set */
+	double *sv_norm;	/* squared norms of the SVs for RBF models (sv_norm[l]), NULL otherwise */
 	
 	/* for classification only */
 
@@ -94,7 +108,38 @@ struct svm_model
 				/* 0 if svm_model is created by svm_train */
 };
 
+/* counters accumulated by training since the last svm_reset_metrics (times in seconds) */
+struct svm_metrics
+{
+	unsigned long long cache_hits;		/* kernel columns served whole from the CPU cache */
+	unsigned long long cache_misses;	/* kernel columns (partly) computed */
+	unsigned long long cache_evictions;	/* columns dropped to make room */
+	unsigned long long cache_bytes;		/* peak bytes of cached columns */
+	unsigned long long gpu_cache_hits;
+	unsigned long long gpu_cache_misses;
+	unsigned long long gpu_cache_invalidations;
+	unsigned long long transfer_bytes;	/* host <-> device copies */
+	unsigned long long pool_hits;		/* device buffers reused from the pool */
+	unsigned long long pool_misses;		/* device buffers the pool had to allocate */
+	unsigned long long pool_bytes;		/* device memory reserved by the pool at kernel teardown, largest over kernels */
+	unsigned long long wss_count;		/* working set selections */
+	unsigned long long iterations;		/* SMO iterations */
+	double column_fill_time;	/* computing kernel columns on cache misses */
+	double wss_time;		/* working set selection */
+};
+
 struct svm_model *svm_train(const struct svm_problem *prob, const struct svm_parameter *param);
+/* starts the solver from init_alpha instead of zero: nr_class-1 rows of prob->l
+   coefficients in sv_coef layout (one row for one-class and regression), e.g. a
+   previous model's sv_coef scattered by sv_indices; clipped to the new bounds
+   and made feasible, then refined. init_label names the nr_class classes in the
+   order init_alpha's rows use, e.g. the previous model's svm_get_labels, and
+   must hold the same labels as prob->y or the start is cold; NULL means the
+   order labels first appear in prob->y, which only matches a model trained on
+   data with the same first appearances. C_SVC and EPSILON_SVR only, the nu
+   formulations start cold */
+struct svm_model *svm_train_warm(const struct svm_problem *prob, const struct svm_parameter *param, const double *init_alpha,
+				 const int *init_label);
 void svm_cross_validation(const struct svm_problem *prob, const struct svm_parameter *param, int nr_fold, double *target);
 
 int svm_save_model(const char *model_file_name, const struct svm_model *model);
@@ -123,6 +168,32 @@ const char *svm_check_parameter(const struct svm_problem *prob, const struct svm
 int svm_check_probability_model(const struct svm_model *model);
 
 void svm_set_print_string_function(void (*print_func)(const char *));
+void svm_set_num_threads(int nr_thread, int min_parallel_len);	/* nr_thread <= 0: one per core; min_parallel_len <= 0: keep current */
+void svm_set_transform_mode(int mode);	/* TRANSFORM_EXACT (default) or TRANSFORM_FAST */
+void svm_set_cache_huge_pages(int enable);
+void svm_set_cache_precision(int precision);	/* CACHE_FLOAT32 (default), CACHE_FP16 (RBF and sigmoid only, 32 bit for other kernels) or CACHE_BF16 kernel cache columns */
+void svm_set_numa_policy(int policy);	/* NUMA_OFF (default), NUMA_INTERLEAVE or NUMA_PARTITION, before allocating the feature matrix; the kernel cache is interleaved under either */
+void svm_set_gpu_cache_size(double size);	/* MB per OpenCL buffer cache, 0 for a share of device memory */
+void svm_set_shared_cache_size(double size);	/* MB of kernel rows shared across subproblems and CV folds, 0 to disable */
+void svm_set_kernel_store(const char *directory);	/* keep kernel rows in a mapped file in directory, NULL to disable */
+void svm_set_prefetch(int depth);	/* kernel columns computed ahead of the next working set (at most 8), 0 to disable */
+void svm_set_solver_mode(int mode);	/* SOLVER_CPU (default, no OpenCL unless the kernel needs it) or SOLVER_DEVICE */
+void svm_set_check_gradient(int check);	/* debugging: keep the gradient on both sides and compare after every update */
+void svm_set_working_set_size(int size);	/* variables per solver working set, even, from 2 (default, plain SMO) to 64 */
+void svm_set_nystrom_sampling(int sampling);	/* NYSTROM_RANDOM (default, seeded) or NYSTROM_KMEANS landmarks */
+
+void svm_get_metrics(struct svm_metrics *metrics);
+void svm_reset_metrics(void);
+int svm_save_metrics(const char *file_name);
+
+#ifdef _DENSE_REP
+/* contiguous dense storage: one 64-byte aligned row-major rows x cols block for svm_node views */
+#define SVM_MATRIX_ALIGNMENT 64
+/* below this fraction of non-zeros the kernel works from CSR rows only, and readers keep rows unpadded */
+#define SVM_SPARSE_DENSITY 0.3
+svm_feature *svm_alloc_feature_matrix(int rows, int cols);
+void svm_free_feature_matrix(svm_feature *matrix);
+#endif
 
 #ifdef __cplusplus
 }
@@ -262,6 +262,7 @@ struct svm_model *matlab_matrix_to_model(const mxArray *matlab_struct, const cha
 	model->label = NULL;
 	model->sv_indices = NULL;
 	model->nSV = NULL;
+	model->sv_norm = NULL;
 	model->free_sv = 1; // XXX
 
 	ptr = mxGetPr(rhs[id]);
@@ -404,7 +405,7 @@ struct svm_model *matlab_matrix_to_model(const mxArray *matlab_struct, const cha
 			#ifdef _DENSE_REP
 				// TODO
 				model->SV[i].dim = maxIndex;
-				model->SV[i].values = (double*) calloc( sizeof(double), maxIndex );
+				model->SV[i].values = (svm_feature*) calloc( sizeof(svm_feature), maxIndex );
 				
 				for(j=low;j<high;j++)
 				{
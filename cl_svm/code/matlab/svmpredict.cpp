@@ -41,7 +41,7 @@ void read_sparse_instance(const mxArray *prhs, int index, struct svm_node *x)
 		}
 	}
 	x->dim = maxIndex;
-	x->values = (double*)calloc( sizeof(double), maxIndex );
+	x->values = (svm_feature*)calloc( sizeof(svm_feature), maxIndex );
 	#else
 	#endif
 	for(i=low;i<high;i++)
@@ -197,7 +197,7 @@ void predict(int nlhs, mxArray *plhs[], const mxArray *prhs[], struct svm_model
 		else
 		{
 			#ifdef _DENSE_REP
-				x.values = (double*)calloc( sizeof(double), (feature_number+1) );
+				x.values = (svm_feature*)calloc( sizeof(svm_feature), (feature_number+1) );
 				x.dim = feature_number + 1;
 				for ( i = 0; i < feature_number; i++ )
 				{
@@ -125,6 +125,7 @@ int parse_command_line(int nrhs, const mxArray *prhs[], char *model_file_name)
 	param.p = 0.1;
 	param.shrinking = 1;
 	param.probability = 0;
+	param.nystrom_landmarks = 0;
 	param.nr_weight = 0;
 	param.weight_label = NULL;
 	param.weight = NULL;
@@ -280,7 +281,7 @@ int read_problem_dense(const mxArray *label_vec, const mxArray *instance_mat)
 	{
 		#ifdef _DENSE_REP
 			prob.x[i].dim = sc;
-			prob.x[i].values = (double*) calloc( sizeof(double), (sc + 1) );
+			prob.x[i].values = (svm_feature*) calloc( sizeof(svm_feature), (sc + 1) );
 			prob.y[i] = labels[i];
 		#else
 			prob.x[i] = &x_space[j];
@@ -411,7 +412,7 @@ int read_problem_sparse(const mxArray *label_vec, const mxArray *instance_mat)
 
 		#ifdef _DENSE_REP
 			prob.x[i].dim = maxValueIndex;
-			prob.x[i].values = (double*) calloc( sizeof(double), maxValueIndex );
+			prob.x[i].values = (svm_feature*) calloc( sizeof(svm_feature), maxValueIndex );
 			prob.y[i] = labels[i];
 		#else
 			prob.x[i] = &x_space[j];
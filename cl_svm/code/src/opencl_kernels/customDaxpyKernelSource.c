@@ -1,8 +1,11 @@
+#ifndef FEATURE_TYPE
 #pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#define FEATURE_TYPE double
+#endif
 
 __kernel void custom_daxpy_kernel(
-									__global double * x,
-									const double c
+									__global FEATURE_TYPE * x,
+									const FEATURE_TYPE c
 								 )
 {
 	// variables
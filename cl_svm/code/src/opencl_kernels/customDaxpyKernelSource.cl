@@ -1,8 +1,11 @@
+"#ifndef FEATURE_TYPE\n" \
 "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n" \
+"#define FEATURE_TYPE double\n" \
+"#endif\n" \
 "\n" \
 "__kernel void custom_daxpy_kernel(\n" \
-"									__global double * x,\n" \
-"									const double c\n" \
+"									__global FEATURE_TYPE * x,\n" \
+"									const FEATURE_TYPE c\n" \
 "								 )\n" \
 "{\n" \
 "	// variables\n" \
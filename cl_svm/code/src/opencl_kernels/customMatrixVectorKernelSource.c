@@ -1,12 +1,15 @@
+#ifndef FEATURE_TYPE
 #pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#define FEATURE_TYPE double
+#endif
 
 __kernel void custom_matrix_vector_kernel(
-											__global double * A,
-											__global double * x,
-											__global double * y,
+											__global FEATURE_TYPE * A,
+											__global FEATURE_TYPE * x,
+											__global FEATURE_TYPE * y,
 											//const int rows,
 											const int cols,
-											__local double * scratch,
+											__local FEATURE_TYPE * scratch,
 											//__global double * largerScratch,
 											const int localSize
 											//const int numberOfWorkGroups
@@ -35,10 +38,10 @@ __kernel void custom_matrix_vector_kernel(
 	{
 		int startIndex = localIndex;
 		int aOffset = rowNumber * cols;
-		double sum = 0.0;
+		FEATURE_TYPE sum = 0.0;
 		while ( startIndex < cols )
 		{
-			sum = sum + ( A[ aOffset + startIndex ] * x[ startIndex ] );
+			sum = sum + ( (FEATURE_TYPE) A[ aOffset + startIndex ] * x[ startIndex ] );
 			startIndex = startIndex + localSize;
 		}
 		scratch[ localIndex ] = sum;
@@ -1,15 +1,18 @@
+"#ifndef FEATURE_TYPE\n" \
 "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n" \
+"#define FEATURE_TYPE double\n" \
+"#endif\n" \
 "\n" \
 "__kernel void custom_matrix_vector_kernel(\n" \
-"											__global double * A,\n" \
-"											__global double * x,\n" \
-"											__global double * y,\n" \
+"											__global FEATURE_TYPE * A,\n" \
+"											__global FEATURE_TYPE * x,\n" \
+"											__global FEATURE_TYPE * y,\n" \
 "											const int cols,\n" \
-"											__local double * scratch,\n" \
+"											__local FEATURE_TYPE * scratch,\n" \
 "											const int localSize,\n" \
-"											const double gamma,\n" \
-"											const double coef0,\n" \
-"											__global double * xSquare,\n" \
+"											const FEATURE_TYPE gamma,\n" \
+"											const FEATURE_TYPE coef0,\n" \
+"											__global FEATURE_TYPE * xSquare,\n" \
 "											const int i\n" \
 "											//const int degree\n" \
 "										)\n" \
@@ -37,10 +40,10 @@
 "	{\n" \
 "		int startIndex = localIndex;\n" \
 "		int aOffset = rowNumber * cols;\n" \
-"		double sum = 0.0;\n" \
+"		FEATURE_TYPE sum = 0.0;\n" \
 "		while ( startIndex < cols )\n" \
 "		{\n" \
-"			sum = sum + ( A[ aOffset + startIndex ] * x[ startIndex ] );\n" \
+"			sum = sum + ( (FEATURE_TYPE) A[ aOffset + startIndex ] * x[ startIndex ] );\n" \
 "			startIndex = startIndex + localSize;\n" \
 "		}\n" \
 "		scratch[ localIndex ] = sum;\n" \
@@ -1,14 +1,17 @@
+#ifndef FEATURE_TYPE
 #pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#define FEATURE_TYPE double
+#endif
 
 __kernel void custom_matrix_vector_kernel(
-											__global double * A,
-											__global double * x,
-											__global double * y,
+											__global FEATURE_TYPE * A,
+											__global FEATURE_TYPE * x,
+											__global FEATURE_TYPE * y,
 											const int cols,
-											__local double * scratch,
+											__local FEATURE_TYPE * scratch,
 											const int localSize,
-											const double gamma,
-											const double coef0//,
+											const FEATURE_TYPE gamma,
+											const FEATURE_TYPE coef0//,
 											//const int degree
 										)
 {
@@ -35,10 +38,10 @@ __kernel void custom_matrix_vector_kernel(
 	{
 		int startIndex = localIndex;
 		int aOffset = rowNumber * cols;
-		double sum = 0.0;
+		FEATURE_TYPE sum = 0.0;
 		while ( startIndex < cols )
 		{
-			sum = sum + ( A[ aOffset + startIndex ] * x[ startIndex ] );
+			sum = sum + ( (FEATURE_TYPE) A[ aOffset + startIndex ] * x[ startIndex ] );
 			startIndex = startIndex + localSize;
 		}
 		scratch[ localIndex ] = sum;
@@ -1,4 +1,7 @@
 #pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#ifndef FEATURE_TYPE
+#define FEATURE_TYPE double
+#endif
 #define TAU 1e-12
 
 enum { LOWER_BOUND = 0, UPPER_BOUND = 1, FREE = 2 };
@@ -15,7 +18,7 @@ __kernel void find_candidate_j_values_kernel(  __global signed char * y,
 											   __local double * scratchValues,
 											   __global double * gMaxCandidates,
 											   __local double * scratchGMaxBuffer,
-											   __global double * Q,
+											   __global FEATURE_TYPE * Q,
 											   __global double * G
 											)
 {
@@ -1,4 +1,7 @@
 "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n" \
+"#ifndef FEATURE_TYPE\n" \
+"#define FEATURE_TYPE double\n" \
+"#endif\n" \
 "#define TAU 1e-12\n" \
 "\n" \
 "enum { LOWER_BOUND = 0, UPPER_BOUND = 1, FREE = 2 };\n" \
@@ -15,7 +18,7 @@
 "											   __local double * scratchValues,\n" \
 "											   __global double * gMaxCandidates,\n" \
 "											   __local double * scratchGMaxBuffer,\n" \
-"											   __global double * Q,\n" \
+"											   __global FEATURE_TYPE * Q,\n" \
 "											   __global double * G\n" \
 "											)\n" \
 "{\n" \
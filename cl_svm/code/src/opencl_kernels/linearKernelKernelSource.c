@@ -1,12 +1,16 @@
+#ifndef FEATURE_TYPE
 #pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#define FEATURE_TYPE double
+#endif
+
 #pragma OPENCL EXTENSION cl_amd_printf 
 
 __kernel void linear_kernel_kernel(
-									__global double * x_data_i,
-									__global double * x_data_j,
-									__global double * outputData,
+									__global FEATURE_TYPE * x_data_i,
+									__global FEATURE_TYPE * x_data_j,
+									__global FEATURE_TYPE * outputData,
 									int goodDataSize,
-									__local double * scratchData
+									__local FEATURE_TYPE * scratchData
 								  )
 {
 	// variables
@@ -1,12 +1,16 @@
+"#ifndef FEATURE_TYPE\n" \
 "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n" \
+"#define FEATURE_TYPE double\n" \
+"#endif\n" \
+"\n" \
 "#pragma OPENCL EXTENSION cl_amd_printf \n" \
 "\n" \
 "__kernel void linear_kernel_kernel(\n" \
-"									__global double * x_data_i,\n" \
-"									__global double * x_data_j,\n" \
-"									__global double * outputData,\n" \
+"									__global FEATURE_TYPE * x_data_i,\n" \
+"									__global FEATURE_TYPE * x_data_j,\n" \
+"									__global FEATURE_TYPE * outputData,\n" \
 "									int goodDataSize,\n" \
-"									__local double * scratchData\n" \
+"									__local FEATURE_TYPE * scratchData\n" \
 "								  )\n" \
 "{\n" \
 "	// variables\n" \
@@ -1,17 +1,20 @@
+#ifndef FEATURE_TYPE
 #pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#define FEATURE_TYPE double
+#endif
 
 __kernel void prediction_reduction_kernel(
-											__global double * y,
-											__global double * alpha,
-											__local double * scratch,
-											__global double * sum,
+											__global FEATURE_TYPE * y,
+											__global FEATURE_TYPE * alpha,
+											__local FEATURE_TYPE * scratch,
+											__global FEATURE_TYPE * sum,
 											const int cols,
 											const int workGroupSize
 										 )
 {
 	// variables
 	int localIndex;
-	double localSum;
+	FEATURE_TYPE localSum;
 	
 	// function body
 	// initialization
@@ -1,17 +1,20 @@
+"#ifndef FEATURE_TYPE\n" \
 "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n" \
+"#define FEATURE_TYPE double\n" \
+"#endif\n" \
 "\n" \
 "__kernel void prediction_reduction_kernel(\n" \
-"											__global double * y,\n" \
-"											__global double * alpha,\n" \
-"											__local double * scratch,\n" \
-"											__global double * sum,\n" \
+"											__global FEATURE_TYPE * y,\n" \
+"											__global FEATURE_TYPE * alpha,\n" \
+"											__local FEATURE_TYPE * scratch,\n" \
+"											__global FEATURE_TYPE * sum,\n" \
 "											const int cols,\n" \
 "											const int workGroupSize\n" \
 "										 )\n" \
 "{\n" \
 "	// variables\n" \
 "	int localIndex;\n" \
-"	double localSum;\n" \
+"	FEATURE_TYPE localSum;\n" \
 "	\n" \
 "	// function body\n" \
 "	// initialization\n" \
@@ -1,16 +1,19 @@
+#ifndef FEATURE_TYPE
 #pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#define FEATURE_TYPE double
+#endif
 
 __kernel void reduction_kernel(
-								__global double * unreducedData,
+								__global FEATURE_TYPE * unreducedData,
 								const int cols,
-								__global double * reducedData
+								__global FEATURE_TYPE * reducedData
 							  )
 {
 
 	// variables
 	int globalIndex;
 	int offset;
-	double sum;
+	FEATURE_TYPE sum;
 
 	// function
 	// initialization
@@ -1,16 +1,19 @@
+"#ifndef FEATURE_TYPE\n" \
 "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n" \
+"#define FEATURE_TYPE double\n" \
+"#endif\n" \
 "\n" \
 "__kernel void reduction_kernel(\n" \
-"								__global double * unreducedData,\n" \
+"								__global FEATURE_TYPE * unreducedData,\n" \
 "								const int cols,\n" \
-"								__global double * reducedData\n" \
+"								__global FEATURE_TYPE * reducedData\n" \
 "							  )\n" \
 "{\n" \
 "\n" \
 "	// variables\n" \
 "	int globalIndex;\n" \
 "	int offset;\n" \
-"	double sum;\n" \
+"	FEATURE_TYPE sum;\n" \
 "\n" \
 "	// function\n" \
 "	// initialization\n" \
@@ -1,4 +1,7 @@
 #pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#ifndef FEATURE_TYPE
+#define FEATURE_TYPE double
+#endif
 
 __kernel void swap_objective_kernel(
 										__global double * objectiveFunction,
@@ -26,3 +29,24 @@ __kernel void swap_objective_kernel(
 	// clean up
 	return;
 }
+
+// the same swap for a cached Q column, which holds the feature type
+__kernel void swap_q_kernel(
+								__global FEATURE_TYPE * column,
+								const int i,
+								const int j
+							)
+{
+	// variables
+	FEATURE_TYPE tempI;
+	FEATURE_TYPE tempJ;
+	
+	// function
+	tempI = column[ i ];
+	tempJ = column[ j ];
+	column[ i ] = tempJ;
+	column[ j ] = tempI;
+	
+	// clean up
+	return;
+}
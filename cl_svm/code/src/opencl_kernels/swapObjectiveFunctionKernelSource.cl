@@ -1,4 +1,7 @@
 "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n" \
+"#ifndef FEATURE_TYPE\n" \
+"#define FEATURE_TYPE double\n" \
+"#endif\n" \
 "\n" \
 "__kernel void swap_objective_kernel(\n" \
 "										__global double * objectiveFunction,\n" \
@@ -26,4 +29,25 @@
 "	// clean up\n" \
 "	return;\n" \
 "}\n" \
+"\n" \
+"// the same swap for a cached Q column, which holds the feature type\n" \
+"__kernel void swap_q_kernel(\n" \
+"								__global FEATURE_TYPE * column,\n" \
+"								const int i,\n" \
+"								const int j\n" \
+"							)\n" \
+"{\n" \
+"	// variables\n" \
+"	FEATURE_TYPE tempI;\n" \
+"	FEATURE_TYPE tempJ;\n" \
+"	\n" \
+"	// function\n" \
+"	tempI = column[ i ];\n" \
+"	tempJ = column[ j ];\n" \
+"	column[ i ] = tempJ;\n" \
+"	column[ j ] = tempI;\n" \
+"	\n" \
+"	// clean up\n" \
+"	return;\n" \
+"}\n" \
 ""
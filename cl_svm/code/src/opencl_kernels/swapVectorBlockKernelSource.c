@@ -1,7 +1,10 @@
+#ifndef FEATURE_TYPE
 #pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#define FEATURE_TYPE double
+#endif
 
 __kernel void swap_vector_block_kernel(
-										__global double * A,
+										__global FEATURE_TYPE * A,
 										const int rows,
 										const int cols,
 										const int i,
@@ -24,8 +27,8 @@ __kernel void swap_vector_block_kernel(
 	}
 	// swap two elements
 	{
-		double element1;
-		double element2;
+		FEATURE_TYPE element1;
+		FEATURE_TYPE element2;
 		// if our column is in the matrix
 		if ( globalIndex < cols )
 		{
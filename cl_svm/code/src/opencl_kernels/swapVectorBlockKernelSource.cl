@@ -1,7 +1,10 @@
+"#ifndef FEATURE_TYPE\n" \
 "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n" \
+"#define FEATURE_TYPE double\n" \
+"#endif\n" \
 "\n" \
 "__kernel void swap_vector_block_kernel(\n" \
-"										__global double * A,\n" \
+"										__global FEATURE_TYPE * A,\n" \
 "										const int rows,\n" \
 "										const int cols,\n" \
 "										const int i,\n" \
@@ -24,8 +27,8 @@
 "	}\n" \
 "	// swap two elements\n" \
 "	{\n" \
-"		double element1;\n" \
-"		double element2;\n" \
+"		FEATURE_TYPE element1;\n" \
+"		FEATURE_TYPE element2;\n" \
 "		// if our column is in the matrix\n" \
 "		if ( globalIndex < cols )\n" \
 "		{\n" \
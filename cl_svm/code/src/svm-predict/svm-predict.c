@@ -103,7 +103,7 @@ void predict(FILE *input, FILE *output)
 				{
 					max_nr_attr *= 2;
 					//x = (struct svm_node *) realloc(x,max_nr_attr*sizeof(struct svm_node));
-					x.values = (double*) realloc(x.values,max_nr_attr*sizeof(double));
+					x.values = (svm_feature*) realloc(x.values,max_nr_attr*sizeof(svm_feature));
 				}
 
 				idx = strtok(NULL,":");
@@ -281,7 +281,7 @@ int main(int argc, char **argv)
 
 	#ifdef _DENSE_REP
 		x.dim = 0;
-		x.values = (double*) malloc( max_nr_attr*sizeof(double) );
+		x.values = (svm_feature*) malloc( max_nr_attr*sizeof(svm_feature) );
 	#else
 		x = (struct svm_node *) malloc(max_nr_attr*sizeof(struct svm_node));
 	#endif
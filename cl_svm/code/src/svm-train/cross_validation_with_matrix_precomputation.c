@@ -12,7 +12,7 @@ void setup_pkm(struct svm_problem *p_km)
 
 	for(i=0;i<prob.l;i++)
 	{
-		(p_km->x+i)->values = Malloc(double,prob.l+1);
+		(p_km->x+i)->values = Malloc(svm_feature,prob.l+1);
 		(p_km->x+i)->dim = prob.l+1;
 	}
 
@@ -37,6 +37,32 @@ void exit_with_help()
 	"-b probability_estimates : whether to train a SVC or SVR model for probability estimates, 0 or 1 (default 0)\n"
 	"-wi weight : set the parameter C of class i to weight*C, for C-SVC (default 1)\n"
 	"-v n: n-fold cross validation mode\n"
+	"-j threads : number of worker threads for kernel evaluation, 0 for one per core (default 0)\n"
+	"-f fast_transform : approximate exp/tanh in kernel rows to float accuracy, 0 or 1 (default 0)\n"
+	"-x contiguous : store a dense training set in one aligned feature matrix, 0 or 1 (default 1; sparse sets keep unpadded rows)\n"
+	"-a shared_cachesize : set memory in MB for kernel rows shared by the one-vs-one subproblems and CV folds (default 0, off)\n"
+	"-i prefetch : kernel columns to compute on a second thread ahead of the solver, 0-8 (default 0)\n"
+	"-z store_directory : keep computed kernel rows in a memory-mapped file in store_directory for later runs\n"
+	"-k gpu_cachesize : set the memory of each OpenCL buffer cache in MB (default 0, a sixth of device memory)\n"
+	"-u hugepages : back the kernel cache with huge pages when the system allows, 0 or 1 (default 0)\n"
+	"-y precision : kernel cache column storage (default 0)\n"
+	"	0 -- 32-bit float\n"
+	"	1 -- 16-bit half float, RBF and sigmoid only (32-bit for other kernels)\n"
+	"	2 -- 16-bit bfloat16\n"
+	"-N numa : NUMA placement of the kernel cache and feature matrix, no-op on one node (default 0)\n"
+	"	0 -- off (first touch)\n"
+	"	1 -- interleave pages over the nodes\n"
+	"	2 -- partition feature rows over the nodes of the worker threads, interleave the cache\n"
+	"-M solver_mode : where the solver keeps the gradient (default 0)\n"
+	"	0 -- host only, no OpenCL unless the kernel type needs it\n"
+	"	1 -- OpenCL device only, working set selection runs there too\n"
+	"-Q working_set_size : variables the solver optimizes together, 2 for plain SMO, up to 64 (default 2)\n"
+	"-V check : debugging, keep the gradient on both sides and compare them after every update, 0 or 1 (default 0)\n"
+	"-o metrics_file : write training metrics (cache, solver and OpenCL counters) to metrics_file as JSON\n"
+	"-l landmarks : train on a Nystrom approximation of the kernel with this many landmarks, 0 for the exact kernel (default 0)\n"
+	"-L sampling : Nystrom landmark selection (default 0)\n"
+	"	0 -- random, with a fixed seed\n"
+	"	1 -- k-means in input space, snapped to the nearest training points\n"
 	"-q : quiet mode (no outputs)\n"
 	);
 	exit(1);
@@ -56,6 +82,9 @@ struct svm_parameter param;		// set by parse_command_line
 struct svm_problem prob;		// set by read_problem
 struct svm_model *model;
 struct svm_node *x_space;
+svm_feature *x_matrix;	// backs prob.x[i].values when contiguous_storage is set
+int contiguous_storage;
+const char *metrics_file_name;	// NULL unless -o is given
 int cross_validation;
 int nr_fold;
 
@@ -65,6 +94,18 @@ static int max_line_len;
 #include "kernel_matrix_calculation.c"
 #include "cross_validation_with_matrix_precomputation.c"
 
+// last feature index of the current line plus one, 0 when it has none
+static int row_width(void)
+{
+	char *endptr;
+	char *p = strrchr(line, ':');
+	if(p == NULL)
+		return 0;
+	while(*p != ' ' && *p != '\t' && p > line)
+		p--;
+	return p > line ? (int) strtol(p,&endptr,10) + 1 : 0;
+}
+
 static char* readline(FILE *input)
 {
 	int len;
@@ -99,6 +140,7 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
+	svm_reset_metrics();
 	if(cross_validation)
 	{
 		do_cross_validation_with_KM_precalculated(  );
@@ -121,6 +163,11 @@ int main(int argc, char **argv)
 		// debugging
 		fprintf( stdout, "Freed and destroyed model\n" );
 	}
+	if(metrics_file_name && svm_save_metrics(metrics_file_name))
+	{
+		fprintf(stderr, "can't save metrics to file %s\n", metrics_file_name);
+		exit(1);
+	}
 	svm_destroy_param(&param);
 	
 	// debugging
@@ -132,9 +179,14 @@ int main(int argc, char **argv)
 	fprintf( stdout, "Freed prob.y\n" );
 	
 #ifdef _DENSE_REP
-	for (i = 0; i < prob.l; ++i)
+	if(x_matrix)
+		svm_free_feature_matrix(x_matrix);
+	else
 	{
-		free((prob.x+i)->values);
+		for (i = 0; i < prob.l; ++i)
+		{
+			free((prob.x+i)->values);
+		}
 	}
 #else
 	free(x_space);
@@ -205,10 +257,13 @@ void parse_command_line(int argc, char **argv, char *input_file_name, char *mode
 	param.p = 0.1;
 	param.shrinking = 1;
 	param.probability = 0;
+	param.nystrom_landmarks = 0;
 	param.nr_weight = 0;
 	param.weight_label = NULL;
 	param.weight = NULL;
 	cross_validation = 0;
+	contiguous_storage = 1;
+	metrics_file_name = NULL;
 
 	// parse options
 	for(i=1;i<argc;i++)
@@ -267,6 +322,54 @@ void parse_command_line(int argc, char **argv, char *input_file_name, char *mode
 					exit_with_help();
 				}
 				break;
+			case 'j':
+				svm_set_num_threads(atoi(argv[i]),0);
+				break;
+			case 'f':
+				svm_set_transform_mode(atoi(argv[i]) ? TRANSFORM_FAST : TRANSFORM_EXACT);
+				break;
+			case 'x':
+				contiguous_storage = atoi(argv[i]);
+				break;
+			case 'o':
+				metrics_file_name = argv[i];
+				break;
+			case 'a':
+				svm_set_shared_cache_size(atof(argv[i]));
+				break;
+			case 'i':
+				svm_set_prefetch(atoi(argv[i]));
+				break;
+			case 'z':
+				svm_set_kernel_store(argv[i]);
+				break;
+			case 'k':
+				svm_set_gpu_cache_size(atof(argv[i]));
+				break;
+			case 'u':
+				svm_set_cache_huge_pages(atoi(argv[i]));
+				break;
+			case 'y':
+				svm_set_cache_precision(atoi(argv[i]));
+				break;
+			case 'N':
+				svm_set_numa_policy(atoi(argv[i]));
+				break;
+			case 'M':
+				svm_set_solver_mode(atoi(argv[i]));
+				break;
+			case 'V':
+				svm_set_check_gradient(atoi(argv[i]));
+				break;
+			case 'Q':
+				svm_set_working_set_size(atoi(argv[i]));
+				break;
+			case 'l':
+				param.nystrom_landmarks = atoi(argv[i]);
+				break;
+			case 'L':
+				svm_set_nystrom_sampling(atoi(argv[i]));
+				break;
 			case 'w':
 				++param.nr_weight;
 				param.weight_label = (int *)realloc(param.weight_label,sizeof(int)*param.nr_weight);
@@ -309,6 +412,8 @@ void read_problem(const char *filename)
 	int elements, max_index, inst_max_index, i, j;
 #ifdef _DENSE_REP
 	double value;
+	long int features;
+	int sparse;
 #endif
 	FILE *fp = fopen(filename,"r");
 	char *endptr;
@@ -327,6 +432,7 @@ void read_problem(const char *filename)
 	line = Malloc(char,max_line_len);
 #ifdef _DENSE_REP
 	max_index = 1;
+	features = 0;
 	while(readline(fp) != NULL)
 	{
 		char *p;		
@@ -340,6 +446,8 @@ void read_problem(const char *filename)
 		}
 		if(max_index > elements)
 			elements = max_index;
+		for(p=line;(p = strchr(p,':')) != NULL;p++)
+			++features;
 		++prob.l;
 	}
 
@@ -348,14 +456,37 @@ void read_problem(const char *filename)
 	prob.y = Malloc(double,prob.l);
 	prob.x = Malloc(struct svm_node,prob.l);
 
+	// one row-major matrix, every row padded with zeros to the full width;
+	// sparse sets keep each row at its own width instead, the kernel works
+	// from CSR rows for them anyway
+	x_matrix = NULL;
+	sparse = (double)features <= SVM_SPARSE_DENSITY*prob.l*elements;
+	if(contiguous_storage && !sparse)
+	{
+		x_matrix = svm_alloc_feature_matrix(prob.l,elements);
+		if(x_matrix == NULL)
+		{
+			fprintf(stderr,"can't allocate feature matrix of %d x %d\n",prob.l,elements);
+			exit(1);
+		}
+	}
+
 	for(i=0;i<prob.l;i++)
 	{
 		int *d; 
-		(prob.x+i)->values = Malloc(double,elements);
+		readline(fp);
+		if(x_matrix)
+			(prob.x+i)->values = x_matrix + (size_t)i*elements;
+		else if(sparse)
+		{
+			int width = row_width();
+			(prob.x+i)->values = Malloc(svm_feature,width > 0 ? width : 1);
+		}
+		else
+			(prob.x+i)->values = Malloc(svm_feature,elements);
 		(prob.x+i)->dim = 0;
 
 		inst_max_index = -1; // strtol gives 0 if wrong format, and precomputed kernel has <index> start from 0
-		readline(fp);
 		
 		label = strtok(line," \t");
 		prob.y[i] = strtod(label,&endptr);
@@ -402,6 +533,13 @@ void read_problem(const char *filename)
 				(prob.x+i)->values[(*d)++] = 0.0;
 			(prob.x+i)->values[(*d)++] = value;
 		}	
+
+		if(x_matrix)
+		{
+			d = &((prob.x+i)->dim);
+			while (*d < elements)
+				(prob.x+i)->values[(*d)++] = 0.0;
+		}
 	}
 	max_index = elements-1;
 
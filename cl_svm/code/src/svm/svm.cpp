@@ -8,14 +8,27 @@
 #include <stdarg.h>
 #include <limits.h>
 #include <locale.h>
+#include <stdint.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 // OpenCL stuff
 #include <CL/cl.h>
 #include "clAmdBlas.h"
 #include "gpu_cache.hpp"
 #include "profiling.h"
+#include "simd_kernels.hpp"
 
 #include <Windows.h>
+#include <malloc.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#endif
 
 #include "svm.h"
 int libsvm_version = LIBSVM_VERSION;
@@ -48,6 +61,291 @@ static inline double powi(double base, int times)
 #define TAU 1e-12
 #define Malloc(type,n) (type *)malloc((n)*sizeof(type))
 
+//
+// Worker pool for kernel evaluation (OpenMP when available)
+//
+// nr_threads <= 0 means one worker per core; loops shorter than
+// parallel_threshold stay on the calling thread
+//
+static int nr_threads = 0;
+static int parallel_threshold = 1024;
+#define ROW_CHUNK 256
+
+// accuracy of the exp/tanh row transforms, see svm_set_transform_mode
+static int transform_mode = TRANSFORM_EXACT;
+
+// columns the solver computes ahead of the next working set, see svm_set_prefetch
+#define PREFETCH_MAX 8
+static int prefetch_depth = 0;
+
+// where the solver keeps G and whether the other side mirrors it for
+// verification, see svm_set_solver_mode and svm_set_check_gradient
+static int solver_mode = SOLVER_CPU;
+static int check_gradient = 0;
+
+// variables per working set of the solver, 2 for plain SMO, see
+// svm_set_working_set_size
+#define WORKING_SET_MAX 64
+static int working_set_size = 2;
+
+// how build_nystrom picks its landmarks, see svm_set_nystrom_sampling
+#define NYSTROM_KMEANS_ITERATIONS 5
+#define NYSTROM_SEED 0x9e3779b97f4a7c15ULL
+static int nystrom_sampling = NYSTROM_RANDOM;
+
+// training counters, see svm_get_metrics. Each Solver, Kernel and Cache
+// counts into a svm_metrics of its own and merges it here once, when it is
+// done, so concurrent svm_train calls only meet at the lock
+static svm_metrics metrics;
+
+static void merge_metrics(const svm_metrics &run)
+{
+#pragma omp critical(svm_metrics)
+	{
+		metrics.cache_hits += run.cache_hits;
+		metrics.cache_misses += run.cache_misses;
+		metrics.cache_evictions += run.cache_evictions;
+		metrics.cache_bytes = max(metrics.cache_bytes, run.cache_bytes);
+		metrics.gpu_cache_hits += run.gpu_cache_hits;
+		metrics.gpu_cache_misses += run.gpu_cache_misses;
+		metrics.gpu_cache_invalidations += run.gpu_cache_invalidations;
+		metrics.transfer_bytes += run.transfer_bytes;
+		metrics.pool_hits += run.pool_hits;
+		metrics.pool_misses += run.pool_misses;
+		metrics.pool_bytes = max(metrics.pool_bytes, run.pool_bytes);
+		metrics.wss_count += run.wss_count;
+		metrics.iterations += run.iterations;
+		metrics.column_fill_time += run.column_fill_time;
+		metrics.wss_time += run.wss_time;
+	}
+}
+
+// device copies of the features, kernel sums and Q columns follow the feature
+// type (the programs build with the matching FEATURE_TYPE); the objective
+// function and the working set reductions over it stay double in every build
+typedef svm_feature cl_real;
+
+// scalar kernel arguments are copied at set time, so a narrowed temporary is enough
+static inline cl_int set_real_arg(cl_kernel kernel, cl_uint index, double value)
+{
+	cl_real real = (cl_real)value;
+	return clSetKernelArg(kernel, index, sizeof(cl_real), &real);
+}
+
+static inline int worker_count()
+{
+#ifdef _OPENMP
+	return nr_threads > 0 ? nr_threads : omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+//
+// NUMA placement, see svm_set_numa_policy
+//
+// Pages go to the node of the thread that first writes them, so placement is
+// a pass that touches each page from the right worker before the real data
+// arrives. For the pass, worker t of T is pinned to node t*nodes/T, the node
+// the static schedule of the row loops gives its ROW_CHUNK blocks to; every
+// worker gets its own affinity back afterwards, so keeping the workers on
+// those nodes later is left to OMP_PLACES/OMP_PROC_BIND. The kernel cache is
+// interleaved under either policy, as swaps move its entries between rows.
+// With one node, or without OpenMP, all of this is a no-op.
+//
+#define NUMA_PAGE 4096
+
+static int numa_policy = NUMA_OFF;
+static int numa_nodes = 0;	// 0 until detected
+
+struct numa_affinity
+{
+	bool saved;
+#ifdef _WIN32
+	GROUP_AFFINITY mask;
+#elif defined(CPU_SET)
+	cpu_set_t mask;
+#endif
+};
+
+static int numa_node_count()
+{
+	if(numa_nodes == 0)
+	{
+#ifdef _WIN32
+		ULONG highest;
+		numa_nodes = GetNumaHighestNodeNumber(&highest) ? (int)highest+1 : 1;
+#else
+		char path[64];
+		numa_nodes = 0;
+		do
+			sprintf(path, "/sys/devices/system/node/node%d", numa_nodes);
+		while(access(path, F_OK) == 0 && ++numa_nodes < 1024);
+		numa_nodes = max(numa_nodes, 1);
+#endif
+	}
+	return numa_nodes;
+}
+
+// pins the calling thread to node; when previous is not NULL it receives the
+// affinity the thread had, for numa_restore_thread
+static void numa_bind_thread(int node, numa_affinity *previous)
+{
+	if(previous)
+		previous->saved = false;
+#ifdef _WIN32
+	GROUP_AFFINITY affinity;
+	if(GetNumaNodeProcessorMaskEx((USHORT)node, &affinity) &&
+	   SetThreadGroupAffinity(GetCurrentThread(), &affinity, previous ? &previous->mask : NULL) && previous)
+		previous->saved = true;
+#elif defined(CPU_SET)
+	char path[64], list[4096];
+	sprintf(path, "/sys/devices/system/node/node%d/cpulist", node);
+	FILE *fp = fopen(path, "r");
+	if(fp == NULL)
+		return;
+	if(fgets(list, sizeof(list), fp) != NULL)
+	{
+		// "0-7,16-23"
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for(char *p = list; *p && *p != '\n';)
+		{
+			int first = (int)strtol(p, &p, 10), last = first;
+			if(*p == '-')
+				last = (int)strtol(p+1, &p, 10);
+			for(int cpu=first;cpu<=last && cpu<CPU_SETSIZE;cpu++)
+				CPU_SET(cpu, &set);
+			if(*p == ',')
+				p++;
+			else
+				break;
+		}
+		if(previous)
+			previous->saved = sched_getaffinity(0, sizeof(previous->mask), &previous->mask) == 0;
+		sched_setaffinity(0, sizeof(set), &set);
+	}
+	fclose(fp);
+#endif
+}
+
+static void numa_restore_thread(const numa_affinity &previous)
+{
+	if(!previous.saved)
+		return;
+#ifdef _WIN32
+	SetThreadGroupAffinity(GetCurrentThread(), &previous.mask, NULL);
+#elif defined(CPU_SET)
+	sched_setaffinity(0, sizeof(previous.mask), &previous.mask);
+#endif
+}
+
+// place copies blocks of rows rows each, stride bytes apart, where a row
+// takes row_bytes: round robin over the workers' pages with NUMA_INTERLEAVE,
+// in ROW_CHUNK blocks following the row loops with NUMA_PARTITION
+static void numa_place(void *memory, int policy, int copies, size_t stride, int rows, size_t row_bytes)
+{
+#ifdef _OPENMP
+	if(memory == NULL || policy == NUMA_OFF || numa_node_count() <= 1)
+		return;
+	char *base = (char *)memory;
+	long pages = (long)(((size_t)copies*stride+NUMA_PAGE-1)/NUMA_PAGE);
+	int chunks = (rows+ROW_CHUNK-1)/ROW_CHUNK;
+#pragma omp parallel num_threads(worker_count())
+	{
+		numa_affinity previous;
+		int t = omp_get_thread_num();
+		numa_bind_thread(t*numa_nodes/omp_get_num_threads(), &previous);
+		if(policy == NUMA_INTERLEAVE)
+		{
+#pragma omp for schedule(static,1)
+			for(long p=0;p<pages;p++)
+				base[(size_t)p*NUMA_PAGE] = 0;
+		}
+		else
+		{
+#pragma omp for schedule(static)
+			for(int c=0;c<chunks;c++)
+				for(int k=0;k<copies;k++)
+				{
+					char *first = base+k*stride+(size_t)c*ROW_CHUNK*row_bytes;
+					char *last = base+k*stride+(size_t)min(rows,(c+1)*ROW_CHUNK)*row_bytes;
+					// the page holding first may belong to the previous block
+					for(char *page = first+(NUMA_PAGE-(size_t)first%NUMA_PAGE)%NUMA_PAGE; page < last; page += NUMA_PAGE)
+						*page = 0;
+				}
+		}
+		numa_restore_thread(previous);
+	}
+#endif
+}
+
+//
+// Kernel row transforms instantiated per kernel type, and per degree for the
+// usual low-degree polynomials, so the inner loops carry no branches and
+// powi unrolls; DEGREE 0 takes the degree at run time.
+// norm_i/norm_j are the squared norms used by RBF and ignored otherwise.
+//
+typedef void (*row_transform_function)(double *v, int n, double gamma, double coef0, int degree,
+				       double norm_i, const double *norm_j);
+
+template<int DEGREE> static inline void powi_row(double *v, int n, int)
+{
+	// same multiplication order as powi, so results are bit-identical
+	for(int j=0;j<n;j++)
+	{
+		double x = v[j], x2 = x*x;
+		v[j] = DEGREE == 2 ? x2 : DEGREE == 3 ? x*x2 : x2*x2;
+	}
+}
+template<> inline void powi_row<0>(double *v, int n, int degree)
+{
+	simd_powi_row(v, n, degree);
+}
+
+template<int KERNEL, int DEGREE>
+static void row_transform(double *v, int n, double gamma, double coef0, int degree,
+			  double norm_i, const double *norm_j)
+{
+	int j;
+	if(KERNEL == POLY || KERNEL == SIGMOID)
+		for(j=0;j<n;j++)
+			v[j] = gamma*v[j]+coef0;
+	if(KERNEL == POLY)
+		powi_row<DEGREE>(v, n, degree);
+	else if(KERNEL == RBF)
+	{
+		for(j=0;j<n;j++)
+			v[j] = -gamma*(norm_i+norm_j[j]-2*v[j]);
+		simd_exp_row(v, n, transform_mode == TRANSFORM_FAST);
+	}
+	else if(KERNEL == SIGMOID)
+		simd_tanh_row(v, n, transform_mode == TRANSFORM_FAST);
+}
+
+// row kernel type (LINEAR, POLY, RBF, SIGMOID) to instantiation, for prediction rows;
+// training rows go through Kernel::select_row_engine
+static row_transform_function select_row_transform(int kernel_type, int degree)
+{
+	switch(kernel_type)
+	{
+		case POLY:
+			switch(degree)
+			{
+				case 2: return &row_transform<POLY,2>;
+				case 3: return &row_transform<POLY,3>;
+				case 4: return &row_transform<POLY,4>;
+				default: return &row_transform<POLY,0>;
+			}
+		case RBF:
+			return &row_transform<RBF,0>;
+		case SIGMOID:
+			return &row_transform<SIGMOID,0>;
+		default:
+			return &row_transform<LINEAR,0>;
+	}
+}
+
 static void print_string_stdout(const char *s)
 {
 	fputs(s,stdout);
@@ -74,46 +372,150 @@ static void info(const char *fmt,...) {}
 // l is the number of total data items
 // size is the cache size limit in bytes
 //
+// Columns live in fixed slots of l Qfloats carved out of one arena of at most
+// size bytes, allocated up front; eviction hands the LRU column's slot to the
+// new one, so training never goes back to the system allocator.
+//
+#define CACHE_HUGE_PAGE (2*1024*1024)
+
+static int cache_huge_pages = 0;
+static int cache_precision = CACHE_FLOAT32;	// see svm_set_cache_precision
+
+// fp16 tops out at 65504, so it only holds kernels bounded by 1; the others
+// keep 32 bit columns
+static int cache_precision_for(int kernel_type)
+{
+	if(cache_precision == CACHE_FP16 && kernel_type != RBF && kernel_type != SIGMOID)
+		return CACHE_FLOAT32;
+	return cache_precision;
+}
+
+// arena backing, with huge pages when svm_set_cache_huge_pages asked for them
+static void *cache_arena_alloc(size_t bytes)
+{
+#ifdef _WIN32
+	void *arena = NULL;
+	SIZE_T page = GetLargePageMinimum();
+	if(cache_huge_pages && page > 0)	// needs SeLockMemoryPrivilege
+		arena = VirtualAlloc(NULL, (bytes+page-1)/page*page, MEM_RESERVE|MEM_COMMIT|MEM_LARGE_PAGES, PAGE_READWRITE);
+	if(arena == NULL)
+		arena = VirtualAlloc(NULL, bytes, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+	return arena;
+#else
+	void *arena;
+	if(posix_memalign(&arena, cache_huge_pages ? CACHE_HUGE_PAGE : SVM_MATRIX_ALIGNMENT, bytes) != 0)
+		return NULL;
+#ifdef MADV_HUGEPAGE
+	if(cache_huge_pages)
+		madvise(arena, bytes, MADV_HUGEPAGE);
+#endif
+	return arena;
+#endif
+}
+
+static void cache_arena_free(void *arena)
+{
+#ifdef _WIN32
+	if(arena) VirtualFree(arena, 0, MEM_RELEASE);
+#else
+	free(arena);
+#endif
+}
+
 class Cache
 {
 public:
-	Cache(int l,long int size);
+	Cache(int l,long int size,int precision);
 	~Cache();
 
 	// request data [0,len)
 	// return some position p where [p,len) need to be filled
 	// (p >= len if nothing needs to be filled)
-	int get_data(const int index, Qfloat **data, int len);
+	// data is the column itself while it is 32 bit; otherwise it is a decoded
+	// copy, valid for the next get_data call too (prefetch calls have a copy
+	// of their own). Either way the filled part must be handed back through
+	// put_data
+	int get_data(const int index, Qfloat **data, int len, bool prefetch = false);
+	void put_data(const int index, const Qfloat *data, int start, int len);
+	// stores a column computed outside get_data if its slot is still there,
+	// without counting a hit or a miss
+	void put_column(const int index, const Qfloat *column, int len);
+	// whether prefetching depth columns cannot evict the two most recent ones
+	bool can_prefetch() const { return nr_slot >= prefetch_depth+2; }
 	void swap_index(int i, int j);	
 private:
 	int l;
-	long int size;
+	int precision;		// CACHE_FLOAT32, CACHE_FP16 or CACHE_BF16
+	size_t element;		// bytes per cached entry
+	size_t bitmap;		// offset of the bitmap of filled entries in a slot
+	size_t stride;		// bytes per slot: l entries, then the bitmap
+	bool overflowed;	// whether a 16 bit entry has already overflowed
+	svm_metrics counters;	// cache_* counts, merged when the cache goes
 	struct head_t
 	{
 		head_t *prev, *next;	// a circular list
-		Qfloat *data;
-		int len;		// data[0,len) is cached in this entry
+		void *data;		// slot, NULL when nothing is cached
+		int stamp;		// swaps of the log already applied to the slot
 	};
 
+	// columns are kept in position order. swap_index only swaps the two
+	// heads and logs the pair; a column replays the swaps logged since its
+	// stamp when it is next accessed, so a swap costs O(1) and a column
+	// O(swaps it missed)
 	head_t *head;
 	head_t lru_head;
+	char *arena;
+	void **free_slot;	// stack of unused slots
+	int nr_slot, nr_free;
+	int *swap_log;		// pairs of swapped positions
+	int nr_swap, max_swap;
+	Qfloat *stage[3];	// decoded columns, the last for prefetch
+	int next_stage;
 	void lru_delete(head_t *h);
 	void lru_insert(head_t *h);
+	void replay(head_t *h);
+	unsigned int *filled(void *slot) const { return (unsigned int *)((char *)slot+bitmap); }
 };
 
-Cache::Cache(int l_,long int size_):l(l_),size(size_)
+Cache::Cache(int l_,long int size_,int precision_):l(l_),precision(precision_)
 {
+	overflowed = false;
+	memset(&counters, 0, sizeof(counters));
+	element = precision == CACHE_FLOAT32 ? sizeof(Qfloat) : sizeof(unsigned short);
+	bitmap = (element*l+7)/8*8;
+	stride = bitmap + ((l+63)/64)*8;
 	head = (head_t *)calloc(l,sizeof(head_t));	// initialized to 0
-	size /= sizeof(Qfloat);
-	size -= l * sizeof(head_t) / sizeof(Qfloat);
-	size = max(size, 2 * (long int) l);	// cache must be large enough for two columns
+	long int size = size_;
+	size -= l * (sizeof(head_t) + 2 * sizeof(int) + 3 * sizeof(Qfloat));
+	nr_slot = (int)max(size / (long int)(stride + sizeof(void *)), 2L);	// cache must be large enough for two columns
+	nr_slot = max(min(nr_slot, l), 2);
+	arena = (char *)cache_arena_alloc(stride*nr_slot);
+	if(arena == NULL)
+	{
+		fprintf(stderr,"can't allocate %d kernel cache columns\n",nr_slot);
+		exit(1);
+	}
+	numa_place(arena, numa_policy == NUMA_OFF ? NUMA_OFF : NUMA_INTERLEAVE, nr_slot, stride, l, element);
+	free_slot = Malloc(void *,nr_slot);
+	for(nr_free=0;nr_free<nr_slot;nr_free++)
+		free_slot[nr_free] = arena+stride*(nr_slot-1-nr_free);
+	max_swap = l;
+	swap_log = Malloc(int,2*max_swap);
+	nr_swap = 0;
+	for(int k=0;k<3;k++)
+		stage[k] = Malloc(Qfloat,l);
+	next_stage = 0;
 	lru_head.next = lru_head.prev = &lru_head;
 }
 
 Cache::~Cache()
 {
-	for(head_t *h = lru_head.next; h != &lru_head; h=h->next)
-		free(h->data);
+	merge_metrics(counters);
+	cache_arena_free(arena);
+	free(free_slot);
+	free(swap_log);
+	for(int k=0;k<3;k++)
+		free(stage[k]);
 	free(head);
 }
 
@@ -133,69 +535,409 @@ void Cache::lru_insert(head_t *h)
 	h->next->prev = h;
 }
 
-int Cache::get_data(const int index, Qfloat **data, int len)
+void Cache::replay(head_t *h)
 {
-	head_t *h = &head[index];
-	if(h->len) lru_delete(h);
-	int more = len - h->len;
+	unsigned int *bits = filled(h->data);
+	for(int k=h->stamp;k<nr_swap;k++)
+	{
+		int i = swap_log[2*k], j = swap_log[2*k+1];
+		if(precision == CACHE_FLOAT32)
+			swap(((Qfloat *)h->data)[i],((Qfloat *)h->data)[j]);
+		else
+			swap(((unsigned short *)h->data)[i],((unsigned short *)h->data)[j]);
+		unsigned int bi = bits[i>>5]>>(i&31) & 1, bj = bits[j>>5]>>(j&31) & 1;
+		if(bi != bj)
+		{
+			bits[i>>5] ^= 1u<<(i&31);
+			bits[j>>5] ^= 1u<<(j&31);
+		}
+	}
+	h->stamp = nr_swap;
+}
 
-	if(more > 0)
+int Cache::get_data(const int index, Qfloat **data, int len, bool prefetch)
+{
+	head_t *h = &head[index];
+	if(h->data)
+	{
+		lru_delete(h);
+		replay(h);
+	}
+	else
 	{
-		// free old space
-		while(size < more)
+		if(nr_free == 0)
 		{
 			head_t *old = lru_head.next;
 			lru_delete(old);
-			free(old->data);
-			size += old->len;
+			free_slot[nr_free++] = old->data;
 			old->data = 0;
-			old->len = 0;
+			++counters.cache_evictions;
 		}
+		h->data = free_slot[--nr_free];
+		h->stamp = nr_swap;
+		memset(filled(h->data), 0, sizeof(unsigned int)*((l+31)/32));
+		counters.cache_bytes = max(counters.cache_bytes, (unsigned long long)stride*(nr_slot-nr_free));
+	}
+	lru_insert(h);
 
-		// allocate new space
-		h->data = (Qfloat *)realloc(h->data,sizeof(Qfloat)*len);
-		size -= more;
-		swap(h->len,len);
+	const unsigned int *bits = filled(h->data);
+	int start = 0;
+	while(start < len && bits[start>>5] == ~0u)
+		start = (start|31)+1;
+	while(start < len && (bits[start>>5]>>(start&31) & 1))
+		++start;
+	start = min(start,len);
+	if(precision == CACHE_FLOAT32)
+		*data = (Qfloat *)h->data;
+	else
+	{
+		Qfloat *copy = prefetch ? stage[2] : stage[next_stage ^= 1];
+		simd_half_decode(precision == CACHE_BF16 ? SIMD_HALF_BF16 : SIMD_HALF_FP16,
+				 (const unsigned short *)h->data, copy, start);
+		*data = copy;
 	}
+	if(start < len)
+		++counters.cache_misses;
+	else
+		++counters.cache_hits;
+	return start;
+}
 
-	lru_insert(h);
-	*data = h->data;
-	return len;
+void Cache::put_data(const int index, const Qfloat *data, int start, int len)
+{
+	if(start >= len)
+		return;
+	void *slot = head[index].data;
+	unsigned int *bits = filled(slot);
+	// 32 bit columns were filled in place
+	if(precision != CACHE_FLOAT32)
+	{
+		unsigned short *encoded = (unsigned short *)slot;
+		simd_half_encode(precision == CACHE_BF16 ? SIMD_HALF_BF16 : SIMD_HALF_FP16,
+				 data+start, encoded+start, len-start);
+		if(!overflowed)
+		{
+			unsigned short inf = precision == CACHE_BF16 ? 0x7f80 : 0x7c00;
+			for(int k=start;k<len;k++)
+				if((encoded[k] & 0x7fff) == inf && fabs(data[k]) <= FLT_MAX)
+				{
+					fprintf(stderr,"warning: kernel value %g overflows the 16 bit cache, use 32 bit columns\n",(double)data[k]);
+					overflowed = true;
+					break;
+				}
+		}
+	}
+	for(int k=start;k<len;k++)
+		bits[k>>5] |= 1u<<(k&31);
+}
+
+void Cache::put_column(const int index, const Qfloat *column, int len)
+{
+	head_t *h = &head[index];
+	if(h->data == NULL)
+		return;
+	replay(h);
+	if(precision == CACHE_FLOAT32)
+		memcpy(h->data, column, sizeof(Qfloat)*len);
+	put_data(index, column, 0, len);
 }
 
 void Cache::swap_index(int i, int j)
 {
 	if(i==j) return;
 
-	if(head[i].len) lru_delete(&head[i]);
-	if(head[j].len) lru_delete(&head[j]);
-	// switch actual vectors
+	if(head[i].data) lru_delete(&head[i]);
+	if(head[j].data) lru_delete(&head[j]);
 	swap(head[i].data,head[j].data);
-	swap(head[i].len,head[j].len);
-	if(head[i].len) lru_insert(&head[i]);
-	if(head[j].len) lru_insert(&head[j]);
+	swap(head[i].stamp,head[j].stamp);
+	if(head[i].data) lru_insert(&head[i]);
+	if(head[j].data) lru_insert(&head[j]);
 
-	if(i>j) swap(i,j);
-	for(head_t *h = lru_head.next; h!=&lru_head; h=h->next)
+	if(nr_swap == max_swap)
 	{
-		if(h->len > i)
+		// a full log is applied to every cached column and started over
+		for(head_t *h = lru_head.next; h != &lru_head; h = h->next)
 		{
-			if(h->len > j)
-			{
-				// swap elements in other vectors to compensate
-				swap(h->data[i],h->data[j]);
-			}
-			else
-			{
-				// give up
-				lru_delete(h);
-				free(h->data);
-				size += h->len;
-				h->data = 0;
-				h->len = 0;
-			}
+			replay(h);
+			h->stamp = 0;
 		}
+		nr_swap = 0;
+	}
+	swap_log[2*nr_swap] = i;
+	swap_log[2*nr_swap+1] = j;
+	++nr_swap;
+}
+
+//
+// Kernel rows shared by all Q matrices of one training run
+//
+// The one-vs-one subproblems of svm_train and the folds of
+// svm_cross_validation all take their vectors from the problem the outermost
+// call was given. Rows of K over that whole problem are kept here, keyed by
+// instance id, and each Kernel gathers its own columns through instance_id.
+// A vector is recognised by its feature pointer, which the subproblems copy.
+// The outermost call owns the rows and hands them down to every Kernel, so
+// concurrent training runs each have their own.
+//
+static double shared_cache_size = 0;	// MB, 0 disables the shared cache
+static char *kernel_store_dir = NULL;	// see svm_set_kernel_store
+
+struct shared_rows;
+
+#ifdef _DENSE_REP
+struct shared_key
+{
+	uintptr_t values;
+	int id;
+};
+
+//
+// On-disk kernel row store
+//
+// svm-kernel-<hash>.bin in kernel_store_dir holds the rows of K for one
+// problem and kernel (the hash covers both, and the transform mode the rows
+// were computed with): a header, one ready byte per row, then l rows of l
+// Qfloats. The file is mapped shared, so later runs and concurrent processes
+// read the rows that are ready; a row is written before its ready byte is
+// set, and read only after it is seen set.
+//
+#define KERNEL_STORE_MAGIC "SVMKROW"
+#define KERNEL_STORE_VERSION 2
+#define KERNEL_STORE_ALIGNMENT 64
+
+struct kernel_store_header
+{
+	char magic[8];
+	unsigned long long hash;
+	int l;
+	int version;
+	int transform;
+};
+
+// orders the row and its ready byte; both sides need one
+static inline void kernel_store_barrier()
+{
+#ifdef _WIN32
+	MemoryBarrier();
+#else
+	__sync_synchronize();
+#endif
+}
+
+struct kernel_store
+{
+	void *base;
+	size_t bytes;
+	volatile char *ready;
+	Qfloat *rows;
+#ifdef _WIN32
+	HANDLE file, mapping;
+#else
+	int file;
+#endif
+};
+
+// FNV-1a over the problem and the kernel parameters
+static unsigned long long kernel_store_hash(const svm_problem *prob, const svm_parameter *param)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	int kernel[4] = { param->kernel_type, param->degree, transform_mode, KERNEL_STORE_VERSION };
+	double scale[2] = { param->gamma, param->coef0 };
+	const unsigned char *p;
+	size_t k;
+#define HASH_BYTES(data, size) for(p=(const unsigned char *)(data),k=0;k<(size_t)(size);k++) hash = (hash^p[k])*1099511628211ULL
+	HASH_BYTES(&prob->l, sizeof(int));
+	HASH_BYTES(kernel, sizeof(kernel));
+	HASH_BYTES(scale, sizeof(scale));
+	for(int i=0;i<prob->l;i++)
+	{
+		HASH_BYTES(&prob->x[i].dim, sizeof(int));
+		HASH_BYTES(prob->x[i].values, sizeof(svm_feature)*prob->x[i].dim);
+	}
+#undef HASH_BYTES
+	return hash;
+}
+
+static kernel_store *kernel_store_open(const char *dir, unsigned long long hash, int l)
+{
+	char path[1024];
+	size_t header = (sizeof(kernel_store_header)+l+KERNEL_STORE_ALIGNMENT-1)/KERNEL_STORE_ALIGNMENT*KERNEL_STORE_ALIGNMENT;
+	size_t bytes = header+sizeof(Qfloat)*(size_t)l*l;
+	kernel_store *store = Malloc(kernel_store,1);
+	store->bytes = bytes;
+	sprintf(path, "%.900s/svm-kernel-%016llx.bin", dir, hash);
+#ifdef _WIN32
+	store->file = CreateFileA(path, GENERIC_READ|GENERIC_WRITE, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL,
+				  OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	store->mapping = NULL;
+	store->base = NULL;
+	if(store->file != INVALID_HANDLE_VALUE)
+	{
+		// a mapping larger than the file extends it with zeros
+		store->mapping = CreateFileMappingA(store->file, NULL, PAGE_READWRITE,
+						    (DWORD)((unsigned long long)bytes >> 32), (DWORD)(bytes & 0xffffffff), NULL);
+		if(store->mapping)
+			store->base = MapViewOfFile(store->mapping, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+	}
+	if(store->base == NULL)
+	{
+		if(store->mapping) CloseHandle(store->mapping);
+		if(store->file != INVALID_HANDLE_VALUE) CloseHandle(store->file);
+		fprintf(stderr,"can't map kernel store %s\n",path);
+		free(store);
+		return NULL;
+	}
+#else
+	struct stat st;
+	store->base = MAP_FAILED;
+	store->file = open(path, O_RDWR|O_CREAT, 0644);
+	if(store->file >= 0 && fstat(store->file, &st) == 0 &&
+	   ((size_t)st.st_size >= bytes || ftruncate(store->file, bytes) == 0))
+		store->base = mmap(NULL, bytes, PROT_READ|PROT_WRITE, MAP_SHARED, store->file, 0);
+	if(store->base == MAP_FAILED)
+	{
+		if(store->file >= 0) close(store->file);
+		fprintf(stderr,"can't map kernel store %s\n",path);
+		free(store);
+		return NULL;
+	}
+#endif
+	kernel_store_header *h = (kernel_store_header *)store->base;
+	static const char blank[8] = { 0 };
+	// a new file is all zeros; anything else keeps the header it has
+	if(memcmp(h->magic, blank, 8) == 0)
+	{
+		h->hash = hash;
+		h->l = l;
+		h->version = KERNEL_STORE_VERSION;
+		h->transform = transform_mode;
+		memcpy(h->magic, KERNEL_STORE_MAGIC, 8);
+	}
+	store->ready = (volatile char *)store->base+sizeof(kernel_store_header);
+	store->rows = (Qfloat *)((char *)store->base+header);
+	if(memcmp(h->magic, KERNEL_STORE_MAGIC, 8) != 0 || h->version != KERNEL_STORE_VERSION)
+	{
+		fprintf(stderr,"kernel store %s has another format, not using it\n",path);
+		store->ready = NULL;
+	}
+	else if(h->transform != transform_mode)
+	{
+		fprintf(stderr,"kernel store %s was computed with another transform mode, not using it\n",path);
+		store->ready = NULL;
+	}
+	else if(h->hash != hash || h->l != l)
+	{
+		fprintf(stderr,"kernel store %s belongs to another problem, not using it\n",path);
+		store->ready = NULL;
 	}
+	else
+		info("kernel store %s\n",path);
+	return store;
+}
+
+static void kernel_store_close(kernel_store *store)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(store->base);
+	CloseHandle(store->mapping);
+	CloseHandle(store->file);
+#else
+	munmap(store->base, store->bytes);
+	close(store->file);
+#endif
+	free(store);
+}
+
+struct shared_rows
+{
+	const svm_node *x;	// the outermost problem
+	int l;
+	svm_parameter param;
+	double *norm;		// squared norms for RBF, NULL otherwise
+	double *row;		// scratch row of length l
+	shared_key *key;	// sorted by values
+	Cache *cache;
+	kernel_store *store;	// NULL without a kernel store
+};
+
+static int compare_shared_key(const void *a, const void *b)
+{
+	uintptr_t va = ((const shared_key *)a)->values, vb = ((const shared_key *)b)->values;
+	return va < vb ? -1 : va > vb ? 1 : 0;
+}
+
+static int shared_instance_id(const shared_rows *shared, const svm_feature *values)
+{
+	int low = 0, high = shared->l-1;
+	while(low <= high)
+	{
+		int mid = (low+high)/2;
+		if(shared->key[mid].values < (uintptr_t)values)
+			low = mid+1;
+		else if(shared->key[mid].values > (uintptr_t)values)
+			high = mid-1;
+		else
+			return shared->key[mid].id;
+	}
+	return -1;
+}
+#endif
+
+// the rows of an outermost svm_train or svm_cross_validation call, NULL when
+// sharing is off or the kernel has no row engine
+static shared_rows *shared_rows_create(const svm_problem *prob, const svm_parameter *param)
+{
+	if(shared_cache_size <= 0 && kernel_store_dir == NULL)
+		return NULL;
+#ifdef _DENSE_REP
+	int kernel_type = param->kernel_type;
+	if(param->nystrom_landmarks > 0 ||
+	   (kernel_type != LINEAR && kernel_type != POLY && kernel_type != RBF && kernel_type != SIGMOID))
+		return NULL;
+	int l = prob->l;
+	shared_rows *shared = Malloc(shared_rows,1);
+	shared->x = prob->x;
+	shared->l = l;
+	shared->param = *param;
+	shared->norm = NULL;
+	if(kernel_type == RBF)
+	{
+		shared->norm = Malloc(double,l);
+		for(int i=0;i<l;i++)
+			shared->norm[i] = simd_squared_norm(prob->x[i].values, prob->x[i].dim);
+	}
+	shared->row = Malloc(double,l);
+	shared->key = Malloc(shared_key,l);
+	for(int i=0;i<l;i++)
+	{
+		shared->key[i].values = (uintptr_t)prob->x[i].values;
+		shared->key[i].id = i;
+	}
+	qsort(shared->key, l, sizeof(shared_key), compare_shared_key);
+	// without a size of its own the cache just stages rows from the store
+	shared->cache = new Cache(l,(long int)(max(shared_cache_size,0.0)*(1<<20)),cache_precision_for(kernel_type));
+	shared->store = NULL;
+	if(kernel_store_dir)
+		shared->store = kernel_store_open(kernel_store_dir, kernel_store_hash(prob,param), l);
+	return shared;
+#else
+	return NULL;
+#endif
+}
+
+static void shared_rows_destroy(shared_rows *shared)
+{
+#ifdef _DENSE_REP
+	if(shared == NULL)
+		return;
+	delete shared->cache;
+	if(shared->store)
+		kernel_store_close(shared->store);
+	free(shared->norm);
+	free(shared->row);
+	free(shared->key);
+	free(shared);
+#endif
 }
 
 //
@@ -210,9 +952,23 @@ public:
 	virtual Qfloat *get_Q(int column, int len) const = 0;
 	virtual double *get_QD() const = 0;
 	virtual void swap_index(int i, int j) const = 0;
+	// compute column i into the cache without returning it; called from a
+	// second thread while the solver only reads the last two columns
+	virtual void prefetch_Q(int, int) const {}
+	// column B[t] of Q over [0,len) into columns[t] for t < n; the default
+	// fetches them one at a time
+	virtual void get_Q_block(const int *B, int n, int len, Qfloat **columns) const
+	{
+		for(int t=0;t<n;t++)
+			memcpy(columns[t], get_Q(B[t],len), sizeof(Qfloat)*len);
+	}
 	virtual ~QMatrix() {}
 	#ifdef CL_SVM
 
+		// whether the functions below have a device to run on and a
+		// gradient layout they understand
+		virtual bool device_gradient() const = 0;
+
 		// OpenCL related function
 		virtual int update_objective_function( int activeSize, double deltaAlphaI, double deltaAlphaJ, int i, int j ) = 0;
 
@@ -266,6 +1022,75 @@ class Kernel: public QMatrix {
 
 //#define	GPU_CACHE_SIZE	10
 
+	// this run's share of the training counters, merged when the Kernel goes
+	mutable svm_metrics counters;
+
+	// host <-> device copies, counted into counters.transfer_bytes
+	cl_int metered_write_buffer(cl_command_queue queue, cl_mem buffer, cl_bool blocking, size_t offset, size_t size,
+				    const void *ptr, cl_uint nr_events, const cl_event *events, cl_event *event) const
+	{
+		counters.transfer_bytes += size;
+		return clEnqueueWriteBuffer(queue, buffer, blocking, offset, size, ptr, nr_events, events, event);
+	}
+
+	cl_int metered_read_buffer(cl_command_queue queue, cl_mem buffer, cl_bool blocking, size_t offset, size_t size,
+				   void *ptr, cl_uint nr_events, const cl_event *events, cl_event *event) const
+	{
+		counters.transfer_bytes += size;
+		return clEnqueueReadBuffer(queue, buffer, blocking, offset, size, ptr, nr_events, events, event);
+	}
+
+	// host doubles <-> device reals, offset and count in elements; float builds
+	// convert through a staging copy, which makes the transfer blocking
+	cl_int write_reals(cl_command_queue queue, cl_mem buffer, cl_bool blocking, size_t offset, size_t count,
+			   const double *src, cl_uint nr_events, const cl_event *events, cl_event *event) const
+	{
+#ifdef SVM_FLOAT_FEATURES
+		cl_real *stage = Malloc(cl_real,count);
+		for(size_t k=0;k<count;k++)
+			stage[k] = (cl_real)src[k];
+		cl_int status = metered_write_buffer(queue, buffer, CL_TRUE, offset*sizeof(cl_real), count*sizeof(cl_real),
+						     stage, nr_events, events, event);
+		free(stage);
+		return status;
+#else
+		return metered_write_buffer(queue, buffer, blocking, offset*sizeof(cl_real), count*sizeof(cl_real),
+					    src, nr_events, events, event);
+#endif
+	}
+
+	cl_int read_reals(cl_command_queue queue, cl_mem buffer, cl_bool blocking, size_t offset, size_t count,
+			  double *dst, cl_uint nr_events, const cl_event *events, cl_event *event) const
+	{
+#ifdef SVM_FLOAT_FEATURES
+		cl_real *stage = Malloc(cl_real,count);
+		cl_int status = metered_read_buffer(queue, buffer, CL_TRUE, offset*sizeof(cl_real), count*sizeof(cl_real),
+						    stage, nr_events, events, event);
+		for(size_t k=0;k<count;k++)
+			dst[k] = stage[k];
+		free(stage);
+		return status;
+#else
+		return metered_read_buffer(queue, buffer, blocking, offset*sizeof(cl_real), count*sizeof(cl_real),
+					   dst, nr_events, events, event);
+#endif
+	}
+
+	// the same for the double objective function buffers
+	cl_int write_doubles(cl_command_queue queue, cl_mem buffer, cl_bool blocking, size_t offset, size_t count,
+			     const double *src, cl_uint nr_events, const cl_event *events, cl_event *event) const
+	{
+		return metered_write_buffer(queue, buffer, blocking, offset*sizeof(double), count*sizeof(double),
+					    src, nr_events, events, event);
+	}
+
+	cl_int read_doubles(cl_command_queue queue, cl_mem buffer, cl_bool blocking, size_t offset, size_t count,
+			    double *dst, cl_uint nr_events, const cl_event *events, cl_event *event) const
+	{
+		return metered_read_buffer(queue, buffer, blocking, offset*sizeof(double), count*sizeof(double),
+					   dst, nr_events, events, event);
+	}
+
 public:
 
 	// variables
@@ -274,13 +1099,19 @@ public:
 	
 	// methods
 
+	// shared, when not NULL, holds the rows of the outermost problem
 #ifdef _DENSE_REP
-	Kernel(int l, svm_node * x, const svm_parameter& param);
+	Kernel(int l, svm_node * x, const svm_parameter& param, shared_rows *shared = NULL);
 #else
-	Kernel(int l, svm_node * const * x, const svm_parameter& param);
+	Kernel(int l, svm_node * const * x, const svm_parameter& param, shared_rows *shared = NULL);
 #endif
 	virtual ~Kernel();
 
+	// turns decision function coefficients over the l rows of x into
+	// coefficients over the Nystrom landmarks, see build_nystrom; no-op for
+	// the exact kernel
+	void nystrom_expansion(int l, double *coef) const;
+
 	#ifdef CL_SVM
 		double wide_k_function( const svm_node * x, const svm_node * y,
 										const svm_parameter & param, double * svmCoefficients );
@@ -288,6 +1119,11 @@ public:
 	
 	static double k_function(const svm_node *x, const svm_node *y,
 				 const svm_parameter& param);
+#ifdef _DENSE_REP
+	static void k_function_row(const svm_node *x, const svm_node *sv, const double *sv_norm,
+				 int l, const svm_parameter& param, double *out);
+	static void dot_rows(const svm_node &xi, const svm_node *rows, int count, double *out);
+#endif
 	virtual Qfloat *get_Q(int column, int len) const = 0;
 	virtual double *get_QD() const = 0;
 	virtual void swap_index(int i, int j) const	// no so const...
@@ -300,10 +1136,13 @@ public:
 	
 		// TODO: Introduce GPU swap
 		//gpuCache.InvalidateCache();
-		((GPUCache)gpuCache).SwapIndices( i, j );
-		copy->swap_vector_block_indices( i, j );
-		//((GPUCache)gpuQCache).InvalidateCache();
-		((GPUCache)cpuQCache).InvalidateCache();
+		if ( device )
+		{
+			((GPUCache*)&gpuCache)->SwapIndices( i, j );
+			copy->swap_vector_block_indices( i, j );
+			//((GPUCache*)&gpuQCache)->InvalidateCache();
+			((GPUCache*)&cpuQCache)->InvalidateCache();
+		}
 		//gpuQCache.SwapIndices( i, j );
 		//startTimer();
 		/*if ( 0 != swap_q_indices( i, j ) )
@@ -317,6 +1156,9 @@ public:
 		
 		swap(x[i],x[j]);
 		if(x_square) swap(x_square[i],x_square[j]);
+		if(sparse_x) swap(sparse_x[i],sparse_x[j]);
+		if(nystrom_row) swap(nystrom_row[i],nystrom_row[j]);
+		if(instance_id) swap(instance_id[i],instance_id[j]);
 	}
 	
 	#ifdef CL_SVM
@@ -338,6 +1180,11 @@ public:
 	LONGLONG kernelEnqueuingTime;// = 0;
 	LONGLONG argSettingTime;// = 0;
 	
+		bool device_gradient() const
+		{
+			return device;
+		}
+	
 		// OpenCL related function
 		int update_objective_function( int activeSize, double deltaAlphaI, double deltaAlphaJ, int i, int j )
 		{
@@ -433,8 +1280,7 @@ update_objective_function_memory_retry_label:
 				if ( 0 != cpuQCache.CheckCache( i, &q_i ) )
 				{
 					qVector1 = get_Q( i, activeSize );
-					q_i = clCreateBuffer( kernelCpuContext, CL_MEM_READ_ONLY, sizeof(float) * numberOfVectors,//sizeof(float) * activeSize,
-										  NULL, &errorCodeInt );
+					q_i = devicePool.Acquire( kernelCpuContext, sizeof(float) * numberOfVectors, &errorCodeInt );
 					if ( CL_SUCCESS != errorCodeInt )
 					{
 						fprintf( stderr, "ERROR CREATING BUFFER FOR QI IN OBJECTIVE FUNCTION UPDATE\n" );
@@ -467,6 +1313,7 @@ update_objective_function_memory_retry_label:
 								retried = 1;
 								cpuQCache.InvalidateCache();
 								gpuCache.InvalidateCache();
+								devicePool.Trim();
 								goto update_objective_function_memory_retry_label;
 								break;
 							default:
@@ -475,7 +1322,7 @@ update_objective_function_memory_retry_label:
 						};
 						return -1;
 					}
-					errorCode = clEnqueueWriteBuffer( kernelCpuCommandQueue, q_i, CL_FALSE, 0, 
+					errorCode = metered_write_buffer( kernelCpuCommandQueue, q_i, CL_FALSE, 0, 
 														sizeof(float) * activeSize, qVector1, 0, NULL, NULL );
 					if ( CL_SUCCESS != errorCode )
 					{
@@ -492,8 +1339,7 @@ update_objective_function_memory_retry_label:
 				if ( 0 != cpuQCache.CheckCache( j, &q_j ) )
 				{
 					qVector2 = get_Q( j, activeSize );
-					q_j = clCreateBuffer( kernelCpuContext, CL_MEM_READ_ONLY, sizeof(float) * numberOfVectors,//sizeof(float) * activeSize,
-										  NULL, &errorCodeInt );
+					q_j = devicePool.Acquire( kernelCpuContext, sizeof(float) * numberOfVectors, &errorCodeInt );
 					if ( CL_SUCCESS != errorCodeInt )
 					{
 						fprintf( stderr, "ERROR CREATING BUFFER FOR QJ IN OBJECTIVE FUNCTION UDPATE\n" );
@@ -526,6 +1372,7 @@ update_objective_function_memory_retry_label:
 								fprintf( stderr, "CLEARING MEMORY, THEN TRYING AGAIN\n" );
 								cpuQCache.InvalidateCache();
 								gpuCache.InvalidateCache();
+								devicePool.Trim();
 								goto update_objective_function_memory_retry_label;
 								break;
 							default:
@@ -536,7 +1383,7 @@ update_objective_function_memory_retry_label:
 					}
 					// write to them
 					
-					errorCode = clEnqueueWriteBuffer( kernelCpuCommandQueue, q_j, CL_FALSE, 0, 
+					errorCode = metered_write_buffer( kernelCpuCommandQueue, q_j, CL_FALSE, 0, 
 														sizeof(float) * activeSize/*sizeof(float) * activeSize*/, qVector2, 0, NULL, NULL );
 					if ( CL_SUCCESS != errorCode )
 					{
@@ -679,6 +1526,7 @@ update_objective_function_memory_retry_label:
 						retried = 1;
 						cpuQCache.InvalidateCache();
 						gpuCache.InvalidateCache();
+						devicePool.Trim();
 						goto update_objective_function_memory_retry_label;
 						break;
 					case CL_INVALID_EVENT_WAIT_LIST:
@@ -727,7 +1575,7 @@ update_objective_function_memory_retry_label:
 			{
 				int remainder = activeSize % IDEAL_WORK_GROUP_SIZE;
 				//g = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE, sizeof(double) * (activeSize + IDEAL_WORK_GROUP_SIZE - remainder), NULL, &errorCode );
-				g = clCreateBuffer( kernelCpuContext, CL_MEM_READ_WRITE, sizeof(double) * (activeSize + IDEAL_WORK_GROUP_SIZE - remainder), NULL, &errorCode );
+				g = devicePool.Acquire( kernelCpuContext, sizeof(double) * (activeSize + IDEAL_WORK_GROUP_SIZE - remainder), &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error
@@ -739,8 +1587,8 @@ update_objective_function_memory_retry_label:
 			{
 				// may not have to be a blocking call
 				// TODO: Make sure this desynchronization doesn't mess us up later on
-				//errorCode = clEnqueueWriteBuffer( kernelCommandQueue, g, CL_FALSE, 0, sizeof(double) * activeSize, initialValue, 0, NULL, NULL );
-				errorCode = clEnqueueWriteBuffer( kernelCpuCommandQueue, g, CL_FALSE, 0, sizeof(double) * activeSize, initialValue, 0, NULL, NULL );
+				//errorCode = metered_write_buffer( kernelCommandQueue, g, CL_FALSE, 0, sizeof(double) * activeSize, initialValue, 0, NULL, NULL );
+				errorCode = write_doubles( kernelCpuCommandQueue, g, CL_FALSE, 0, activeSize, initialValue, 0, NULL, NULL );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error
@@ -855,8 +1703,8 @@ update_objective_function_memory_retry_label:
 			}
 			// read objective function off of GPU
 			{
-				//errorCode = clEnqueueReadBuffer( kernelCommandQueue, g, CL_TRUE, 0, sizeof(double) * activeSize, gpuData, 0, NULL, NULL );
-				errorCode = clEnqueueReadBuffer( kernelCpuCommandQueue, g, CL_TRUE, 0, sizeof(double) * activeSize, gpuData, 0, NULL, NULL );
+				//errorCode = metered_read_buffer( kernelCommandQueue, g, CL_TRUE, 0, sizeof(double) * activeSize, gpuData, 0, NULL, NULL );
+				errorCode = read_doubles( kernelCpuCommandQueue, g, CL_TRUE, 0, activeSize, gpuData, 0, NULL, NULL );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error
@@ -908,7 +1756,7 @@ update_objective_function_memory_retry_label:
 			}
 			// set up input data structures
 			{
-				gBarGpu = clCreateBuffer( kernelContext, CL_MEM_READ_ONLY, sizeof(double) * (highJ - lowJ), NULL, &errorCode );
+				gBarGpu = devicePool.Acquire( kernelContext, sizeof(double) * (highJ - lowJ), &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error in earnest
@@ -925,7 +1773,7 @@ update_objective_function_memory_retry_label:
 			}
 			// write p to g's space
 			{
-				errorCode = clEnqueueWriteBuffer( kernelCommandQueue, g, CL_TRUE, sizeof(double) * lowJ, sizeof(double) * (highJ - lowJ), p, 0, NULL, NULL );
+				errorCode = write_doubles( kernelCommandQueue, g, CL_TRUE, lowJ, (highJ - lowJ), p, 0, NULL, NULL );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error in earnest
@@ -935,7 +1783,7 @@ update_objective_function_memory_retry_label:
 			}
 			// write gBar to gBar's space
 			{
-				errorCode = clEnqueueWriteBuffer( kernelCommandQueue, gBarGpu, CL_TRUE, 0, sizeof(double) * (highJ - lowJ), G_bar, 0, NULL, NULL );
+				errorCode = write_doubles( kernelCommandQueue, gBarGpu, CL_TRUE, 0, (highJ - lowJ), G_bar, 0, NULL, NULL );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error in earnest
@@ -957,7 +1805,7 @@ update_objective_function_memory_retry_label:
 			
 			// clean up
 			{
-				clReleaseMemObject( gBarGpu );
+				devicePool.Release( gBarGpu );
 			}
 			return 0;
 		}
@@ -986,8 +1834,8 @@ update_objective_function_memory_retry_label:
 			}
 			// write to it
 			{
-				//errorCode = clEnqueueWriteBuffer( kernelCommandQueue, g, CL_TRUE, sizeof(double) * lowJ, sizeof(double) * (highJ - lowJ), values, 0, NULL, NULL );
-				errorCode = clEnqueueWriteBuffer( kernelCpuCommandQueue, g, CL_TRUE, sizeof(double) * lowJ, sizeof(double) * (highJ - lowJ), values, 0, NULL, NULL );
+				//errorCode = metered_write_buffer( kernelCommandQueue, g, CL_TRUE, sizeof(double) * lowJ, sizeof(double) * (highJ - lowJ), values, 0, NULL, NULL );
+				errorCode = write_doubles( kernelCpuCommandQueue, g, CL_TRUE, lowJ, (highJ - lowJ), values, 0, NULL, NULL );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error
@@ -1024,8 +1872,8 @@ update_objective_function_memory_retry_label:
 			}
 			// read it into the pointer provided
 			{
-				//errorCode = clEnqueueReadBuffer( kernelCommandQueue, g, CL_TRUE, sizeof(double) * lowJ, sizeof(double) * (highJ - lowJ), values, 0, NULL, NULL );
-				errorCode = clEnqueueReadBuffer( kernelCpuCommandQueue, g, CL_TRUE, sizeof(double) * lowJ, sizeof(double) * (highJ - lowJ), values, 0, NULL, NULL );
+				//errorCode = metered_read_buffer( kernelCommandQueue, g, CL_TRUE, sizeof(double) * lowJ, sizeof(double) * (highJ - lowJ), values, 0, NULL, NULL );
+				errorCode = read_doubles( kernelCpuCommandQueue, g, CL_TRUE, lowJ, (highJ - lowJ), values, 0, NULL, NULL );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error
@@ -1081,14 +1929,14 @@ update_objective_function_memory_retry_label:
 				// TODO: Allocate this once
 				//if ( -1 == gpuCache.GetYSpace( &yGpu ) )
 				{
-					yGpu = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE, sizeof(schar) * globalWorkSize[0], NULL, &errorCode );
+					yGpu = devicePool.Acquire( kernelContext, sizeof(schar) * globalWorkSize[0], &errorCode );
 					if ( CL_SUCCESS != errorCode )
 					{
 						// TODO: Deal with this
 						fprintf( stderr, "ERROR CREATING SPACE FOR Y DATA\n" );
 						return -1;
 					}
-					errorCode = clEnqueueWriteBuffer( kernelCommandQueue, yGpu, CL_FALSE, 0, sizeof(schar) * activeSize, y, 0, NULL, NULL );
+					errorCode = metered_write_buffer( kernelCommandQueue, yGpu, CL_FALSE, 0, sizeof(schar) * activeSize, y, 0, NULL, NULL );
 					if ( CL_SUCCESS != errorCode )
 					{
 						// TODO: Deal with this error
@@ -1098,7 +1946,7 @@ update_objective_function_memory_retry_label:
 					//gpuCache.SaveYSpace( yGpu );
 				}
 				// create alpha status buffer
-				alphaStatusGpu = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE, sizeof(char) * globalWorkSize[0], NULL, &errorCode );
+				alphaStatusGpu = devicePool.Acquire( kernelContext, sizeof(char) * globalWorkSize[0], &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this
@@ -1109,14 +1957,14 @@ update_objective_function_memory_retry_label:
 			// create output buffers for kernel
 			{
 				// two buffers, one for indices, one for values
-				valueBuffer = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE, sizeof(double) * numberOfWorkGroups, NULL, &errorCode );
+				valueBuffer = devicePool.Acquire( kernelContext, sizeof(double) * numberOfWorkGroups, &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this
 					fprintf( stderr, "ERROR CREATING SPACE FOR VALUE BUFFER\n" );
 					return -1;
 				}
-				indexBuffer = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE, sizeof(int) * numberOfWorkGroups, NULL, &errorCode );
+				indexBuffer = devicePool.Acquire( kernelContext, sizeof(int) * numberOfWorkGroups, &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this
@@ -1126,7 +1974,7 @@ update_objective_function_memory_retry_label:
 			}
 			// write y and alpha status vectors
 			{
-				errorCode = clEnqueueWriteBuffer( kernelCommandQueue, alphaStatusGpu, CL_FALSE, 0, sizeof(char) * activeSize, alphaStatus, 0, NULL, NULL );
+				errorCode = metered_write_buffer( kernelCommandQueue, alphaStatusGpu, CL_FALSE, 0, sizeof(char) * activeSize, alphaStatus, 0, NULL, NULL );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error
@@ -1241,7 +2089,7 @@ update_objective_function_memory_retry_label:
 					return -1;
 				}
 				// read them
-				errorCode = clEnqueueReadBuffer( kernelCommandQueue, valueBuffer, CL_FALSE, 0, sizeof(double) * numberOfWorkGroups, cpuValues, 0, NULL, NULL );
+				errorCode = read_doubles( kernelCommandQueue, valueBuffer, CL_FALSE, 0, numberOfWorkGroups, cpuValues, 0, NULL, NULL );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error
@@ -1275,7 +2123,7 @@ update_objective_function_memory_retry_label:
 					};
 					return -1;
 				}
-				errorCode = clEnqueueReadBuffer( kernelCommandQueue, indexBuffer, CL_FALSE, 0, sizeof(int) * numberOfWorkGroups, cpuIndices, 0, NULL, NULL );
+				errorCode = metered_read_buffer( kernelCommandQueue, indexBuffer, CL_FALSE, 0, sizeof(int) * numberOfWorkGroups, cpuIndices, 0, NULL, NULL );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error
@@ -1332,10 +2180,10 @@ update_objective_function_memory_retry_label:
 			
 			// clean up
 			{
-				clReleaseMemObject( yGpu );
-				clReleaseMemObject( alphaStatusGpu );
-				clReleaseMemObject( valueBuffer );
-				clReleaseMemObject( indexBuffer );
+				devicePool.Release( yGpu );
+				devicePool.Release( alphaStatusGpu );
+				devicePool.Release( valueBuffer );
+				devicePool.Release( indexBuffer );
 				free( cpuValues );
 				free( cpuIndices );
 			}
@@ -1404,7 +2252,7 @@ update_objective_function_memory_retry_label:
 				numberOfWorkGroups = globalWorkSize[0] / IDEAL_WORK_GROUP_SIZE;
 				// create y buffer
 				// TODO: Allocate this once
-				yGpu = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE, sizeof(schar) * globalWorkSize[0], NULL, &errorCode );
+				yGpu = devicePool.Acquire( kernelContext, sizeof(schar) * globalWorkSize[0], &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this
@@ -1412,7 +2260,7 @@ update_objective_function_memory_retry_label:
 					return -1;
 				}
 				// create alpha status buffer
-				alphaStatusGpu = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE, sizeof(char) * globalWorkSize[0], NULL, &errorCode );
+				alphaStatusGpu = devicePool.Acquire( kernelContext, sizeof(char) * globalWorkSize[0], &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this
@@ -1420,7 +2268,7 @@ update_objective_function_memory_retry_label:
 					return -1;
 				}
 				// create QD buffer
-				qdGpu = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE, sizeof(double) * globalWorkSize[0], NULL, &errorCode );
+				qdGpu = devicePool.Acquire( kernelContext, sizeof(double) * globalWorkSize[0], &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal witht his error
@@ -1430,21 +2278,21 @@ update_objective_function_memory_retry_label:
 			}
 			// write out values for y, alpha status and QD
 			{
-				errorCode = clEnqueueWriteBuffer( kernelCommandQueue, yGpu, CL_FALSE, 0, sizeof(schar) * activeSize, y, 0, NULL, NULL );
+				errorCode = metered_write_buffer( kernelCommandQueue, yGpu, CL_FALSE, 0, sizeof(schar) * activeSize, y, 0, NULL, NULL );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error
 					fprintf( stderr, "ERROR WRITING Y TO GPU WHILE SELECTING J\n" );
 					return -1;
 				}
-				errorCode = clEnqueueWriteBuffer( kernelCommandQueue, alphaStatusGpu, CL_FALSE, 0, sizeof(char) * activeSize, alphaStatus, 0, NULL, NULL );
+				errorCode = metered_write_buffer( kernelCommandQueue, alphaStatusGpu, CL_FALSE, 0, sizeof(char) * activeSize, alphaStatus, 0, NULL, NULL );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error
 					fprintf( stderr, "ERROR WRITING ALPHA STATUS TO GPU WHILE SELECTING J\n" );
 					return -1;
 				}
-				errorCode = clEnqueueWriteBuffer( kernelCommandQueue, qdGpu, CL_FALSE, 0, sizeof(double) * activeSize, QD, 0, NULL, NULL );
+				errorCode = write_doubles( kernelCommandQueue, qdGpu, CL_FALSE, 0, activeSize, QD, 0, NULL, NULL );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error
@@ -1465,21 +2313,21 @@ update_objective_function_memory_retry_label:
 			// create index and value buffers (for output)
 			{
 				// two buffers, one for indices, one for values
-				valueBuffer = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE, sizeof(double) * numberOfWorkGroups, NULL, &errorCode );
+				valueBuffer = devicePool.Acquire( kernelContext, sizeof(double) * numberOfWorkGroups, &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this
 					fprintf( stderr, "ERROR CREATING SPACE FOR VALUE BUFFER WHILE SELECTING J\n" );
 					return -1;
 				}
-				indexBuffer = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE, sizeof(int) * numberOfWorkGroups, NULL, &errorCode );
+				indexBuffer = devicePool.Acquire( kernelContext, sizeof(int) * numberOfWorkGroups, &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this
 					fprintf( stderr, "ERROR CREATING SPACE FOR INDEX BUFFER WHILE SELECTING J\n" );
 					return -1;
 				}
-				gMaxGpu = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE, sizeof(double) * numberOfWorkGroups, NULL, &errorCode );
+				gMaxGpu = devicePool.Acquire( kernelContext, sizeof(double) * numberOfWorkGroups, &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this
@@ -1607,7 +2455,7 @@ update_objective_function_memory_retry_label:
 					return -1;
 				}
 				// read them
-				errorCode = clEnqueueReadBuffer( kernelCommandQueue, valueBuffer, CL_FALSE, 0, sizeof(double) * numberOfWorkGroups, cpuValues, 0, NULL, NULL );
+				errorCode = read_doubles( kernelCommandQueue, valueBuffer, CL_FALSE, 0, numberOfWorkGroups, cpuValues, 0, NULL, NULL );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error
@@ -1641,7 +2489,7 @@ update_objective_function_memory_retry_label:
 					};
 					return -1;
 				}
-				errorCode = clEnqueueReadBuffer( kernelCommandQueue, indexBuffer, CL_FALSE, 0, sizeof(int) * numberOfWorkGroups, cpuIndices, 0, NULL, NULL );
+				errorCode = metered_read_buffer( kernelCommandQueue, indexBuffer, CL_FALSE, 0, sizeof(int) * numberOfWorkGroups, cpuIndices, 0, NULL, NULL );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error
@@ -1675,7 +2523,7 @@ update_objective_function_memory_retry_label:
 					};
 					return -1;
 				}
-				errorCode = clEnqueueReadBuffer( kernelCommandQueue, gMaxGpu, CL_FALSE, 0, sizeof(double) * numberOfWorkGroups, gmax2Candidates, 0, NULL, NULL );
+				errorCode = read_doubles( kernelCommandQueue, gMaxGpu, CL_FALSE, 0, numberOfWorkGroups, gmax2Candidates, 0, NULL, NULL );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error
@@ -1740,10 +2588,11 @@ update_objective_function_memory_retry_label:
 				out_j = minIndex;
 				out_gMax2 = maxGValue;
 			}
-			// get G[i] and G[j]
+			// get G[i] and G[j]; no j means the caller stops as optimal
 			{
-				errorCode = clEnqueueReadBuffer( kernelCommandQueue, g, CL_FALSE, sizeof(double) * selectedI, sizeof(double), &(outG[selectedI]), 0, NULL, NULL );
-				errorCode |= clEnqueueReadBuffer( kernelCommandQueue, g, CL_FALSE, sizeof(double) * out_j, sizeof(double), &(outG[out_j]), 0, NULL, NULL );
+				errorCode = read_doubles( kernelCommandQueue, g, CL_FALSE, selectedI, 1, &(outG[selectedI]), 0, NULL, NULL );
+				if ( out_j >= 0 )
+					errorCode |= read_doubles( kernelCommandQueue, g, CL_FALSE, out_j, 1, &(outG[out_j]), 0, NULL, NULL );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error
@@ -1755,10 +2604,12 @@ update_objective_function_memory_retry_label:
 			
 			// clean up
 			{
-				clReleaseMemObject( qdGpu );
-				clReleaseMemObject( yGpu );
-				clReleaseMemObject( alphaStatusGpu );
-				clReleaseMemObject( gMaxGpu );
+				devicePool.Release( qdGpu );
+				devicePool.Release( yGpu );
+				devicePool.Release( alphaStatusGpu );
+				devicePool.Release( gMaxGpu );
+				devicePool.Release( valueBuffer );
+				devicePool.Release( indexBuffer );
 				free( cpuValues );
 				free( cpuIndices );
 				free( gmax2Candidates );
@@ -1810,9 +2661,9 @@ update_objective_function_memory_retry_label:
 						qRetrievingTime += calculateTime();
 						// set up call to swap kernel
 						startTimer();
-						errorCode = clSetKernelArg( swapObjectiveFunctionKernel, 0, sizeof(cl_mem), &q_i );
-						errorCode |= clSetKernelArg( swapObjectiveFunctionKernel, 1, sizeof(int), &i );
-						errorCode |= clSetKernelArg( swapObjectiveFunctionKernel, 2, sizeof(int), &j );
+						errorCode = clSetKernelArg( swapQKernel, 0, sizeof(cl_mem), &q_i );
+						errorCode |= clSetKernelArg( swapQKernel, 1, sizeof(int), &i );
+						errorCode |= clSetKernelArg( swapQKernel, 2, sizeof(int), &j );
 						stopTimer();
 						argSettingTime += calculateTime();
 						if ( CL_SUCCESS != errorCode )
@@ -1823,7 +2674,7 @@ update_objective_function_memory_retry_label:
 						}
 						// call swap kernel
 						startTimer();
-						errorCode = clEnqueueNDRangeKernel( kernelCommandQueue, swapObjectiveFunctionKernel, 1, NULL,
+						errorCode = clEnqueueNDRangeKernel( kernelCommandQueue, swapQKernel, 1, NULL,
 															&one, &one, 0, NULL, NULL );
 						stopTimer();
 						kernelEnqueuingTime += calculateTime();
@@ -1858,13 +2709,13 @@ update_objective_function_memory_retry_label:
 						qRetrievingTime += calculateTime();
 						startTimer();
 						qValues[ qIndex ] = q_i;
-						errorCode = clEnqueueReadBuffer( kernelCommandQueue, q_i, CL_FALSE, sizeof(double) * i, sizeof(double), &(copiedValues[ 2 * qIndex ]), 0, NULL, NULL );
+						errorCode = read_reals( kernelCommandQueue, q_i, CL_FALSE, i, 1, &(copiedValues[ 2 * qIndex ]), 0, NULL, NULL );
 						if ( CL_SUCCESS != errorCode )
 						{
 							fprintf( stderr, "ERROR READING I VALUES WHILE Q SWAPPING\n" );
 							return -1;
 						}
-						errorCode = clEnqueueReadBuffer( kernelCommandQueue, q_i, CL_FALSE, sizeof(double) * j, sizeof(double), &(copiedValues[ 2 * qIndex + 1 ]), 0, NULL, NULL );
+						errorCode = read_reals( kernelCommandQueue, q_i, CL_FALSE, j, 1, &(copiedValues[ 2 * qIndex + 1 ]), 0, NULL, NULL );
 						if ( CL_SUCCESS != errorCode )
 						{
 							fprintf( stderr, "ERROR READING J VALUES WHILE Q SWAPPING\n" );
@@ -1887,13 +2738,13 @@ update_objective_function_memory_retry_label:
 				for ( k = 0; k < qIndex; k++ )
 				{
 					startTimer();
-					errorCode = clEnqueueWriteBuffer( kernelCommandQueue, qValues[ k ], CL_FALSE, sizeof(double) * j, sizeof(double), &(copiedValues[ 2 * k ]), 0, NULL, NULL );
+					errorCode = write_reals( kernelCommandQueue, qValues[ k ], CL_FALSE, j, 1, &(copiedValues[ 2 * k ]), 0, NULL, NULL );
 					if ( CL_SUCCESS != errorCode )
 					{
 						fprintf( stderr, "ERROR WRITING I VALUES WHILE Q SWAPPING\n" );
 						return -1;
 					}
-					errorCode = clEnqueueWriteBuffer( kernelCommandQueue, qValues[ k ], CL_FALSE, sizeof(double) * i, sizeof(double), &(copiedValues[ 2 * k + 1 ]), 0, NULL, NULL );
+					errorCode = write_reals( kernelCommandQueue, qValues[ k ], CL_FALSE, i, 1, &(copiedValues[ 2 * k + 1 ]), 0, NULL, NULL );
 					if ( CL_SUCCESS != errorCode )
 					{
 						fprintf( stderr, "ERROR WRITING J VALUES WHILE Q SWAPPING\n" );
@@ -1993,6 +2844,643 @@ protected:
 	double (Kernel::*kernel_function)(int i, int j) const;
 
 	int (Kernel::*wide_kernel_function)( int i, int startJ, int endJ, double * output ) const; 
+
+	// row engine kernel (LINEAR, POLY, RBF or SIGMOID), -1 when rows must be
+	// filled element by element through kernel_function
+	int row_kernel_type;
+	// the row engine instantiated for row_kernel_type and the poly degree,
+	// picked once by select_row_engine: one indirect call per row, with the
+	// transform inlined into the loops
+	void (Kernel::*row_fill)(int i, int start, int end, double *out) const;
+	void (Kernel::*row_sweep)(const int *rows, const int *start, int count, int len, Qfloat **out) const;
+	double (Kernel::*sparse_element)(int i, int j) const;
+	// scratch row of length l for get_Q
+	double *row_buffer;
+
+	// CSR rows of x when the data is sparse enough, NULL otherwise. Once built
+	// the kernel reads x only through them; rows are swapped together with x
+	struct sparse_row
+	{
+		int nnz;
+		const int *index;
+		const svm_feature *value;
+	};
+	sparse_row *sparse_x;
+	int *sparse_index;
+	svm_feature *sparse_value;
+	// zeroed row of sparse_width features that fill_row scatters x[i] into
+	svm_feature *sparse_scratch;
+	int sparse_width;
+
+	// Nystrom factor Z (l x nystrom_rank, K ~ Z*Z'), NULL for the exact kernel;
+	// rows are swapped together with x
+	svm_feature **nystrom_row;
+	svm_feature *nystrom_factor;
+	int nystrom_rank;
+	// landmark indices into the original order of x, and L with W = L L'
+	int *nystrom_landmark;
+	double *nystrom_L;
+
+	// ids of x in the shared row cache, NULL when it is not used
+	shared_rows *shared;
+	int *instance_id;
+
+	void map_shared_instances(int l)
+	{
+		instance_id = NULL;
+#ifdef _DENSE_REP
+		if(shared == NULL || row_kernel_type < 0 || wideKernelInUse || nystrom_row ||
+		   kernel_type != shared->param.kernel_type || degree != shared->param.degree ||
+		   gamma != shared->param.gamma || coef0 != shared->param.coef0)
+			return;
+		instance_id = new int[l];
+		for(int i=0;i<l;i++)
+			if((instance_id[i] = shared_instance_id(shared, x[i].values)) < 0)
+			{
+				delete[] instance_id;
+				instance_id = NULL;
+				return;
+			}
+#endif
+	}
+
+	// out[j] = K(i,j) gathered from the shared row of instance i, computing
+	// that row over the whole outer problem on a miss
+	void shared_row(int i, int start, int end, double *out) const
+	{
+#ifdef _DENSE_REP
+		Qfloat *row;
+		int id = instance_id[i], n = shared->l;
+		if(shared->cache->get_data(id, &row, n) < n)
+		{
+			kernel_store *store = shared->store;
+			Qfloat *stored = store && store->ready ? store->rows+(size_t)id*n : NULL;
+			if(stored && store->ready[id])
+			{
+				// no reading the row ahead of its ready byte
+				kernel_store_barrier();
+				memcpy(row, stored, sizeof(Qfloat)*n);
+				shared->cache->put_data(id, row, 0, n);
+			}
+			else
+			{
+				int chunks = (n+ROW_CHUNK-1)/ROW_CHUNK;
+#pragma omp parallel for num_threads(worker_count()) if(n >= parallel_threshold) schedule(static)
+				for(int c=0;c<chunks;c++)
+				{
+					int first = c*ROW_CHUNK;
+					k_function_row(&shared->x[id], shared->x+first, shared->norm ? shared->norm+first : NULL,
+						       min(ROW_CHUNK, n-first), shared->param, shared->row+first);
+				}
+				for(int k=0;k<n;k++)
+					row[k] = (Qfloat)shared->row[k];
+				shared->cache->put_data(id, row, 0, n);
+				if(stored)
+				{
+					memcpy(stored, row, sizeof(Qfloat)*n);
+					// the row must be visible before its ready byte
+					kernel_store_barrier();
+					store->ready[id] = 1;
+				}
+			}
+		}
+		for(int j=start;j<end;j++)
+			out[j] = row[instance_id[j]];
+#endif
+	}
+
+	double kernel_nystrom(int i, int j) const
+	{
+		return simd_dot(nystrom_row[i], nystrom_row[j], nystrom_rank);
+	}
+
+	// fixed-seed xorshift for the landmark draw, so runs repeat and do not
+	// depend on who else called rand()
+	static int landmark_rand(unsigned long long &state, int n)
+	{
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		return (int)((state*2685821657736338717ULL >> 33)%(unsigned long long)n);
+	}
+
+	// x[i].c and c += x[i] for a dense vector c of the full width, read from
+	// the CSR rows when the kernel uses them
+	double row_dot_dense(int i, const double *c) const
+	{
+		double sum = 0;
+		int k;
+		if(sparse_x)
+		{
+			const sparse_row &r = sparse_x[i];
+			for(k=0;k<r.nnz;k++)
+				sum += r.value[k]*c[r.index[k]];
+		}
+		else
+			for(k=0;k<x[i].dim;k++)
+				sum += x[i].values[k]*c[k];
+		return sum;
+	}
+
+	void row_add_dense(int i, double *c) const
+	{
+		int k;
+		if(sparse_x)
+		{
+			const sparse_row &r = sparse_x[i];
+			for(k=0;k<r.nnz;k++)
+				c[r.index[k]] += r.value[k];
+		}
+		else
+			for(k=0;k<x[i].dim;k++)
+				c[k] += x[i].values[k];
+	}
+
+	// NYSTROM_KMEANS: Lloyd iterations in input space from the random
+	// landmarks, then each landmark becomes the point closest to its
+	// centroid, so it stays a training point the model can store. Empty
+	// clusters are dropped; returns the number of landmarks left
+	int nystrom_kmeans(int l, int m, int *landmark) const
+	{
+		int d = 1, i, k, it;
+		for(i=0;i<l;i++)
+			d = max(d, x[i].dim);
+		double *centroid = new double[(long int)m*d];
+		double *sum = new double[(long int)m*d];
+		double *norm = new double[m];
+		int *count = new int[m];
+		int *assign = new int[l];
+		double *dist = new double[l];
+		for(k=0;k<(long int)m*d;k++)
+			centroid[k] = 0;
+		for(k=0;k<m;k++)
+			row_add_dense(landmark[k], centroid+(long int)k*d);
+		for(it=0;;it++)
+		{
+			for(k=0;k<m;k++)
+			{
+				const double *c = centroid+(long int)k*d;
+				norm[k] = 0;
+				for(int t=0;t<d;t++)
+					norm[k] += c[t]*c[t];
+			}
+			// |x_i - c_k|^2 up to the |x_i|^2 every k shares
+#pragma omp parallel for num_threads(worker_count()) if(l >= parallel_threshold) schedule(static)
+			for(int r=0;r<l;r++)
+			{
+				int best = 0;
+				double best_dist = INF;
+				for(int q=0;q<m;q++)
+				{
+					double dq = norm[q]-2*row_dot_dense(r, centroid+(long int)q*d);
+					if(dq < best_dist)
+					{
+						best = q;
+						best_dist = dq;
+					}
+				}
+				assign[r] = best;
+				dist[r] = best_dist;
+			}
+			if(it == NYSTROM_KMEANS_ITERATIONS)
+				break;
+			for(k=0;k<(long int)m*d;k++)
+				sum[k] = 0;
+			for(k=0;k<m;k++)
+				count[k] = 0;
+			for(i=0;i<l;i++)
+			{
+				row_add_dense(i, sum+(long int)assign[i]*d);
+				++count[assign[i]];
+			}
+			// an empty cluster keeps its centroid
+			for(k=0;k<m;k++)
+				if(count[k] > 0)
+					for(int t=0;t<d;t++)
+						centroid[(long int)k*d+t] = sum[(long int)k*d+t]/count[k];
+		}
+		// closest member of each cluster, now with |x_i|^2
+		for(k=0;k<m;k++)
+			landmark[k] = -1;
+		for(i=0;i<l;i++)
+		{
+			dist[i] += x_square ? x_square[i] : row_norm(i);
+			k = assign[i];
+			if(landmark[k] < 0 || dist[i] < dist[landmark[k]])
+				landmark[k] = i;
+		}
+		int n = 0;
+		for(k=0;k<m;k++)
+			if(landmark[k] >= 0)
+				landmark[n++] = landmark[k];
+		delete[] centroid;
+		delete[] sum;
+		delete[] norm;
+		delete[] count;
+		delete[] assign;
+		delete[] dist;
+		return n;
+	}
+
+	double row_norm(int i) const
+	{
+		return sparse_x ? sparse_dot(sparse_x[i],sparse_x[i]) : dot(x[i],x[i]);
+	}
+
+	// K ~ C W^-1 C' with C the kernel columns of m landmarks and W their m x m
+	// block; with W = L L' the factor is Z = C L^-T, so a kernel row costs
+	// O(l*m) instead of O(l*d). Pivots lost to rounding (W is only PSD) are
+	// dropped, which gives the pseudo-inverse on that direction. Landmarks are
+	// drawn at random with a fixed seed, or refined by k-means (see
+	// svm_set_nystrom_sampling); they and L are kept for nystrom_expansion.
+	void build_nystrom(int l, int m)
+	{
+		nystrom_row = NULL;
+		nystrom_factor = NULL;
+		nystrom_rank = 0;
+		nystrom_landmark = NULL;
+		nystrom_L = NULL;
+#ifdef _DENSE_REP
+		if(m <= 0 || row_kernel_type < 0 || wideKernelInUse)
+			return;
+		m = min(m, l);
+		int i, j, k;
+		int *landmark = new int[l];
+		unsigned long long state = NYSTROM_SEED;
+		for(i=0;i<l;i++)
+			landmark[i] = i;
+		for(i=0;i<m;i++)
+			swap(landmark[i], landmark[i+landmark_rand(state, l-i)]);
+		if(nystrom_sampling == NYSTROM_KMEANS && m < l)
+			m = nystrom_kmeans(l, m, landmark);
+
+		// C, column by column through the exact row engine
+		double *C = new double[(long int)l*m];
+		for(k=0;k<m;k++)
+		{
+			kernel_row(landmark[k], 0, l, row_buffer);
+			for(i=0;i<l;i++)
+				C[(long int)i*m+k] = row_buffer[i];
+		}
+
+		// Cholesky of W in place
+		double *L = new double[(long int)m*m];
+		double trace = 0;
+		for(k=0;k<m;k++)
+			trace += C[(long int)landmark[k]*m+k];
+		double tolerance = 1e-12*max(trace, 1.0);
+		for(j=0;j<m;j++)
+		{
+			const double *w = C+(long int)landmark[j]*m;
+			for(i=0;i<=j;i++)
+			{
+				double sum = w[i];
+				for(k=0;k<i;k++)
+					sum -= L[j*m+k]*L[i*m+k];
+				if(i < j)
+					L[j*m+i] = L[i*m+i] > 0 ? sum/L[i*m+i] : 0;
+				else
+					L[j*m+j] = sum > tolerance ? sqrt(sum) : 0;
+			}
+		}
+		nystrom_landmark = landmark;
+		nystrom_L = L;
+
+		nystrom_rank = m;
+		nystrom_factor = new svm_feature[(long int)l*m];
+		nystrom_row = new svm_feature*[l];
+#pragma omp parallel for num_threads(worker_count()) if(l >= parallel_threshold) schedule(static)
+		for(int r=0;r<l;r++)
+		{
+			// forward substitution L z = c_r
+			double *c = C+(long int)r*m;
+			svm_feature *z = nystrom_factor+(long int)r*m;
+			for(int p=0;p<m;p++)
+			{
+				double sum = c[p];
+				for(int q=0;q<p;q++)
+					sum -= L[p*m+q]*c[q];
+				c[p] = L[p*m+p] > 0 ? sum/L[p*m+p] : 0;
+				z[p] = (svm_feature)c[p];
+			}
+			nystrom_row[r] = z;
+		}
+		delete[] C;
+		kernel_function = &Kernel::kernel_nystrom;
+		info("Nystrom approximation with %d landmarks\n", m);
+#endif
+	}
+
+	void build_sparse_rows(int l)
+	{
+#ifdef _DENSE_REP
+		long int nnz = 0, total = 0;
+		int i, k;
+		sparse_x = NULL;
+		sparse_index = NULL;
+		sparse_value = NULL;
+		sparse_scratch = NULL;
+		sparse_width = 0;
+		// the OpenCL kernels upload the dense rows themselves
+		if(row_kernel_type < 0 || wideKernelInUse)
+			return;
+		for(i=0;i<l;i++)
+		{
+			sparse_width = max(sparse_width, x[i].dim);
+			for(k=0;k<x[i].dim;k++)
+				if(x[i].values[k] != 0)
+					++nnz;
+		}
+		// density against the full width, the same measure the readers use
+		total = (long int)l*sparse_width;
+		if(total == 0 || nnz > SVM_SPARSE_DENSITY*total)
+		{
+			sparse_width = 0;
+			return;
+		}
+		info("density %.3f, using CSR kernel rows\n", (double)nnz/total);
+		sparse_x = new sparse_row[l];
+		sparse_index = new int[max(nnz,1L)];
+		sparse_value = new svm_feature[max(nnz,1L)];
+		sparse_scratch = new svm_feature[sparse_width];
+		for(k=0;k<sparse_width;k++)
+			sparse_scratch[k] = 0;
+		nnz = 0;
+		for(i=0;i<l;i++)
+		{
+			sparse_x[i].nnz = 0;
+			sparse_x[i].index = sparse_index+nnz;
+			sparse_x[i].value = sparse_value+nnz;
+			for(k=0;k<x[i].dim;k++)
+				if(x[i].values[k] != 0)
+				{
+					sparse_index[nnz] = k;
+					sparse_value[nnz] = x[i].values[k];
+					++nnz;
+					++sparse_x[i].nnz;
+				}
+		}
+		kernel_function = sparse_element;
+#else
+		sparse_x = NULL;
+		sparse_index = NULL;
+		sparse_value = NULL;
+		sparse_scratch = NULL;
+		sparse_width = 0;
+#endif
+	}
+
+	// dot product of two CSR rows, merging their index lists
+	static double sparse_dot(const sparse_row &a, const sparse_row &b)
+	{
+		double sum = 0;
+		int p = 0, q = 0;
+		while(p < a.nnz && q < b.nnz)
+		{
+			if(a.index[p] == b.index[q])
+				sum += (double)a.value[p++]*b.value[q++];
+			else if(a.index[p] < b.index[q])
+				++p;
+			else
+				++q;
+		}
+		return sum;
+	}
+
+	// K(i,j) from the CSR rows, with the same transform as the row engine
+	template<int KERNEL, int DEGREE>
+	double kernel_sparse(int i, int j) const
+	{
+		double value = sparse_dot(sparse_x[i], sparse_x[j]);
+		row_transform<KERNEL,DEGREE>(&value, 1, gamma, coef0, degree, x_square ? x_square[i] : 0,
+					     x_square ? x_square+j : NULL);
+		return value;
+	}
+
+	// whole-row evaluation: out[j] = K(i,j) for start <= j < end, timed into
+	// counters.column_fill_time
+	void kernel_row(int i, int start, int end, double *out) const
+	{
+		profileDecls;
+		startTimer();
+		fill_row(i, start, end, out);
+		stopTimer();
+		counters.column_fill_time += calculateTime()*1e-6;
+	}
+
+	// out[r][j] = K(rows[r],j) for start[r] <= j < len. The dense engine
+	// sweeps x once for all count rows, each ROW_CHUNK block of x staying in
+	// cache while every row is dotted against it; the other engines go row
+	// by row
+	void kernel_rows(const int *rows, const int *start, int count, int len, Qfloat **out) const
+	{
+		profileDecls;
+		startTimer();
+		int r;
+#ifdef _DENSE_REP
+		if(row_kernel_type >= 0 && !nystrom_row && !instance_id && !sparse_x)
+			(this->*row_sweep)(rows, start, count, len, out);
+		else
+#endif
+		for(r=0;r<count;r++)
+		{
+			fill_row(rows[r], start[r], len, row_buffer);
+			for(int j=start[r];j<len;j++)
+				out[r][j] = (Qfloat)row_buffer[j];
+		}
+		stopTimer();
+		counters.column_fill_time += calculateTime()*1e-6;
+	}
+
+	// get_Q_block for the cached Q matrices: columns in cache are copied,
+	// the missing ones are computed together by kernel_rows and stored back.
+	// With y the columns are y[i]*y[j]*K(i,j), as in get_Q
+	void fill_Q_block(Cache *cache, const schar *y, const int *B, int n, int len, Qfloat **columns) const
+	{
+		int *miss = new int[n];
+		int *start = new int[n];
+		Qfloat **out = new Qfloat*[n];
+		int count = 0, t, k, j;
+		for(t=0;t<n;t++)
+		{
+			Qfloat *data;
+			int filled = min(cache->get_data(B[t],&data,len), len);
+			memcpy(columns[t], data, sizeof(Qfloat)*filled);
+			if(filled < len)
+			{
+				miss[count] = B[t];
+				start[count] = filled;
+				out[count++] = columns[t];
+			}
+		}
+		if(count > 0)
+		{
+			kernel_rows(miss, start, count, len, out);
+			for(k=0;k<count;k++)
+			{
+				if(y)
+					for(j=start[k];j<len;j++)
+						if(y[miss[k]] != y[j])
+							out[k][j] = -out[k][j];
+				cache->put_column(miss[k], out[k], len);
+			}
+		}
+		delete[] miss;
+		delete[] start;
+		delete[] out;
+	}
+
+	// a blocked dot product sweep followed by the kernel transform over the row
+	void fill_row(int i, int start, int end, double *out) const
+	{
+		if(nystrom_row)
+		{
+#pragma omp parallel for num_threads(worker_count()) if(end-start >= parallel_threshold) schedule(static)
+			for(int jj=start;jj<end;jj++)
+				out[jj] = kernel_nystrom(i,jj);
+			return;
+		}
+		if(instance_id)
+		{
+			shared_row(i, start, end, out);
+			return;
+		}
+#ifdef _DENSE_REP
+		if(row_kernel_type >= 0)
+		{
+			(this->*row_fill)(i, start, end, out);
+			return;
+		}
+#endif
+		for(int j=start;j<end;j++)
+			out[j] = (this->*kernel_function)(i,j);
+	}
+
+#ifdef _DENSE_REP
+	template<int KERNEL, int DEGREE>
+	void fill_row_engine(int i, int start, int end, double *out) const
+	{
+		int j;
+		if(sparse_x)
+		{
+			// scatter row i into the zeroed scratch row, gather it at the
+			// non-zeros of each row j, then clear it again
+			const sparse_row &ri = sparse_x[i];
+			for(j=0;j<ri.nnz;j++)
+				sparse_scratch[ri.index[j]] = ri.value[j];
+#pragma omp parallel for num_threads(worker_count()) if(end-start >= parallel_threshold) schedule(static)
+			for(int jj=start;jj<end;jj++)
+			{
+				const sparse_row &r = sparse_x[jj];
+				out[jj] = simd_sparse_dot(r.index, r.value, r.nnz, sparse_scratch);
+			}
+			for(j=0;j<ri.nnz;j++)
+				sparse_scratch[ri.index[j]] = 0;
+			kernel_row_transform<KERNEL,DEGREE>(i, start, end, out);
+			return;
+		}
+		const svm_node &xi = x[i];
+		int chunks = (end-start+ROW_CHUNK-1)/ROW_CHUNK;
+#pragma omp parallel for num_threads(worker_count()) if(end-start >= parallel_threshold) schedule(static)
+		for(int c=0;c<chunks;c++)
+		{
+			int first = start+c*ROW_CHUNK;
+			dot_rows(xi, x+first, min(ROW_CHUNK, end-first), out+first);
+		}
+		kernel_row_transform<KERNEL,DEGREE>(i, start, end, out);
+	}
+
+	// the dense half of kernel_rows
+	template<int KERNEL, int DEGREE>
+	void sweep_rows(const int *rows, const int *start, int count, int len, Qfloat **out) const
+	{
+		int first_start = len;
+		for(int r=0;r<count;r++)
+			first_start = min(first_start, start[r]);
+		int chunks = (len-first_start+ROW_CHUNK-1)/ROW_CHUNK;
+#pragma omp parallel for num_threads(worker_count()) if(len-first_start >= parallel_threshold) schedule(static)
+		for(int c=0;c<chunks;c++)
+		{
+			double value[ROW_CHUNK];
+			int first = first_start+c*ROW_CHUNK;
+			int n = min(ROW_CHUNK, len-first);
+			for(int k=0;k<count;k++)
+			{
+				int i = rows[k];
+				if(first+n <= start[k])
+					continue;
+				dot_rows(x[i], x+first, n, value);
+				row_transform<KERNEL,DEGREE>(value, n, gamma, coef0, degree, x_square ? x_square[i] : 0,
+							     x_square ? x_square+first : NULL);
+				for(int j=max(first,start[k]);j<first+n;j++)
+					out[k][j] = (Qfloat)value[j-first];
+			}
+		}
+	}
+
+	template<int KERNEL, int DEGREE>
+	void use_row_engine()
+	{
+		row_fill = &Kernel::fill_row_engine<KERNEL,DEGREE>;
+		row_sweep = &Kernel::sweep_rows<KERNEL,DEGREE>;
+		sparse_element = &Kernel::kernel_sparse<KERNEL,DEGREE>;
+	}
+
+	// the one run-time switch of the row engine, as select_row_transform
+	void select_row_engine()
+	{
+		switch(row_kernel_type)
+		{
+			case POLY:
+				switch(degree)
+				{
+					case 2: use_row_engine<POLY,2>(); break;
+					case 3: use_row_engine<POLY,3>(); break;
+					case 4: use_row_engine<POLY,4>(); break;
+					default: use_row_engine<POLY,0>(); break;
+				}
+				break;
+			case RBF:
+				use_row_engine<RBF,0>();
+				break;
+			case SIGMOID:
+				use_row_engine<SIGMOID,0>();
+				break;
+			default:
+				use_row_engine<LINEAR,0>();
+				break;
+		}
+	}
+#endif
+
+	// QD[i] = K(i,i) for all l vectors; only the CPU kernels run in parallel,
+	// the OpenCL ones share a single command queue
+	void fill_diagonal(double *QD) const
+	{
+		int l = numberOfVectors;
+#pragma omp parallel for num_threads(worker_count()) if(row_kernel_type >= 0 && l >= parallel_threshold) schedule(static)
+		for(int i=0;i<l;i++)
+			QD[i] = (this->*kernel_function)(i,i);
+	}
+
+	// turns a row of dot products into kernel values, in chunks so that the
+	// workers each get whole SIMD-friendly stretches of the row
+	template<int KERNEL, int DEGREE>
+	void kernel_row_transform(int i, int start, int end, double *out) const
+	{
+		if(KERNEL == LINEAR)
+			return;
+		double norm_i = x_square ? x_square[i] : 0;
+		int chunks = (end-start+ROW_CHUNK-1)/ROW_CHUNK;
+#pragma omp parallel for num_threads(worker_count()) if(end-start >= parallel_threshold) schedule(static)
+		for(int c=0;c<chunks;c++)
+		{
+			int first = start+c*ROW_CHUNK;
+			int last = min(first+ROW_CHUNK, end);
+			row_transform<KERNEL,DEGREE>(out+first, last-first, gamma, coef0, degree,
+						     norm_i, x_square ? x_square+first : NULL);
+		}
+	}
 	
 private:
 
@@ -2020,6 +3508,7 @@ private:
 	cl_kernel linearKernelKernel;
 	cl_kernel customDaxpyKernel;
 	cl_kernel swapObjectiveFunctionKernel;
+	cl_kernel swapQKernel;
 	cl_kernel findCandidateIValuesKernel;
 	cl_kernel findCandidateJValuesKernel;
 	cl_kernel dualDaxpyKernel;
@@ -2031,6 +3520,12 @@ private:
 	cl_kernel swapVectorBlockKernel;
 	cl_kernel predictionReductionKernel;
 	cl_mem resultCl;
+	// whether initialize_device set up the members above, which is skipped
+	// when neither the kernel type nor the solver mode needs OpenCL
+	bool device;
+	// device buffers, recycled rather than released (declared before the
+	// caches so it outlives what they hand back)
+	mutable DevicePool devicePool;
 	// caching stuff
 	GPUCache gpuCache;
 	GPUCache gpuQCache;
@@ -2078,6 +3573,7 @@ private:
 	
 	// function declarations
 	
+	void initialize_device( int l );
 	static double dot(const svm_node *px, const svm_node *py);
 #ifdef _DENSE_REP
 	static double dot(const svm_node &px, const svm_node &py);
@@ -2155,34 +3651,34 @@ private:
 			#ifdef _DENSE_REP
 				// allocate GPU space for them
 				// check the cache
-				if ( -1 == ((GPUCache)gpuCache).CheckCache( i, &x_data_i ) )
+				if ( -1 == ((GPUCache*)&gpuCache)->CheckCache( i, &x_data_i ) )
 				{
-					x_data_i = clCreateBuffer( kernelContext, CL_MEM_READ_ONLY, sizeof(double) * x[i].dim, NULL, &errorCode );
+					x_data_i = devicePool.Acquire( kernelContext, sizeof(svm_feature) * x[i].dim, &errorCode );
 					if ( CL_SUCCESS != errorCode )
 					{
 						// TODO: Deal with this error case
 						fprintf( stderr, "Error creating OpenCL buffer\n" );
 						exit( -1 );
 					}
-					errorCode = clEnqueueWriteBuffer( kernelCommandQueue, x_data_i, /* CL_FALSE /*/ CL_TRUE /**/, 0, sizeof(double) * x[i].dim, x[i].values, 0, NULL, &write1Event );
-					((GPUCache)gpuCache).CacheData( i, x_data_i );
+					errorCode = metered_write_buffer( kernelCommandQueue, x_data_i, /* CL_FALSE /*/ CL_TRUE /**/, 0, sizeof(svm_feature) * x[i].dim, x[i].values, 0, NULL, &write1Event );
+					((GPUCache*)&gpuCache)->CacheData( i, x_data_i );
 				}
-				if ( -1 == ((GPUCache)gpuCache).CheckCache( j, &x_data_j ) )
+				if ( -1 == ((GPUCache*)&gpuCache)->CheckCache( j, &x_data_j ) )
 				{
-					x_data_j = clCreateBuffer( kernelContext, CL_MEM_READ_ONLY, sizeof(double) * x[j].dim, NULL, &errorCode );
+					x_data_j = devicePool.Acquire( kernelContext, sizeof(svm_feature) * x[j].dim, &errorCode );
 					if ( CL_SUCCESS != errorCode )
 					{
 						// TODO: Deal with this error code
 						fprintf( stderr, "Error creating OpenCL buffer\n" );
 						exit( -1 );
 					}
-					errorCode = clEnqueueWriteBuffer( kernelCommandQueue, x_data_j, /* CL_FALSE /*/ CL_TRUE /**/, 0, sizeof(double) * x[j].dim, x[j].values, 0, NULL, &write2Event );
-					((GPUCache)gpuCache).CacheData( j, x_data_j );
+					errorCode = metered_write_buffer( kernelCommandQueue, x_data_j, /* CL_FALSE /*/ CL_TRUE /**/, 0, sizeof(svm_feature) * x[j].dim, x[j].values, 0, NULL, &write2Event );
+					((GPUCache*)&gpuCache)->CacheData( j, x_data_j );
 				}
 				
 				// do the actual writing
-				//errorCode = clEnqueueWriteBuffer( kernelCommandQueue, x_data_i, CL_TRUE, 0, sizeof(double) * x[i].dim, x[i].values, 0, NULL, NULL );
-				//errorCode |= clEnqueueWriteBuffer( kernelCommandQueue, x_data_j, CL_TRUE, 0, sizeof(double) * x[j].dim, x[j].values, 0, NULL, NULL );
+				//errorCode = metered_write_buffer( kernelCommandQueue, x_data_i, CL_TRUE, 0, sizeof(svm_feature) * x[i].dim, x[i].values, 0, NULL, NULL );
+				//errorCode |= metered_write_buffer( kernelCommandQueue, x_data_j, CL_TRUE, 0, sizeof(svm_feature) * x[j].dim, x[j].values, 0, NULL, NULL );
 				/*if ( CL_SUCCESS != errorCode )
 				{
 					fprintf( stderr, "Error writing to OpenCL buffers\n" );
@@ -2192,7 +3688,7 @@ private:
 				// TODO: this
 			#endif
 			// create space for the output
-			/*resultCl = clCreateBuffer( kernelContext, CL_MEM_WRITE_ONLY, sizeof(double), NULL, &errorCode );
+			/*resultCl = clCreateBuffer( kernelContext, CL_MEM_WRITE_ONLY, sizeof(cl_real), NULL, &errorCode );
 			if ( CL_SUCCESS != errorCode )
 			{
 				fprintf( stderr, "Error creating linear kernel result buffer\n" );
@@ -2218,7 +3714,7 @@ private:
 			workGroupSize |= workGroupSize >> 16;
 			workGroupSize++;*/
 			// allocate space for intermediate GPU result, we'll do reduction on the CPU
-			y_data = clCreateBuffer( kernelContext, CL_MEM_WRITE_ONLY, sizeof(double) * goodDataSize, NULL, &errorCode );
+			y_data = devicePool.Acquire( kernelContext, sizeof(cl_real) * goodDataSize, &errorCode );
 			if ( CL_SUCCESS != errorCode )
 			{
 				// TODO: Deal with this error code
@@ -2237,7 +3733,7 @@ private:
 			//errorCode |= clSetKernelArg( linearKernelKernel, 2, sizeof(cl_mem), &(resultCl) );
 			errorCode |= clSetKernelArg( linearKernelKernel, 2, sizeof(cl_mem), &(y_data) );
 			errorCode |= clSetKernelArg( linearKernelKernel, 3, sizeof(int), &(goodDataSize) );
-			errorCode |= clSetKernelArg( linearKernelKernel, 4, sizeof(double) * workGroupSize, NULL );
+			errorCode |= clSetKernelArg( linearKernelKernel, 4, sizeof(cl_real) * workGroupSize, NULL );
 			if ( CL_SUCCESS != errorCode )
 			{
 				// TODO: Deal with this error for real
@@ -2273,7 +3769,7 @@ private:
 		}*/
 		// read the result from the GPU
 		{
-			//errorCode = clEnqueueReadBuffer( kernelCommandQueue, resultCl, /* CL_FALSE /*/ CL_TRUE /***/, 0, sizeof(double), &result, 0, NULL, &readEvent );
+			//errorCode = metered_read_buffer( kernelCommandQueue, resultCl, /* CL_FALSE /*/ CL_TRUE /***/, 0, sizeof(double), &result, 0, NULL, &readEvent );
 			/*if ( CL_SUCCESS != errorCode )
 			{
 				// TODO: Deal with this error
@@ -2288,7 +3784,7 @@ private:
 				exit( -1 );
 			}
 			//double longResult[ goodDataSize ];
-			errorCode = clEnqueueReadBuffer( kernelCommandQueue, y_data, /*CL_FALSE*/CL_TRUE, 0, sizeof(double) * goodDataSize, longResult, 0, NULL, &readEvent );
+			errorCode = read_reals( kernelCommandQueue, y_data, /*CL_FALSE*/CL_TRUE, 0, goodDataSize, longResult, 0, NULL, &readEvent );
 			if ( CL_SUCCESS != errorCode )
 			{
 				// TODO: Deal with this error
@@ -2330,18 +3826,54 @@ private:
 		fprintf( stdout, "Execute time: %llu\n", (executeEnd - executeStart) );
 		
 		// clean up
-		//clReleaseMemObject( x_data_i );
-		//clReleaseMemObject( x_data_j );
-		//clReleaseMemObject( resultCl );
-		clReleaseMemObject( y_data );
-		free( longResult );
-		return result;
+		//clReleaseMemObject( x_data_i );
+		//clReleaseMemObject( x_data_j );
+		//clReleaseMemObject( resultCl );
+		devicePool.Release( y_data );
+		free( longResult );
+		return result;
+	}
+	
+	// this will be a set of special, "wide" kernels
+	
+	#ifdef CL_SVM
+	
+	/**
+	 *	write_vector_block
+	 *
+	 *	Writes count vectors of the given dimension, starting at x[start], into buffer back to back.
+	 *	When the vectors are views into one contiguous matrix (see svm_alloc_feature_matrix) and
+	 *	still in their original order this is a single transfer, otherwise one write per vector.
+	 **/
+	cl_int write_vector_block( cl_mem buffer, int start, int count, int dimension ) const
+	{
+		// variables
+		cl_int errorCode;
+		int k;
+		int contiguous;
+		
+		// function body
+		contiguous = 1;
+		for ( k = 0; k < count && contiguous; k++ )
+		{
+			contiguous = ( x[ start + k ].dim == dimension && x[ start + k ].values == x[ start ].values + (size_t) k * dimension );
+		}
+		if ( contiguous )
+		{
+			return metered_write_buffer( kernelCommandQueue, buffer, CL_FALSE, 0, sizeof(svm_feature) * count * dimension,
+											x[ start ].values, 0, NULL, NULL );
+		}
+		errorCode = CL_SUCCESS;
+		for ( k = 0; k < count; k++ )
+		{
+			errorCode |= metered_write_buffer( kernelCommandQueue, buffer, CL_FALSE, k * sizeof(svm_feature) * dimension,
+												sizeof(svm_feature) * dimension, x[ k + start ].values, 0, NULL, NULL );
+		}
+		
+		// clean up
+		return errorCode;
 	}
 	
-	// this will be a set of special, "wide" kernels
-	
-	#ifdef CL_SVM
-	
 	/**
 	 *	wide_kernel_linear_opencl
 	 *
@@ -2363,7 +3895,6 @@ private:
 		cl_mem tempBuffer;
 		//cl_mem q_i;
 		uint32_t jDimension;
-		uint32_t k;
 		int numberOfJVectors;
 		int qAlreadyComputed;
 		int workDimension;
@@ -2386,7 +3917,7 @@ private:
 			numberOfJVectors = (endJ - startJ) + 1;
 			qAlreadyComputed = 0;
 			// all programming is an exercise in caching
-			if ( 0 == ((GPUCache)gpuQCache).CheckCache( i, &y_data ) )
+			if ( 0 == ((GPUCache*)&gpuQCache)->CheckCache( i, &y_data ) )
 			{
 				qAlreadyComputed = 1;
 				// I really, sincerely don't care that gotos are bad practice
@@ -2399,17 +3930,17 @@ wide_kernel_linear_opencl_retry_label:
 		{	
 			#ifdef _DENSE_REP
 				//fprintf( stdout, "WHATWHAT\n" );
-				//if ( -1 == ((GPUCache)gpuCache).CheckCache( i, &x_data_i ) )
+				//if ( -1 == ((GPUCache*)&gpuCache)->CheckCache( i, &x_data_i ) )
 				if ( -1 == myGpuCache->CheckCache( i, &x_data_i ) )
 				{
-					x_data_i = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE/*ONLY*/, sizeof(double) * x[i].dim, NULL, &errorCode );
+					x_data_i = devicePool.Acquire( kernelContext, sizeof(svm_feature) * x[i].dim, &errorCode );
 					if ( CL_SUCCESS != errorCode )
 					{
 						// TODO: Deal with this
 						fprintf( stderr, "ERROR CREATING X_DATA_I BUFFER\n" );
 						return -1;
 					}
-					errorCode = clEnqueueWriteBuffer( kernelCommandQueue, x_data_i, CL_FALSE, 0, sizeof(double) * x[i].dim, x[i].values, 0, NULL, NULL );
+					errorCode = metered_write_buffer( kernelCommandQueue, x_data_i, CL_FALSE, 0, sizeof(svm_feature) * x[i].dim, x[i].values, 0, NULL, NULL );
 					if ( CL_SUCCESS != errorCode )
 					{
 						// TODO: Deal with this error
@@ -2426,6 +3957,7 @@ wide_kernel_linear_opencl_retry_label:
 									myGpuCache->InvalidateCache();
 									//cpuQCache.InvalidateCache();
 									myCpuCache->InvalidateCache();
+									devicePool.Trim();
 									goto wide_kernel_linear_opencl_retry_label;
 								}
 								else
@@ -2458,7 +3990,7 @@ wide_kernel_linear_opencl_retry_label:
 						return -1;
 					}
 					//fprintf( stdout, "WHO?\n" );
-					//((GPUCache)gpuCache).CacheData( i, x_data_i );
+					//((GPUCache*)&gpuCache)->CacheData( i, x_data_i );
 					myGpuCache->CacheData( i, x_data_i );
 				}
 			#else
@@ -2472,7 +4004,7 @@ wide_kernel_linear_opencl_retry_label:
 			if ( -1 == myGpuCache->CheckCache( startJ, endJ, &x_data_j ) )
 			{
 				// create the cl_mem buffer (assume all j vectors have same dimensionality)
-				x_data_j = clCreateBuffer( kernelContext, CL_MEM_READ_ONLY, sizeof(double) * numberOfJVectors * jDimension, NULL, &errorCode );
+				x_data_j = devicePool.Acquire( kernelContext, sizeof(svm_feature) * numberOfJVectors * jDimension, &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this
@@ -2480,11 +4012,7 @@ wide_kernel_linear_opencl_retry_label:
 					return -1;
 				}
 				// loop through the j vectors and write them
-				errorCode = 0;
-				for ( k = 0; k < numberOfJVectors; k++ )
-				{
-					errorCode |= clEnqueueWriteBuffer( kernelCommandQueue, x_data_j, CL_FALSE, k * sizeof(double) * jDimension, sizeof(double) * jDimension, x[k + startJ].values, 0, NULL, NULL );
-				}
+				errorCode = write_vector_block( x_data_j, startJ, numberOfJVectors, jDimension );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this
@@ -2514,7 +4042,7 @@ wide_kernel_linear_opencl_retry_label:
 			//if ( -1 == gpuCache.GetQSpace( numberOfJVectors, &y_data ) )
 			//if( -1 == gpuQCache.CheckCache( i, &y_data ) )
 			{
-				y_data = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE, sizeof(double) * (numberOfJVectors + IDEAL_WORK_GROUP_SIZE - remainder), NULL, &errorCode );
+				y_data = devicePool.Acquire( kernelContext, sizeof(cl_real) * (numberOfJVectors + IDEAL_WORK_GROUP_SIZE - remainder), &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error
@@ -2553,7 +4081,7 @@ wide_kernel_linear_opencl_retry_label:
 			errorCode |= clSetKernelArg( customMatrixVectorKernel, 2, sizeof(cl_mem), &y_data );
 			//errorCode |= clSetKernelArg( customMatrixVectorKernel, 3, sizeof(int), &numberOfJVectors );
 			errorCode |= clSetKernelArg( customMatrixVectorKernel, 3, sizeof(int), &jDimension );
-			errorCode |= clSetKernelArg( customMatrixVectorKernel, 4, sizeof(double) * IDEAL_WORK_GROUP_SIZE, NULL );
+			errorCode |= clSetKernelArg( customMatrixVectorKernel, 4, sizeof(cl_real) * IDEAL_WORK_GROUP_SIZE, NULL );
 			//errorCode |= clSetKernelArg( customMatrixVectorKernel, 6, sizeof(cl_mem), &tempBuffer );
 			errorCode |= clSetKernelArg( customMatrixVectorKernel, 5, sizeof(int), &localSize );
 			//errorCode |= clSetKernelArg( customMatrixVectorKernel, 8, sizeof(int), &numberOfWorkGroups );
@@ -2618,6 +4146,7 @@ wide_kernel_linear_opencl_retry_label:
 							myGpuCache->InvalidateCache();
 							//cpuQCache.InvalidateCache();
 							myCpuCache->InvalidateCache();
+							devicePool.Trim();
 							goto wide_kernel_linear_opencl_retry_label;
 						}
 						else
@@ -2650,7 +4179,7 @@ wide_kernel_linear_opencl_skip_work_label:
 		{
 			if ( NULL != output )
 			{
-				errorCode = clEnqueueReadBuffer( kernelCommandQueue, y_data, CL_TRUE, 0, sizeof(double) * numberOfJVectors, output, 0, NULL, NULL );
+				errorCode = read_reals( kernelCommandQueue, y_data, CL_TRUE, 0, numberOfJVectors, output, 0, NULL, NULL );
 				if ( CL_SUCCESS != errorCode )
 				{
 					fprintf( stderr, "ERROR READING OUTPUT DATA: %i, %i, %i\n", i, startJ, endJ );
@@ -2695,7 +4224,7 @@ wide_kernel_linear_opencl_skip_work_label:
 		{
 			//clReleaseMemObject( x_data_i );
 			//clReleaseMemObject( x_data_j );
-			clReleaseMemObject( y_data );
+			devicePool.Release( y_data );
 		}
 		return 0;
 	}
@@ -2711,7 +4240,6 @@ wide_kernel_linear_opencl_skip_work_label:
 		cl_mem tempBuffer;
 		//cl_mem q_i;
 		uint32_t jDimension;
-		uint32_t k;
 		int numberOfJVectors;
 		int qAlreadyComputed;
 		int workDimension;
@@ -2754,14 +4282,14 @@ wide_kernel_poly_opencl_retry_label:
 				{
 					// debugging
 					//fprintf( stdout, "MISSED CACHE ON X[%i]\n", i );
-					x_data_i = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE/*ONLY*/, sizeof(double) * x[i].dim, NULL, &errorCode );
+					x_data_i = devicePool.Acquire( kernelContext, sizeof(svm_feature) * x[i].dim, &errorCode );
 					if ( CL_SUCCESS != errorCode )
 					{
 						// TODO: Deal with this
 						fprintf( stderr, "ERROR CREATING X_DATA_I BUFFER\n" );
 						return -1;
 					}
-					errorCode = clEnqueueWriteBuffer( kernelCommandQueue, x_data_i, CL_FALSE, 0, sizeof(double) * x[i].dim, x[i].values, 0, NULL, NULL );
+					errorCode = metered_write_buffer( kernelCommandQueue, x_data_i, CL_FALSE, 0, sizeof(svm_feature) * x[i].dim, x[i].values, 0, NULL, NULL );
 					if ( CL_SUCCESS != errorCode )
 					{
 						// TODO: Deal with this error
@@ -2778,6 +4306,7 @@ wide_kernel_poly_opencl_retry_label:
 									//cpuQCache.InvalidateCache();
 									myGpuCache->InvalidateCache();
 									myCpuCache->InvalidateCache();
+									devicePool.Trim();
 									goto wide_kernel_poly_opencl_retry_label;
 								}
 								else
@@ -2825,7 +4354,7 @@ wide_kernel_poly_opencl_retry_label:
 				// debugging
 				//fprintf( stdout, "MISSED CACHE ON A\n" );
 				// create the cl_mem buffer (assume all j vectors have same dimensionality)
-				x_data_j = clCreateBuffer( kernelContext, CL_MEM_READ_ONLY, sizeof(double) * numberOfJVectors * jDimension, NULL, &errorCode );
+				x_data_j = devicePool.Acquire( kernelContext, sizeof(svm_feature) * numberOfJVectors * jDimension, &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this
@@ -2833,11 +4362,7 @@ wide_kernel_poly_opencl_retry_label:
 					return -1;
 				}
 				// loop through the j vectors and write them
-				errorCode = 0;
-				for ( k = 0; k < numberOfJVectors; k++ )
-				{
-					errorCode |= clEnqueueWriteBuffer( kernelCommandQueue, x_data_j, CL_FALSE, k * sizeof(double) * jDimension, sizeof(double) * jDimension, x[k + startJ].values, 0, NULL, NULL );
-				}
+				errorCode = write_vector_block( x_data_j, startJ, numberOfJVectors, jDimension );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this
@@ -2867,7 +4392,7 @@ wide_kernel_poly_opencl_retry_label:
 			//if ( -1 == gpuCache.GetQSpace( numberOfJVectors, &y_data ) )
 			//if( -1 == gpuQCache.CheckCache( i, &y_data ) )
 			{
-				y_data = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE, sizeof(double) * (numberOfJVectors + IDEAL_WORK_GROUP_SIZE - remainder), NULL, &errorCode );
+				y_data = devicePool.Acquire( kernelContext, sizeof(cl_real) * (numberOfJVectors + IDEAL_WORK_GROUP_SIZE - remainder), &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error
@@ -2905,10 +4430,10 @@ wide_kernel_poly_opencl_retry_label:
 			errorCode |= clSetKernelArg( customMatrixVectorPolynomialKernel, 1, sizeof(cl_mem), &x_data_i );
 			errorCode |= clSetKernelArg( customMatrixVectorPolynomialKernel, 2, sizeof(cl_mem), &y_data );
 			errorCode |= clSetKernelArg( customMatrixVectorPolynomialKernel, 3, sizeof(int), &jDimension );
-			errorCode |= clSetKernelArg( customMatrixVectorPolynomialKernel, 4, sizeof(double) * IDEAL_WORK_GROUP_SIZE, NULL );
+			errorCode |= clSetKernelArg( customMatrixVectorPolynomialKernel, 4, sizeof(cl_real) * IDEAL_WORK_GROUP_SIZE, NULL );
 			errorCode |= clSetKernelArg( customMatrixVectorPolynomialKernel, 5, sizeof(int), &localSize );
-			errorCode |= clSetKernelArg( customMatrixVectorPolynomialKernel, 6, sizeof(double), &gamma );
-			errorCode |= clSetKernelArg( customMatrixVectorPolynomialKernel, 7, sizeof(double), &coef0 );
+			errorCode |= set_real_arg( customMatrixVectorPolynomialKernel, 6, gamma );
+			errorCode |= set_real_arg( customMatrixVectorPolynomialKernel, 7, coef0 );
 			errorCode |= clSetKernelArg( customMatrixVectorPolynomialKernel, 8, sizeof(int), &degree );
 			if ( CL_SUCCESS != errorCode )
 			{
@@ -2970,6 +4495,7 @@ wide_kernel_poly_opencl_retry_label:
 							//cpuQCache.InvalidateCache();
 							myGpuCache->InvalidateCache();
 							myCpuCache->InvalidateCache();
+							devicePool.Trim();
 							goto wide_kernel_poly_opencl_retry_label;
 						}
 						else
@@ -3002,7 +4528,7 @@ wide_kernel_poly_opencl_skip_work_label:
 		{
 			if ( NULL != output )
 			{
-				errorCode = clEnqueueReadBuffer( kernelCommandQueue, y_data, CL_TRUE, 0, sizeof(double) * numberOfJVectors, output, 0, NULL, NULL );
+				errorCode = read_reals( kernelCommandQueue, y_data, CL_TRUE, 0, numberOfJVectors, output, 0, NULL, NULL );
 				if ( CL_SUCCESS != errorCode )
 				{
 					fprintf( stderr, "ERROR READING OUTPUT DATA: %i, %i, %i\n", i, startJ, endJ );
@@ -3047,7 +4573,7 @@ wide_kernel_poly_opencl_skip_work_label:
 		{
 			//clReleaseMemObject( x_data_i );
 			//clReleaseMemObject( x_data_j );
-			clReleaseMemObject( y_data );
+			devicePool.Release( y_data );
 		}
 		return 0;
 	}
@@ -3063,7 +4589,6 @@ wide_kernel_poly_opencl_skip_work_label:
 		cl_mem tempBuffer;
 		//cl_mem q_i;
 		uint32_t jDimension;
-		uint32_t k;
 		int numberOfJVectors;
 		int qAlreadyComputed;
 		int workDimension;
@@ -3106,14 +4631,14 @@ wide_kernel_sigmoid_opencl_retry_label:
 				{
 					// debugging
 					//fprintf( stdout, "MISSED CACHE ON X[%i]\n", i );
-					x_data_i = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE/*ONLY*/, sizeof(double) * x[i].dim, NULL, &errorCode );
+					x_data_i = devicePool.Acquire( kernelContext, sizeof(svm_feature) * x[i].dim, &errorCode );
 					if ( CL_SUCCESS != errorCode )
 					{
 						// TODO: Deal with this
 						fprintf( stderr, "ERROR CREATING X_DATA_I BUFFER\n" );
 						return -1;
 					}
-					errorCode = clEnqueueWriteBuffer( kernelCommandQueue, x_data_i, CL_FALSE, 0, sizeof(double) * x[i].dim, x[i].values, 0, NULL, NULL );
+					errorCode = metered_write_buffer( kernelCommandQueue, x_data_i, CL_FALSE, 0, sizeof(svm_feature) * x[i].dim, x[i].values, 0, NULL, NULL );
 					if ( CL_SUCCESS != errorCode )
 					{
 						// TODO: Deal with this error
@@ -3130,6 +4655,7 @@ wide_kernel_sigmoid_opencl_retry_label:
 									//cpuQCache.InvalidateCache();
 									myGpuCache->InvalidateCache();
 									myCpuCache->InvalidateCache();
+									devicePool.Trim();
 									goto wide_kernel_sigmoid_opencl_retry_label;
 								}
 								else
@@ -3177,7 +4703,7 @@ wide_kernel_sigmoid_opencl_retry_label:
 				// debugging
 				//fprintf( stdout, "MISSED CACHE ON A\n" );
 				// create the cl_mem buffer (assume all j vectors have same dimensionality)
-				x_data_j = clCreateBuffer( kernelContext, CL_MEM_READ_ONLY, sizeof(double) * numberOfJVectors * jDimension, NULL, &errorCode );
+				x_data_j = devicePool.Acquire( kernelContext, sizeof(svm_feature) * numberOfJVectors * jDimension, &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this
@@ -3185,11 +4711,7 @@ wide_kernel_sigmoid_opencl_retry_label:
 					return -1;
 				}
 				// loop through the j vectors and write them
-				errorCode = 0;
-				for ( k = 0; k < numberOfJVectors; k++ )
-				{
-					errorCode |= clEnqueueWriteBuffer( kernelCommandQueue, x_data_j, CL_FALSE, k * sizeof(double) * jDimension, sizeof(double) * jDimension, x[k + startJ].values, 0, NULL, NULL );
-				}
+				errorCode = write_vector_block( x_data_j, startJ, numberOfJVectors, jDimension );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this
@@ -3219,7 +4741,7 @@ wide_kernel_sigmoid_opencl_retry_label:
 			//if ( -1 == gpuCache.GetQSpace( numberOfJVectors, &y_data ) )
 			//if( -1 == gpuQCache.CheckCache( i, &y_data ) )
 			{
-				y_data = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE, sizeof(double) * (numberOfJVectors + IDEAL_WORK_GROUP_SIZE - remainder), NULL, &errorCode );
+				y_data = devicePool.Acquire( kernelContext, sizeof(cl_real) * (numberOfJVectors + IDEAL_WORK_GROUP_SIZE - remainder), &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error
@@ -3255,10 +4777,10 @@ wide_kernel_sigmoid_opencl_retry_label:
 			errorCode |= clSetKernelArg( customMatrixVectorSigmoidKernel, 1, sizeof(cl_mem), &x_data_i );
 			errorCode |= clSetKernelArg( customMatrixVectorSigmoidKernel, 2, sizeof(cl_mem), &y_data );
 			errorCode |= clSetKernelArg( customMatrixVectorSigmoidKernel, 3, sizeof(int), &jDimension );
-			errorCode |= clSetKernelArg( customMatrixVectorSigmoidKernel, 4, sizeof(double) * IDEAL_WORK_GROUP_SIZE, NULL );
+			errorCode |= clSetKernelArg( customMatrixVectorSigmoidKernel, 4, sizeof(cl_real) * IDEAL_WORK_GROUP_SIZE, NULL );
 			errorCode |= clSetKernelArg( customMatrixVectorSigmoidKernel, 5, sizeof(int), &localSize );
-			errorCode |= clSetKernelArg( customMatrixVectorSigmoidKernel, 6, sizeof(double), &gamma );
-			errorCode |= clSetKernelArg( customMatrixVectorSigmoidKernel, 7, sizeof(double), &coef0 );
+			errorCode |= set_real_arg( customMatrixVectorSigmoidKernel, 6, gamma );
+			errorCode |= set_real_arg( customMatrixVectorSigmoidKernel, 7, coef0 );
 			//errorCode |= clSetKernelArg( customMatrixVectorSigmoidKernel, 8, sizeof(int), &degree );
 			if ( CL_SUCCESS != errorCode )
 			{
@@ -3318,6 +4840,7 @@ wide_kernel_sigmoid_opencl_retry_label:
 							retried = 1;
 							myGpuCache->InvalidateCache();//gpuCache.InvalidateCache();
 							myCpuCache->InvalidateCache();//cpuQCache.InvalidateCache();
+							devicePool.Trim();
 							goto wide_kernel_sigmoid_opencl_retry_label;
 						}
 						else
@@ -3350,7 +4873,7 @@ wide_kernel_sigmoid_opencl_skip_work_label:
 		{
 			if ( NULL != output )
 			{
-				errorCode = clEnqueueReadBuffer( kernelCommandQueue, y_data, CL_TRUE, 0, sizeof(double) * numberOfJVectors, output, 0, NULL, NULL );
+				errorCode = read_reals( kernelCommandQueue, y_data, CL_TRUE, 0, numberOfJVectors, output, 0, NULL, NULL );
 				if ( CL_SUCCESS != errorCode )
 				{
 					fprintf( stderr, "ERROR READING OUTPUT DATA: %i, %i, %i\n", i, startJ, endJ );
@@ -3395,7 +4918,7 @@ wide_kernel_sigmoid_opencl_skip_work_label:
 		{
 			//clReleaseMemObject( x_data_i );
 			//clReleaseMemObject( x_data_j );
-			clReleaseMemObject( y_data );
+			devicePool.Release( y_data );
 		}
 		return 0;
 	}
@@ -3413,7 +4936,6 @@ wide_kernel_sigmoid_opencl_skip_work_label:
 		cl_mem tempBuffer;
 		//cl_mem q_i;
 		uint32_t jDimension;
-		uint32_t k;
 		int numberOfJVectors;
 		int qAlreadyComputed;
 		int workDimension;
@@ -3456,14 +4978,14 @@ wide_kernel_rbf_opencl_retry_label:
 				{
 					// debugging
 					//fprintf( stdout, "MISSED CACHE ON X[%i]\n", i );
-					x_data_i = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE/*ONLY*/, sizeof(double) * x[i].dim, NULL, &errorCode );
+					x_data_i = devicePool.Acquire( kernelContext, sizeof(svm_feature) * x[i].dim, &errorCode );
 					if ( CL_SUCCESS != errorCode )
 					{
 						// TODO: Deal with this
 						fprintf( stderr, "ERROR CREATING X_DATA_I BUFFER\n" );
 						return -1;
 					}
-					errorCode = clEnqueueWriteBuffer( kernelCommandQueue, x_data_i, CL_FALSE, 0, sizeof(double) * x[i].dim, x[i].values, 0, NULL, NULL );
+					errorCode = metered_write_buffer( kernelCommandQueue, x_data_i, CL_FALSE, 0, sizeof(svm_feature) * x[i].dim, x[i].values, 0, NULL, NULL );
 					if ( CL_SUCCESS != errorCode )
 					{
 						// TODO: Deal with this error
@@ -3478,6 +5000,7 @@ wide_kernel_rbf_opencl_retry_label:
 									retried = 1;
 									myGpuCache->InvalidateCache();//gpuCache.InvalidateCache();
 									myCpuCache->InvalidateCache();//cpuQCache.InvalidateCache();
+									devicePool.Trim();
 									goto wide_kernel_rbf_opencl_retry_label;
 								}
 								else
@@ -3525,7 +5048,7 @@ wide_kernel_rbf_opencl_retry_label:
 				// debugging
 				//fprintf( stdout, "MISSED CACHE ON A\n" );
 				// create the cl_mem buffer (assume all j vectors have same dimensionality)
-				x_data_j = clCreateBuffer( kernelContext, CL_MEM_READ_ONLY, sizeof(double) * numberOfJVectors * jDimension, NULL, &errorCode );
+				x_data_j = devicePool.Acquire( kernelContext, sizeof(svm_feature) * numberOfJVectors * jDimension, &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this
@@ -3533,11 +5056,7 @@ wide_kernel_rbf_opencl_retry_label:
 					return -1;
 				}
 				// loop through the j vectors and write them
-				errorCode = 0;
-				for ( k = 0; k < numberOfJVectors; k++ )
-				{
-					errorCode |= clEnqueueWriteBuffer( kernelCommandQueue, x_data_j, CL_FALSE, k * sizeof(double) * jDimension, sizeof(double) * jDimension, x[k + startJ].values, 0, NULL, NULL );
-				}
+				errorCode = write_vector_block( x_data_j, startJ, numberOfJVectors, jDimension );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this
@@ -3550,13 +5069,13 @@ wide_kernel_rbf_opencl_retry_label:
 		}
 		// write the square vector
 		{
-			x_squareGpu = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE, sizeof(double) * numberOfVectors, NULL, &errorCode );
+			x_squareGpu = devicePool.Acquire( kernelContext, sizeof(cl_real) * numberOfVectors, &errorCode );
 			if ( CL_SUCCESS != errorCode )
 			{
 				fprintf( stderr, "ERROR CREATING SPACE FOR X_SQUARE\n" );
 				return -1;
 			}
-			errorCode = clEnqueueWriteBuffer( kernelCommandQueue, x_squareGpu, CL_FALSE, 0, sizeof(double) * numberOfVectors,
+			errorCode = write_reals( kernelCommandQueue, x_squareGpu, CL_FALSE, 0, numberOfVectors,
 												x_square, 0, NULL, NULL );
 			if ( CL_SUCCESS != errorCode )
 			{
@@ -3583,7 +5102,7 @@ wide_kernel_rbf_opencl_retry_label:
 			//if ( -1 == gpuCache.GetQSpace( numberOfJVectors, &y_data ) )
 			//if( -1 == gpuQCache.CheckCache( i, &y_data ) )
 			{
-				y_data = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE, sizeof(double) * (numberOfJVectors + IDEAL_WORK_GROUP_SIZE - remainder), NULL, &errorCode );
+				y_data = devicePool.Acquire( kernelContext, sizeof(cl_real) * (numberOfJVectors + IDEAL_WORK_GROUP_SIZE - remainder), &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error
@@ -3619,10 +5138,10 @@ wide_kernel_rbf_opencl_retry_label:
 			errorCode |= clSetKernelArg( customMatrixVectorRBFKernel, 1, sizeof(cl_mem), &x_data_i );
 			errorCode |= clSetKernelArg( customMatrixVectorRBFKernel, 2, sizeof(cl_mem), &y_data );
 			errorCode |= clSetKernelArg( customMatrixVectorRBFKernel, 3, sizeof(int), &jDimension );
-			errorCode |= clSetKernelArg( customMatrixVectorRBFKernel, 4, sizeof(double) * IDEAL_WORK_GROUP_SIZE, NULL );
+			errorCode |= clSetKernelArg( customMatrixVectorRBFKernel, 4, sizeof(cl_real) * IDEAL_WORK_GROUP_SIZE, NULL );
 			errorCode |= clSetKernelArg( customMatrixVectorRBFKernel, 5, sizeof(int), &localSize );
-			errorCode |= clSetKernelArg( customMatrixVectorRBFKernel, 6, sizeof(double), &gamma );
-			errorCode |= clSetKernelArg( customMatrixVectorRBFKernel, 7, sizeof(double), &coef0 );
+			errorCode |= set_real_arg( customMatrixVectorRBFKernel, 6, gamma );
+			errorCode |= set_real_arg( customMatrixVectorRBFKernel, 7, coef0 );
 			errorCode |= clSetKernelArg( customMatrixVectorRBFKernel, 8, sizeof(cl_mem), &x_squareGpu );
 			errorCode |= clSetKernelArg( customMatrixVectorRBFKernel, 9, sizeof(int), &i );
 			//errorCode |= clSetKernelArg( customMatrixVectorSigmoidKernel, 8, sizeof(int), &degree );
@@ -3684,6 +5203,7 @@ wide_kernel_rbf_opencl_retry_label:
 							retried = 1;
 							myGpuCache->InvalidateCache();//gpuCache.InvalidateCache();
 							myCpuCache->InvalidateCache();//cpuQCache.InvalidateCache();
+							devicePool.Trim();
 							goto wide_kernel_rbf_opencl_retry_label;
 						}
 						else
@@ -3716,7 +5236,7 @@ wide_kernel_rbf_opencl_skip_work_label:
 		{
 			if ( NULL != output )
 			{
-				errorCode = clEnqueueReadBuffer( kernelCommandQueue, y_data, CL_TRUE, 0, sizeof(double) * numberOfJVectors, output, 0, NULL, NULL );
+				errorCode = read_reals( kernelCommandQueue, y_data, CL_TRUE, 0, numberOfJVectors, output, 0, NULL, NULL );
 				if ( CL_SUCCESS != errorCode )
 				{
 					fprintf( stderr, "ERROR READING OUTPUT DATA: %i, %i, %i\n", i, startJ, endJ );
@@ -3761,8 +5281,8 @@ wide_kernel_rbf_opencl_skip_work_label:
 		{
 			//clReleaseMemObject( x_data_i );
 			//clReleaseMemObject( x_data_j );
-			clReleaseMemObject( y_data );
-			clReleaseMemObject( x_squareGpu );
+			devicePool.Release( y_data );
+			devicePool.Release( x_squareGpu );
 		}
 		return 0;
 	}
@@ -3778,22 +5298,21 @@ wide_kernel_rbf_opencl_skip_work_label:
 		cl_mem xDataGpu;
 		cl_mem yDataGpu;
 		cl_mem sumGpu;
-		int k;
 		double * yDataCpu;
 		double sum;
 		
 		// function body
 		// write x data to the GPU
 		{
-			xDataGpu = clCreateBuffer( kernelContext, CL_MEM_READ_ONLY, sizeof(double) * xData->dim, NULL, &errorCode );
+			xDataGpu = devicePool.Acquire( kernelContext, sizeof(svm_feature) * xData->dim, &errorCode );
 			if ( CL_SUCCESS != errorCode )
 			{
 				// TODO: Deal with this error
 				fprintf( stderr, "ERROR CREATING SPACE FOR VECTOR TO BE PREDICTED\n" );
 				exit( -1 );
 			}
-			errorCode = clEnqueueWriteBuffer( kernelCommandQueue, xDataGpu, CL_FALSE, 0, 
-												sizeof(double) * (xData->dim), xData->values,
+			errorCode = metered_write_buffer( kernelCommandQueue, xDataGpu, CL_FALSE, 0, 
+												sizeof(svm_feature) * (xData->dim), xData->values,
 												0, NULL, NULL );
 			if ( CL_SUCCESS != errorCode )
 			{
@@ -3808,21 +5327,14 @@ wide_kernel_rbf_opencl_skip_work_label:
 			{
 				// debugging
 				fprintf( stdout, "WRITING A\n" );
-				A = clCreateBuffer( kernelContext, CL_MEM_READ_ONLY, sizeof(double) * numberOfVectors * x[0].dim,
-									NULL, &errorCode );
+				A = devicePool.Acquire( kernelContext, sizeof(svm_feature) * numberOfVectors * x[0].dim, &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					fprintf( stderr, "ERROR CREATING SPACE FOR A DURING PREDICTION\n" );
 					exit( -1 );
 				}
 				// loop through the j vectors and write them
-				errorCode = 0;
-				for ( k = 0; k < numberOfVectors; k++ )
-				{
-					errorCode |= clEnqueueWriteBuffer( kernelCommandQueue, A, CL_FALSE, 
-														k * sizeof(double) * x[0].dim, 
-														sizeof(double) * x[0].dim, x[k].values, 0, NULL, NULL );
-				}
+				errorCode = write_vector_block( A, 0, numberOfVectors, x[0].dim );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this
@@ -3839,16 +5351,15 @@ wide_kernel_rbf_opencl_skip_work_label:
 			{ 
 				// debugging
 				fprintf( stdout, "WRITING ALPHA\n" );
-				alpha = clCreateBuffer( kernelContext, CL_MEM_READ_ONLY, sizeof(double) * numberOfVectors,
-										NULL, &errorCode );
+				alpha = devicePool.Acquire( kernelContext, sizeof(cl_real) * numberOfVectors, &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error
 					fprintf( stderr, "ERROR CREATING BUFFER TO HOLD SV COEFFICIENTS\n" );
 					exit( -1 );
 				}
-				errorCode = clEnqueueWriteBuffer( kernelCommandQueue, alpha, CL_FALSE, 0,
-													sizeof(double) * numberOfVectors, svmCoefficients,
+				errorCode = write_reals( kernelCommandQueue, alpha, CL_FALSE, 0,
+													numberOfVectors, svmCoefficients,
 													0, NULL, NULL );
 				if ( CL_SUCCESS != errorCode )
 				{
@@ -3861,15 +5372,14 @@ wide_kernel_rbf_opencl_skip_work_label:
 		}
 		// set up intermediate and output data structures
 		{
-			yDataGpu = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE, sizeof(double) * numberOfVectors,
-										NULL, &errorCode );
+			yDataGpu = devicePool.Acquire( kernelContext, sizeof(cl_real) * numberOfVectors, &errorCode );
 			if ( CL_SUCCESS != errorCode )
 			{
 				// TODO: Deal with this error
 				fprintf( stderr, "ERROR CREATING SPACE FOR Y VECTOR DURING PREDICTION\n" );
 				exit( -1 );
 			}
-			sumGpu = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE, sizeof(double), NULL, &errorCode );
+			sumGpu = devicePool.Acquire( kernelContext, sizeof(cl_real), &errorCode );
 			if ( CL_SUCCESS != errorCode )
 			{
 				// TODO: Deal with this error
@@ -3913,7 +5423,7 @@ wide_kernel_rbf_opencl_skip_work_label:
 		}
 		// read back output
 		{
-			errorCode = clEnqueueReadBuffer( kernelCommandQueue, sumGpu, CL_TRUE, 0, sizeof(double),
+			errorCode = read_reals( kernelCommandQueue, sumGpu, CL_TRUE, 0, 1,
 											 &sum, 0, NULL, NULL );
 			if ( CL_SUCCESS != errorCode )
 			{
@@ -3925,9 +5435,9 @@ wide_kernel_rbf_opencl_skip_work_label:
 		
 		// clean up
 		{
-			clReleaseMemObject( xDataGpu );
-			clReleaseMemObject( yDataGpu );
-			clReleaseMemObject( sumGpu );
+			devicePool.Release( xDataGpu );
+			devicePool.Release( yDataGpu );
+			devicePool.Release( sumGpu );
 			//clReleaseMemObject( alpha );
 		}
 		return sum;
@@ -3958,7 +5468,7 @@ wide_kernel_rbf_opencl_skip_work_label:
 			errorCode |= clSetKernelArg( customMatrixVectorKernel, 1, sizeof(cl_mem), &xData );
 			errorCode |= clSetKernelArg( customMatrixVectorKernel, 2, sizeof(cl_mem), &yData );
 			errorCode |= clSetKernelArg( customMatrixVectorKernel, 3, sizeof(int), &(x[0].dim) );
-			errorCode |= clSetKernelArg( customMatrixVectorKernel, 4, sizeof(double) * IDEAL_WORK_GROUP_SIZE, NULL );
+			errorCode |= clSetKernelArg( customMatrixVectorKernel, 4, sizeof(cl_real) * IDEAL_WORK_GROUP_SIZE, NULL );
 			errorCode |= clSetKernelArg( customMatrixVectorKernel, 5, sizeof(int), &(localWorkSize[1]) );
 			if ( CL_SUCCESS != errorCode )
 			{
@@ -4038,22 +5548,21 @@ wide_kernel_rbf_opencl_skip_work_label:
 		cl_mem xDataGpu;
 		cl_mem yDataGpu;
 		cl_mem sumGpu;
-		int k;
 		double * yDataCpu;
 		double sum;
 		
 		// function body
 		// write x data to the GPU
 		{
-			xDataGpu = clCreateBuffer( kernelContext, CL_MEM_READ_ONLY, sizeof(double) * xData->dim, NULL, &errorCode );
+			xDataGpu = devicePool.Acquire( kernelContext, sizeof(svm_feature) * xData->dim, &errorCode );
 			if ( CL_SUCCESS != errorCode )
 			{
 				// TODO: Deal with this error
 				fprintf( stderr, "ERROR CREATING SPACE FOR VECTOR TO BE PREDICTED\n" );
 				exit( -1 );
 			}
-			errorCode = clEnqueueWriteBuffer( kernelCommandQueue, xDataGpu, CL_FALSE, 0, 
-												sizeof(double) * (xData->dim), xData->values,
+			errorCode = metered_write_buffer( kernelCommandQueue, xDataGpu, CL_FALSE, 0, 
+												sizeof(svm_feature) * (xData->dim), xData->values,
 												0, NULL, NULL );
 			if ( CL_SUCCESS != errorCode )
 			{
@@ -4066,21 +5575,14 @@ wide_kernel_rbf_opencl_skip_work_label:
 		{
 			if ( 0 != gpuCache.CheckCache( 0, numberOfVectors-1, &A ) )
 			{
-				A = clCreateBuffer( kernelContext, CL_MEM_READ_ONLY, sizeof(double) * numberOfVectors * x[0].dim,
-									NULL, &errorCode );
+				A = devicePool.Acquire( kernelContext, sizeof(svm_feature) * numberOfVectors * x[0].dim, &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					fprintf( stderr, "ERROR CREATING SPACE FOR A DURING PREDICTION\n" );
 					exit( -1 );
 				}
 				// loop through the j vectors and write them
-				errorCode = 0;
-				for ( k = 0; k < numberOfVectors; k++ )
-				{
-					errorCode |= clEnqueueWriteBuffer( kernelCommandQueue, A, CL_FALSE, 
-														k * sizeof(double) * x[0].dim, 
-														sizeof(double) * x[0].dim, x[k].values, 0, NULL, NULL );
-				}
+				errorCode = write_vector_block( A, 0, numberOfVectors, x[0].dim );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this
@@ -4095,16 +5597,15 @@ wide_kernel_rbf_opencl_skip_work_label:
 			// we're gonna cheat, using the knowledge that individual x values don't get cached during classification
 			if ( 0 != gpuCache.CheckCache( 0, &alpha ) )
 			{
-				alpha = clCreateBuffer( kernelContext, CL_MEM_READ_ONLY, sizeof(double) * numberOfVectors,
-										NULL, &errorCode );
+				alpha = devicePool.Acquire( kernelContext, sizeof(cl_real) * numberOfVectors, &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error
 					fprintf( stderr, "ERROR CREATING BUFFER TO HOLD SV COEFFICIENTS\n" );
 					exit( -1 );
 				}
-				errorCode = clEnqueueWriteBuffer( kernelCommandQueue, alpha, CL_FALSE, 0,
-													sizeof(double) * numberOfVectors, svmCoefficients,
+				errorCode = write_reals( kernelCommandQueue, alpha, CL_FALSE, 0,
+													numberOfVectors, svmCoefficients,
 													0, NULL, NULL );
 				if ( CL_SUCCESS != errorCode )
 				{
@@ -4117,15 +5618,14 @@ wide_kernel_rbf_opencl_skip_work_label:
 		}
 		// set up intermediate and output data structures
 		{
-			yDataGpu = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE, sizeof(double) * numberOfVectors,
-										NULL, &errorCode );
+			yDataGpu = devicePool.Acquire( kernelContext, sizeof(cl_real) * numberOfVectors, &errorCode );
 			if ( CL_SUCCESS != errorCode )
 			{
 				// TODO: Deal with this error
 				fprintf( stderr, "ERROR CREATING SPACE FOR Y VECTOR DURING PREDICTION\n" );
 				exit( -1 );
 			}
-			sumGpu = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE, sizeof(double), NULL, &errorCode );
+			sumGpu = devicePool.Acquire( kernelContext, sizeof(cl_real), &errorCode );
 			if ( CL_SUCCESS != errorCode )
 			{
 				// TODO: Deal with this error
@@ -4169,7 +5669,7 @@ wide_kernel_rbf_opencl_skip_work_label:
 		}
 		// read back output
 		{
-			errorCode = clEnqueueReadBuffer( kernelCommandQueue, sumGpu, CL_TRUE, 0, sizeof(double),
+			errorCode = read_reals( kernelCommandQueue, sumGpu, CL_TRUE, 0, 1,
 											 &sum, 0, NULL, NULL );
 			if ( CL_SUCCESS != errorCode )
 			{
@@ -4181,9 +5681,9 @@ wide_kernel_rbf_opencl_skip_work_label:
 		
 		// clean up
 		{
-			clReleaseMemObject( xDataGpu );
-			clReleaseMemObject( sumGpu );
-			clReleaseMemObject( yDataGpu );
+			devicePool.Release( xDataGpu );
+			devicePool.Release( sumGpu );
+			devicePool.Release( yDataGpu );
 			//clReleaseMemObject( alpha );
 		}
 		return sum;
@@ -4214,10 +5714,10 @@ wide_kernel_rbf_opencl_skip_work_label:
 			errorCode |= clSetKernelArg( customMatrixVectorPolynomialKernel, 1, sizeof(cl_mem), &xData );
 			errorCode |= clSetKernelArg( customMatrixVectorPolynomialKernel, 2, sizeof(cl_mem), &yData );
 			errorCode |= clSetKernelArg( customMatrixVectorPolynomialKernel, 3, sizeof(int), &(x[0].dim) );
-			errorCode |= clSetKernelArg( customMatrixVectorPolynomialKernel, 4, sizeof(double) * IDEAL_WORK_GROUP_SIZE, NULL );
+			errorCode |= clSetKernelArg( customMatrixVectorPolynomialKernel, 4, sizeof(cl_real) * IDEAL_WORK_GROUP_SIZE, NULL );
 			errorCode |= clSetKernelArg( customMatrixVectorPolynomialKernel, 5, sizeof(int), &(localWorkSize[1]) );
-			errorCode |= clSetKernelArg( customMatrixVectorPolynomialKernel, 6, sizeof(double), &gamma );
-			errorCode |= clSetKernelArg( customMatrixVectorPolynomialKernel, 7, sizeof(double), &coef0 );
+			errorCode |= set_real_arg( customMatrixVectorPolynomialKernel, 6, gamma );
+			errorCode |= set_real_arg( customMatrixVectorPolynomialKernel, 7, coef0 );
 			errorCode |= clSetKernelArg( customMatrixVectorPolynomialKernel, 8, sizeof(int), &degree );
 			if ( CL_SUCCESS != errorCode )
 			{
@@ -4252,22 +5752,21 @@ wide_kernel_rbf_opencl_skip_work_label:
 		cl_mem xDataGpu;
 		cl_mem yDataGpu;
 		cl_mem sumGpu;
-		int k;
 		double * yDataCpu;
 		double sum;
 		
 		// function body
 		// write x data to the GPU
 		{
-			xDataGpu = clCreateBuffer( kernelContext, CL_MEM_READ_ONLY, sizeof(double) * xData->dim, NULL, &errorCode );
+			xDataGpu = devicePool.Acquire( kernelContext, sizeof(svm_feature) * xData->dim, &errorCode );
 			if ( CL_SUCCESS != errorCode )
 			{
 				// TODO: Deal with this error
 				fprintf( stderr, "ERROR CREATING SPACE FOR VECTOR TO BE PREDICTED\n" );
 				exit( -1 );
 			}
-			errorCode = clEnqueueWriteBuffer( kernelCommandQueue, xDataGpu, CL_FALSE, 0, 
-												sizeof(double) * (xData->dim), xData->values,
+			errorCode = metered_write_buffer( kernelCommandQueue, xDataGpu, CL_FALSE, 0, 
+												sizeof(svm_feature) * (xData->dim), xData->values,
 												0, NULL, NULL );
 			if ( CL_SUCCESS != errorCode )
 			{
@@ -4280,21 +5779,14 @@ wide_kernel_rbf_opencl_skip_work_label:
 		{
 			if ( 0 != gpuCache.CheckCache( 0, numberOfVectors-1, &A ) )
 			{
-				A = clCreateBuffer( kernelContext, CL_MEM_READ_ONLY, sizeof(double) * numberOfVectors * x[0].dim,
-									NULL, &errorCode );
+				A = devicePool.Acquire( kernelContext, sizeof(svm_feature) * numberOfVectors * x[0].dim, &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					fprintf( stderr, "ERROR CREATING SPACE FOR A DURING PREDICTION\n" );
 					exit( -1 );
 				}
 				// loop through the j vectors and write them
-				errorCode = 0;
-				for ( k = 0; k < numberOfVectors; k++ )
-				{
-					errorCode |= clEnqueueWriteBuffer( kernelCommandQueue, A, CL_FALSE, 
-														k * sizeof(double) * x[0].dim, 
-														sizeof(double) * x[0].dim, x[k].values, 0, NULL, NULL );
-				}
+				errorCode = write_vector_block( A, 0, numberOfVectors, x[0].dim );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this
@@ -4309,16 +5801,15 @@ wide_kernel_rbf_opencl_skip_work_label:
 			// we're gonna cheat, using the knowledge that individual x values don't get cached during classification
 			if ( 0 != gpuCache.CheckCache( 0, &alpha ) )
 			{
-				alpha = clCreateBuffer( kernelContext, CL_MEM_READ_ONLY, sizeof(double) * numberOfVectors,
-										NULL, &errorCode );
+				alpha = devicePool.Acquire( kernelContext, sizeof(cl_real) * numberOfVectors, &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error
 					fprintf( stderr, "ERROR CREATING BUFFER TO HOLD SV COEFFICIENTS\n" );
 					exit( -1 );
 				}
-				errorCode = clEnqueueWriteBuffer( kernelCommandQueue, alpha, CL_FALSE, 0,
-													sizeof(double) * numberOfVectors, svmCoefficients,
+				errorCode = write_reals( kernelCommandQueue, alpha, CL_FALSE, 0,
+													numberOfVectors, svmCoefficients,
 													0, NULL, NULL );
 				if ( CL_SUCCESS != errorCode )
 				{
@@ -4331,15 +5822,14 @@ wide_kernel_rbf_opencl_skip_work_label:
 		}
 		// set up intermediate and output data structures
 		{
-			yDataGpu = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE, sizeof(double) * numberOfVectors,
-										NULL, &errorCode );
+			yDataGpu = devicePool.Acquire( kernelContext, sizeof(cl_real) * numberOfVectors, &errorCode );
 			if ( CL_SUCCESS != errorCode )
 			{
 				// TODO: Deal with this error
 				fprintf( stderr, "ERROR CREATING SPACE FOR Y VECTOR DURING PREDICTION\n" );
 				exit( -1 );
 			}
-			sumGpu = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE, sizeof(double), NULL, &errorCode );
+			sumGpu = devicePool.Acquire( kernelContext, sizeof(cl_real), &errorCode );
 			if ( CL_SUCCESS != errorCode )
 			{
 				// TODO: Deal with this error
@@ -4383,7 +5873,7 @@ wide_kernel_rbf_opencl_skip_work_label:
 		}
 		// read back output
 		{
-			errorCode = clEnqueueReadBuffer( kernelCommandQueue, sumGpu, CL_TRUE, 0, sizeof(double),
+			errorCode = read_reals( kernelCommandQueue, sumGpu, CL_TRUE, 0, 1,
 											 &sum, 0, NULL, NULL );
 			if ( CL_SUCCESS != errorCode )
 			{
@@ -4395,9 +5885,9 @@ wide_kernel_rbf_opencl_skip_work_label:
 		
 		// clean up
 		{
-			clReleaseMemObject( xDataGpu );
-			clReleaseMemObject( sumGpu );
-			clReleaseMemObject( yDataGpu );
+			devicePool.Release( xDataGpu );
+			devicePool.Release( sumGpu );
+			devicePool.Release( yDataGpu );
 			//clReleaseMemObject( alpha );
 		}
 		return sum;
@@ -4428,10 +5918,10 @@ wide_kernel_rbf_opencl_skip_work_label:
 			errorCode |= clSetKernelArg( customMatrixVectorSigmoidKernel, 1, sizeof(cl_mem), &xData );
 			errorCode |= clSetKernelArg( customMatrixVectorSigmoidKernel, 2, sizeof(cl_mem), &yData );
 			errorCode |= clSetKernelArg( customMatrixVectorSigmoidKernel, 3, sizeof(int), &(x[0].dim) );
-			errorCode |= clSetKernelArg( customMatrixVectorSigmoidKernel, 4, sizeof(double) * IDEAL_WORK_GROUP_SIZE, NULL );
+			errorCode |= clSetKernelArg( customMatrixVectorSigmoidKernel, 4, sizeof(cl_real) * IDEAL_WORK_GROUP_SIZE, NULL );
 			errorCode |= clSetKernelArg( customMatrixVectorSigmoidKernel, 5, sizeof(int), &(localWorkSize[1]) );
-			errorCode |= clSetKernelArg( customMatrixVectorSigmoidKernel, 6, sizeof(double), &gamma );
-			errorCode |= clSetKernelArg( customMatrixVectorSigmoidKernel, 7, sizeof(double), &coef0 );
+			errorCode |= set_real_arg( customMatrixVectorSigmoidKernel, 6, gamma );
+			errorCode |= set_real_arg( customMatrixVectorSigmoidKernel, 7, coef0 );
 			if ( CL_SUCCESS != errorCode )
 			{
 				// TODO: Deal with this error
@@ -4465,22 +5955,21 @@ wide_kernel_rbf_opencl_skip_work_label:
 		cl_mem xDataGpu;
 		cl_mem yDataGpu;
 		cl_mem sumGpu;
-		int k;
 		double * yDataCpu;
 		double sum;
 		
 		// function body
 		// write x data to the GPU
 		{
-			xDataGpu = clCreateBuffer( kernelContext, CL_MEM_READ_ONLY, sizeof(double) * xData->dim, NULL, &errorCode );
+			xDataGpu = devicePool.Acquire( kernelContext, sizeof(svm_feature) * xData->dim, &errorCode );
 			if ( CL_SUCCESS != errorCode )
 			{
 				// TODO: Deal with this error
 				fprintf( stderr, "ERROR CREATING SPACE FOR VECTOR TO BE PREDICTED\n" );
 				exit( -1 );
 			}
-			errorCode = clEnqueueWriteBuffer( kernelCommandQueue, xDataGpu, CL_FALSE, 0, 
-												sizeof(double) * (xData->dim), xData->values,
+			errorCode = metered_write_buffer( kernelCommandQueue, xDataGpu, CL_FALSE, 0, 
+												sizeof(svm_feature) * (xData->dim), xData->values,
 												0, NULL, NULL );
 			if ( CL_SUCCESS != errorCode )
 			{
@@ -4493,21 +5982,14 @@ wide_kernel_rbf_opencl_skip_work_label:
 		{
 			if ( 0 != gpuCache.CheckCache( 0, numberOfVectors-1, &A ) )
 			{
-				A = clCreateBuffer( kernelContext, CL_MEM_READ_ONLY, sizeof(double) * numberOfVectors * x[0].dim,
-									NULL, &errorCode );
+				A = devicePool.Acquire( kernelContext, sizeof(svm_feature) * numberOfVectors * x[0].dim, &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					fprintf( stderr, "ERROR CREATING SPACE FOR A DURING PREDICTION\n" );
 					exit( -1 );
 				}
 				// loop through the j vectors and write them
-				errorCode = 0;
-				for ( k = 0; k < numberOfVectors; k++ )
-				{
-					errorCode |= clEnqueueWriteBuffer( kernelCommandQueue, A, CL_FALSE, 
-														k * sizeof(double) * x[0].dim, 
-														sizeof(double) * x[0].dim, x[k].values, 0, NULL, NULL );
-				}
+				errorCode = write_vector_block( A, 0, numberOfVectors, x[0].dim );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this
@@ -4522,16 +6004,15 @@ wide_kernel_rbf_opencl_skip_work_label:
 			// we're gonna cheat, using the knowledge that individual x values don't get cached during classification
 			if ( 0 != gpuCache.CheckCache( 0, &alpha ) )
 			{
-				alpha = clCreateBuffer( kernelContext, CL_MEM_READ_ONLY, sizeof(double) * numberOfVectors,
-										NULL, &errorCode );
+				alpha = devicePool.Acquire( kernelContext, sizeof(cl_real) * numberOfVectors, &errorCode );
 				if ( CL_SUCCESS != errorCode )
 				{
 					// TODO: Deal with this error
 					fprintf( stderr, "ERROR CREATING BUFFER TO HOLD SV COEFFICIENTS\n" );
 					exit( -1 );
 				}
-				errorCode = clEnqueueWriteBuffer( kernelCommandQueue, alpha, CL_FALSE, 0,
-													sizeof(double) * numberOfVectors, svmCoefficients,
+				errorCode = write_reals( kernelCommandQueue, alpha, CL_FALSE, 0,
+													numberOfVectors, svmCoefficients,
 													0, NULL, NULL );
 				if ( CL_SUCCESS != errorCode )
 				{
@@ -4544,15 +6025,14 @@ wide_kernel_rbf_opencl_skip_work_label:
 		}
 		// set up intermediate and output data structures
 		{
-			yDataGpu = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE, sizeof(double) * numberOfVectors,
-										NULL, &errorCode );
+			yDataGpu = devicePool.Acquire( kernelContext, sizeof(cl_real) * numberOfVectors, &errorCode );
 			if ( CL_SUCCESS != errorCode )
 			{
 				// TODO: Deal with this error
 				fprintf( stderr, "ERROR CREATING SPACE FOR Y VECTOR DURING PREDICTION\n" );
 				exit( -1 );
 			}
-			sumGpu = clCreateBuffer( kernelContext, CL_MEM_READ_WRITE, sizeof(double), NULL, &errorCode );
+			sumGpu = devicePool.Acquire( kernelContext, sizeof(cl_real), &errorCode );
 			if ( CL_SUCCESS != errorCode )
 			{
 				// TODO: Deal with this error
@@ -4596,7 +6076,7 @@ wide_kernel_rbf_opencl_skip_work_label:
 		}
 		// read back output
 		{
-			errorCode = clEnqueueReadBuffer( kernelCommandQueue, sumGpu, CL_TRUE, 0, sizeof(double),
+			errorCode = read_reals( kernelCommandQueue, sumGpu, CL_TRUE, 0, 1,
 											 &sum, 0, NULL, NULL );
 			if ( CL_SUCCESS != errorCode )
 			{
@@ -4608,9 +6088,9 @@ wide_kernel_rbf_opencl_skip_work_label:
 		
 		// clean up
 		{
-			clReleaseMemObject( xDataGpu );
-			clReleaseMemObject( sumGpu );
-			clReleaseMemObject( yDataGpu );
+			devicePool.Release( xDataGpu );
+			devicePool.Release( sumGpu );
+			devicePool.Release( yDataGpu );
 			//clReleaseMemObject( alpha );
 		}
 		return sum;
@@ -4655,13 +6135,13 @@ wide_kernel_rbf_opencl_skip_work_label:
 			// set up the last one
 			tempXSquare[ numberOfVectors ] = dot( xDataCpu, xDataCpu );
 			// write it to the GPU
-			xSquareGpu = clCreateBuffer( kernelContext, CL_MEM_READ_ONLY, sizeof(double) * (numberOfVectors + 1), NULL, &errorCode );
+			xSquareGpu = devicePool.Acquire( kernelContext, sizeof(cl_real) * (numberOfVectors + 1), &errorCode );
 			if ( CL_SUCCESS != errorCode )
 			{
 				fprintf( stderr, "ERROR CREATING XSQUARE GPU VALUE\n" );
 				return -1;
 			}
-			errorCode = clEnqueueWriteBuffer( kernelCommandQueue, xSquareGpu, CL_TRUE, 0, sizeof(double) * (numberOfVectors + 1), tempXSquare, 0, NULL, NULL );
+			errorCode = write_reals( kernelCommandQueue, xSquareGpu, CL_TRUE, 0, (numberOfVectors + 1), tempXSquare, 0, NULL, NULL );
 			if ( CL_SUCCESS != errorCode )
 			{
 				fprintf( stderr, "ERROR WRITING XSQUARE DATA TO GPU\n" );
@@ -4675,10 +6155,10 @@ wide_kernel_rbf_opencl_skip_work_label:
 			errorCode |= clSetKernelArg( customMatrixVectorRBFKernel, 1, sizeof(cl_mem), &xData );
 			errorCode |= clSetKernelArg( customMatrixVectorRBFKernel, 2, sizeof(cl_mem), &yData );
 			errorCode |= clSetKernelArg( customMatrixVectorRBFKernel, 3, sizeof(int), &(x[0].dim) );
-			errorCode |= clSetKernelArg( customMatrixVectorRBFKernel, 4, sizeof(double) * IDEAL_WORK_GROUP_SIZE, NULL );
+			errorCode |= clSetKernelArg( customMatrixVectorRBFKernel, 4, sizeof(cl_real) * IDEAL_WORK_GROUP_SIZE, NULL );
 			errorCode |= clSetKernelArg( customMatrixVectorRBFKernel, 5, sizeof(int), &(localWorkSize[1]) );
-			errorCode |= clSetKernelArg( customMatrixVectorRBFKernel, 6, sizeof(double), &gamma );
-			errorCode |= clSetKernelArg( customMatrixVectorRBFKernel, 7, sizeof(double), &coef0 );
+			errorCode |= set_real_arg( customMatrixVectorRBFKernel, 6, gamma );
+			errorCode |= set_real_arg( customMatrixVectorRBFKernel, 7, coef0 );
 			errorCode |= clSetKernelArg( customMatrixVectorRBFKernel, 8, sizeof(cl_mem), &xSquareGpu );
 			errorCode |= clSetKernelArg( customMatrixVectorRBFKernel, 9, sizeof(int), &numberOfVectors );
 			if ( CL_SUCCESS != errorCode )
@@ -4701,6 +6181,8 @@ wide_kernel_rbf_opencl_skip_work_label:
 		}
 		
 		// clean up
+		// in-order queue: the next user of the buffer waits for this kernel
+		devicePool.Release( xSquareGpu );
 		return 0;
 	}
 
@@ -4724,7 +6206,7 @@ wide_kernel_rbf_opencl_skip_work_label:
 			// call will be of the form: kernel( y, alpha, __local scratch, sum, cols, workGroupSize )
 			errorCode = clSetKernelArg( predictionReductionKernel, 0, sizeof(cl_mem), &y );
 			errorCode |= clSetKernelArg( predictionReductionKernel, 1, sizeof(cl_mem), &alpha );
-			errorCode |= clSetKernelArg( predictionReductionKernel, 2, sizeof(double) * IDEAL_WORK_GROUP_SIZE, NULL );
+			errorCode |= clSetKernelArg( predictionReductionKernel, 2, sizeof(cl_real) * IDEAL_WORK_GROUP_SIZE, NULL );
 			errorCode |= clSetKernelArg( predictionReductionKernel, 3, sizeof(cl_mem), &sum );
 			errorCode |= clSetKernelArg( predictionReductionKernel, 4, sizeof(int), &numberOfVectors );
 			errorCode |= clSetKernelArg( predictionReductionKernel, 5, sizeof(int), &(localWorkSize[0]) );
@@ -4754,21 +6236,24 @@ wide_kernel_rbf_opencl_skip_work_label:
 	
 };
 
-#define	GPU_CACHE_SIZE	6000
-#define	GPU_Q_CACHE_SIZE	6000
-#define	CPU_Q_CACHE_SIZE	6000
+// the buffer caches get a slot per vector and are limited in bytes instead,
+// by svm_set_gpu_cache_size or by default to a sixth of device memory each
+#define	GPU_CACHE_MEMORY_SHARE	6
 
-#ifdef _DENSE_REP
-Kernel::Kernel(int l, svm_node * x_, const svm_parameter& param)
+static double gpu_cache_size = 0;	// MB per cache, 0 for the device default
+
+// build options for every program; FEATURE_TYPE only types the feature and Q
+// buffers, so the objective function kernels still need cl_khr_fp64
+#ifdef SVM_FLOAT_FEATURES
+	#define	FEATURE_BUILD_OPTIONS	"-D FEATURE_TYPE=float"
 #else
-Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
+	#define	FEATURE_BUILD_OPTIONS	NULL
 #endif
-:kernel_type(param.kernel_type), degree(param.degree),
- gamma(param.gamma), coef0(param.coef0), gpuCache( l, GPU_CACHE_SIZE ), gpuQCache( l,GPU_Q_CACHE_SIZE ),
- cpuQCache( l, CPU_Q_CACHE_SIZE )
-{
-
 
+// contexts, queues, programs and the BLAS library, for the OpenCL kernel
+// types and for a gradient kept (or checked) on the device
+void Kernel::initialize_device( int l )
+{
 	#ifdef	CL_SVM
 	
 	linearKernelKernelSource = 
@@ -4811,20 +6296,6 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 	#include "predictionReductionKernelSource.cl"
 	;
 	
-		// profiling, TEMPORARY
-		otherFunctionTime = 0;
-		gettingQTime = 0;
-		gettingGTime = 0;
-		daxpyTime = 0;
-		swappingTime = 0;
-		swappingCount = 0;
-		qRetrievingTime = 0;
-		swappingOtherFunctionTime = 0;
-		qCacheSwappingTime = 0;
-		endQueueTime = 0;
-		kernelEnqueuingTime = 0;
-		argSettingTime = 0;
-	
 	#define CL_PLATFORM_COUNT	10
 		// variables
 		cl_device_id firstDevice;
@@ -4990,6 +6461,32 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 		cpuDevice = firstDevice;
 		//*/
 		
+		// byte budgets for the buffer caches
+		{
+			cl_ulong globalMemorySize;
+			size_t cacheBudget;
+			
+			cacheBudget = 0;
+			if ( gpu_cache_size > 0 )
+			{
+				cacheBudget = (size_t)( gpu_cache_size * (1<<20) );
+			}
+			else if ( CL_SUCCESS == clGetDeviceInfo( firstDevice, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(cl_ulong), &globalMemorySize, NULL ) )
+			{
+				cacheBudget = (size_t)( globalMemorySize / GPU_CACHE_MEMORY_SHARE );
+			}
+			gpuCache.SetByteBudget( cacheBudget );
+			gpuQCache.SetByteBudget( cacheBudget );
+			cpuQCache.SetByteBudget( cacheBudget );
+		}
+		// pooled device memory
+		{
+			devicePool.Initialize( kernelContext, firstDevice );
+			gpuCache.SetPool( &devicePool );
+			gpuQCache.SetPool( &devicePool );
+			cpuQCache.SetPool( &devicePool );
+		}
+		
 		// start whipping up kernels
 
 		linearKernelKernelProgram = clCreateProgramWithSource( kernelContext,
@@ -5005,7 +6502,7 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 			fprintf( stderr, "Error creating program\n" );
 			exit( -1 );
 		}
-		errorCode = clBuildProgram( linearKernelKernelProgram, 0, NULL, NULL,
+		errorCode = clBuildProgram( linearKernelKernelProgram, 0, NULL, FEATURE_BUILD_OPTIONS,
 					NULL, NULL );
 		if ( 0 != errorCode )
 		{
@@ -5044,7 +6541,7 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 			fprintf( stderr, "Error creating custom daxpy program\n" );
 			exit( -1 );
 		}
-		errorCode = clBuildProgram( customDaxpyKernelProgram, 0, NULL, NULL,
+		errorCode = clBuildProgram( customDaxpyKernelProgram, 0, NULL, FEATURE_BUILD_OPTIONS,
 					NULL, NULL );
 		if ( 0 != errorCode )
 		{
@@ -5082,7 +6579,7 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 			fprintf( stderr, "ERROR CREATING OBJECTIVE FUNCTION SWAPPING KERNEL PROGRAM\n" );
 			exit( -1 );
 		}
-		errorCode = clBuildProgram( swapObjectiveFunctionKernelProgram, 0, NULL, NULL, NULL, NULL );
+		errorCode = clBuildProgram( swapObjectiveFunctionKernelProgram, 0, NULL, FEATURE_BUILD_OPTIONS, NULL, NULL );
 		if ( CL_SUCCESS != errorCode )
 		{
 			fprintf( stderr, "ERROR BUILDING OBJECTIVE FUNCTION SWAPPING PROGRAM\n" );
@@ -5095,6 +6592,13 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 			fprintf( stderr, "ERROR CREATING KERNEL FOR OBJECTIVE FUNCTION SWAPPING PROGRAM\n" );
 			exit( -1 );
 		}
+		swapQKernel = clCreateKernel( swapObjectiveFunctionKernelProgram, "swap_q_kernel", &errorCode );
+		if ( CL_SUCCESS != errorCode )
+		{
+			// TODO: Deal with this error
+			fprintf( stderr, "ERROR CREATING KERNEL FOR Q SWAPPING\n" );
+			exit( -1 );
+		}
 
 		findCandidateIValuesKernelProgram = clCreateProgramWithSource( kernelContext,
 																		1,
@@ -5107,7 +6611,7 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 			fprintf( stderr, "ERROR CREATING I CANDIDATE SEARCHING KERNEL PROGRAM\n" );
 			exit( -1 );
 		}
-		errorCode = clBuildProgram( findCandidateIValuesKernelProgram, 0, NULL, NULL, NULL, NULL );
+		errorCode = clBuildProgram( findCandidateIValuesKernelProgram, 0, NULL, FEATURE_BUILD_OPTIONS, NULL, NULL );
 		if ( CL_SUCCESS != errorCode )
 		{
 			fprintf( stderr, "ERROR BUILDING I CANDIDATE SEARCHING PROGRAM\n" );
@@ -5142,7 +6646,7 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 			fprintf( stderr, "ERROR CREATING J CANDIDATE SEARCHING KERNEL PROGRAM\n" );
 			exit( -1 );
 		}
-		errorCode = clBuildProgram( findCandidateJValuesKernelProgram, 0, NULL, NULL, NULL, NULL );
+		errorCode = clBuildProgram( findCandidateJValuesKernelProgram, 0, NULL, FEATURE_BUILD_OPTIONS, NULL, NULL );
 		if ( CL_SUCCESS != errorCode )
 		{
 			fprintf( stderr, "ERROR BUILDING J CANDIDATE SEARCHING PROGRAM\n" );
@@ -5173,7 +6677,7 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 			fprintf( stderr, "ERROR: FAILED TO CREATE DUAL DAXPY KERNEL PROGRAM\n" );
 			exit( -1 );
 		}
-		errorCode = clBuildProgram( dualDaxpyKernelProgram, 0, NULL, NULL, NULL, NULL );
+		errorCode = clBuildProgram( dualDaxpyKernelProgram, 0, NULL, FEATURE_BUILD_OPTIONS, NULL, NULL );
 		if ( CL_SUCCESS != errorCode )
 		{
 			// TODO: Deal with this error
@@ -5204,7 +6708,7 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 			fprintf( stderr, "ERROR CREATING MATRIX VECTOR MULTIPLY PROGRAM\n" );
 			exit( -1 );
 		}
-		errorCode = clBuildProgram( customMatrixVectorKernelProgram, 0, NULL, NULL, NULL, NULL );
+		errorCode = clBuildProgram( customMatrixVectorKernelProgram, 0, NULL, FEATURE_BUILD_OPTIONS, NULL, NULL );
 		if ( CL_SUCCESS != errorCode )
 		{
 			fprintf( stderr, "ERROR BUILDING MATRIX VECTOR MULTIPLY KERNEL\n" );
@@ -5234,7 +6738,7 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 			fprintf( stderr, "ERROR CREATING POLYNOMIAL KERNEL PROGRAM\n" );
 			exit( -1 );
 		}
-		errorCode = clBuildProgram( customMatrixVectorPolynomialKernelProgram, 0, NULL, NULL, NULL, NULL );
+		errorCode = clBuildProgram( customMatrixVectorPolynomialKernelProgram, 0, NULL, FEATURE_BUILD_OPTIONS, NULL, NULL );
 		if ( CL_SUCCESS != errorCode )
 		{
 			fprintf( stderr, "ERROR BUILDING POLYNOMIAL MATRIX VECTOR MULTIPLY KERNEL\n" );
@@ -5265,7 +6769,7 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 			fprintf( stderr, "ERROR CREATING SIGMOID KERNEL PROGRAM\n" );
 			exit( -1 );
 		}
-		errorCode = clBuildProgram( customMatrixVectorSigmoidKernelProgram, 0, NULL, NULL, NULL, NULL );
+		errorCode = clBuildProgram( customMatrixVectorSigmoidKernelProgram, 0, NULL, FEATURE_BUILD_OPTIONS, NULL, NULL );
 		if ( CL_SUCCESS != errorCode )
 		{
 			fprintf( stderr, "ERROR BUILDING SIGMOID MATRIX VECTOR MULTIPLY KERNEL\n" );
@@ -5296,7 +6800,7 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 			fprintf( stderr, "ERROR CREATING SIGMOID KERNEL PROGRAM\n" );
 			exit( -1 );
 		}
-		errorCode = clBuildProgram( customMatrixVectorRBFKernelProgram, 0, NULL, NULL, NULL, NULL );
+		errorCode = clBuildProgram( customMatrixVectorRBFKernelProgram, 0, NULL, FEATURE_BUILD_OPTIONS, NULL, NULL );
 		if ( CL_SUCCESS != errorCode )
 		{
 			fprintf( stderr, "ERROR BUILDING SIGMOID MATRIX VECTOR MULTIPLY KERNEL\n" );
@@ -5326,7 +6830,7 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 			fprintf( stderr, "ERROR CREATING SWAP VECTOR BLOCK PROGRAM\n" );
 			exit( -1 );
 		}
-		errorCode = clBuildProgram( swapVectorBlockKernelProgram, 0, NULL, NULL, NULL, NULL );
+		errorCode = clBuildProgram( swapVectorBlockKernelProgram, 0, NULL, FEATURE_BUILD_OPTIONS, NULL, NULL );
 		if ( CL_SUCCESS != errorCode )
 		{
 			fprintf( stderr, "ERROR BUILDING SWAP VECTOR BLOCK KERNEL\n" );
@@ -5355,7 +6859,7 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 			fprintf( stderr, "ERROR CREATING PREDICTION REDUCTION PROGRAM\n" );
 			exit( -1 );
 		}
-		errorCode = clBuildProgram( predictionReductionKernelProgram, 0, NULL, NULL, NULL, NULL );
+		errorCode = clBuildProgram( predictionReductionKernelProgram, 0, NULL, FEATURE_BUILD_OPTIONS, NULL, NULL );
 		if ( CL_SUCCESS != errorCode )
 		{
 			fprintf( stderr, "ERROR BUILDING PREDICTION REDUCTION KERNEL\n" );
@@ -5385,7 +6889,7 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 			fprintf( stderr, "ERROR CREATING REDUCTION PROGRAM\n" );
 			exit( -1 );
 		}
-		errorCode = clBuildProgram( reductionKernelProgram, 0, NULL, NULL, NULL, NULL );
+		errorCode = clBuildProgram( reductionKernelProgram, 0, NULL, FEATURE_BUILD_OPTIONS, NULL, NULL );
 		if ( CL_SUCCESS != errorCode )
 		{
 			fprintf( stderr, "ERROR BUILDING REDUCTION KERNEL\n" );
@@ -5409,7 +6913,7 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 		}
 		*/
 
-		resultCl = clCreateBuffer( kernelContext, CL_MEM_WRITE_ONLY, sizeof(double), NULL, &errorCode );
+		resultCl = clCreateBuffer( kernelContext, CL_MEM_WRITE_ONLY, sizeof(cl_real), NULL, &errorCode );
 		if ( CL_SUCCESS != errorCode )
 		{
 			fprintf( stderr, "Error creating linear kernel result buffer\n" );
@@ -5426,8 +6930,43 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 		
 		// TODO: mask kernel assignment
 	#endif
+}
+
+#ifdef _DENSE_REP
+Kernel::Kernel(int l, svm_node * x_, const svm_parameter& param, shared_rows *shared_)
+#else
+Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param, shared_rows *shared_)
+#endif
+:kernel_type(param.kernel_type), degree(param.degree),
+ gamma(param.gamma), coef0(param.coef0), gpuCache( l, l ), gpuQCache( l, l ),
+ cpuQCache( l, l )
+{
+	memset(&counters, 0, sizeof(counters));
+	#ifdef	CL_SVM
+		// profiling, TEMPORARY
+		otherFunctionTime = 0;
+		gettingQTime = 0;
+		gettingGTime = 0;
+		daxpyTime = 0;
+		swappingTime = 0;
+		swappingCount = 0;
+		qRetrievingTime = 0;
+		swappingOtherFunctionTime = 0;
+		qCacheSwappingTime = 0;
+		endQueueTime = 0;
+		kernelEnqueuingTime = 0;
+		argSettingTime = 0;
+	
+		device = LINEAR_OPENCL <= kernel_type || SOLVER_DEVICE == solver_mode || check_gradient;
+		if ( device )
+		{
+			initialize_device( l );
+		}
+	#endif
 
 	wideKernelInUse = 0;
+	numberOfVectors = l;
+	row_kernel_type = -1;
 	
 	switch(kernel_type)
 	{
@@ -5471,20 +7010,52 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 			break;
 	}
 	
+	switch(kernel_type)
+	{
+		case LINEAR:
+		case WIDE_LINEAR_OPENCL:
+			row_kernel_type = LINEAR;
+			break;
+		case POLY:
+		case WIDE_POLY_OPENCL:
+			row_kernel_type = POLY;
+			break;
+		case RBF:
+		case WIDE_RBF_OPENCL:
+			row_kernel_type = RBF;
+			break;
+		case SIGMOID:
+		case WIDE_SIGMOID_OPENCL:
+			row_kernel_type = SIGMOID;
+			break;
+	}
+#ifdef _DENSE_REP
+	select_row_engine();
+#endif
+	row_buffer = new double[l];
+	// build_nystrom computes rows through fill_row, which reads these
+	sparse_x = NULL;
+	nystrom_row = NULL;
+	instance_id = NULL;
+	
 	clone(x,x_,l);
+	build_sparse_rows(l);
 
 	if(kernel_type == RBF || kernel_type == WIDE_RBF_OPENCL)
 	{
 		x_square = new double[l];
 		for(int i=0;i<l;i++)
 		{
-			x_square[i] = dot(x[i],x[i]);
+			x_square[i] = sparse_x ? sparse_dot(sparse_x[i],sparse_x[i]) : dot(x[i],x[i]);
 		}	
 	}
 	else
 	{
 		x_square = 0;
 	}
+	build_nystrom(l, param.nystrom_landmarks);
+	shared = shared_;
+	map_shared_instances(l);
 	
 	/*#ifdef CL_SVM
 		// create the cl_mem buffer (assume all j vectors have same dimensionality)
@@ -5499,7 +7070,7 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 		errorCode = 0;
 		for ( k = 0; k < l; k++ )
 		{
-			errorCode |= clEnqueueWriteBuffer( kernelCommandQueue, x_data_j, CL_FALSE, k * sizeof(double) * l, sizeof(double) * x[0].dim, x[k].values, 0, NULL, NULL );
+			errorCode |= metered_write_buffer( kernelCommandQueue, x_data_j, CL_FALSE, k * sizeof(double) * l, sizeof(double) * x[0].dim, x[k].values, 0, NULL, NULL );
 		}
 		if ( CL_SUCCESS != errorCode )
 		{
@@ -5550,6 +7121,13 @@ Kernel::~Kernel()
 	fprintf( stdout, "CACHE INVALIDATIONS: %lu\n", gpuCache.cacheInvalidations );
 	fprintf( stdout, "Q CACHE MISSES: %lu\n", gpuQCache.cacheMisses );
 	fprintf( stdout, "Q CACHE INVALIDATIONS: %lu\n", gpuQCache.cacheInvalidations );
+	counters.gpu_cache_hits = gpuCache.cacheHits + gpuQCache.cacheHits + cpuQCache.cacheHits;
+	counters.gpu_cache_misses = gpuCache.cacheMisses + gpuQCache.cacheMisses + cpuQCache.cacheMisses;
+	counters.gpu_cache_invalidations = gpuCache.cacheInvalidations + gpuQCache.cacheInvalidations + cpuQCache.cacheInvalidations;
+	counters.pool_hits = devicePool.poolHits;
+	counters.pool_misses = devicePool.poolMisses;
+	counters.pool_bytes = devicePool.bytesReserved;
+	merge_metrics(counters);
 
 	if ( 0 != swappingCount )
 	{
@@ -5571,43 +7149,75 @@ Kernel::~Kernel()
 	#ifdef CL_SVM
 		// debugging
 		fprintf( stdout, "Deconstructing kernel\n" );
-		clAmdBlasTeardown();
-		clReleaseMemObject( resultCl );
-		//clReleaseMemObject( x_data_j );
-		clReleaseContext( kernelContext );
-		clReleaseCommandQueue( kernelCommandQueue );
+		if ( device )
+		{
+			clAmdBlasTeardown();
+			clReleaseMemObject( resultCl );
+			//clReleaseMemObject( x_data_j );
+			clReleaseContext( kernelContext );
+			clReleaseCommandQueue( kernelCommandQueue );
+		}
 	#endif
 	delete[] x;
 	delete[] x_square;
+	delete[] row_buffer;
+	delete[] sparse_x;
+	delete[] sparse_index;
+	delete[] sparse_value;
+	delete[] sparse_scratch;
+	delete[] nystrom_row;
+	delete[] nystrom_factor;
+	delete[] nystrom_landmark;
+	delete[] nystrom_L;
+	delete[] instance_id;
 	
 	// debugging
 	fprintf( stdout, "Finished deconstructing kernel\n" );
 	
 }
 
-#ifdef _DENSE_REP
-double Kernel::dot(const svm_node *px, const svm_node *py)
+// sum_i coef_i K~(x_i,x) with K~ = C W^-1 C' is sum_k beta_k K(landmark_k,x)
+// for beta = L^-T Z' coef, so a model storing beta on the landmarks predicts
+// with the same approximate kernel it was trained on
+void Kernel::nystrom_expansion(int l, double *coef) const
 {
-	double sum = 0;
-
-	int dim = min(px->dim, py->dim);
-	for (int i = 0; i < dim; i++)
+	if(!nystrom_row)
+		return;
+	int m = nystrom_rank, i, p, q;
+	double *beta = new double[m];
+	for(p=0;p<m;p++)
+		beta[p] = 0;
+	for(i=0;i<l;i++)
+		if(coef[i] != 0)
+		{
+			const svm_feature *z = nystrom_factor+(long int)i*m;
+			for(p=0;p<m;p++)
+				beta[p] += coef[i]*z[p];
+		}
+	// back substitution L' beta = Z' coef
+	for(p=m-1;p>=0;p--)
 	{
-		sum += (px->values)[i] * (py->values)[i];
+		double sum = beta[p];
+		for(q=p+1;q<m;q++)
+			sum -= nystrom_L[q*m+p]*beta[q];
+		beta[p] = nystrom_L[p*m+p] > 0 ? sum/nystrom_L[p*m+p] : 0;
 	}
-	return sum;
+	for(i=0;i<l;i++)
+		coef[i] = 0;
+	for(p=0;p<m;p++)
+		coef[nystrom_landmark[p]] += beta[p];
+	delete[] beta;
 }
 
-double Kernel::dot(const svm_node &px, const svm_node &py)
+#ifdef _DENSE_REP
+double Kernel::dot(const svm_node *px, const svm_node *py)
 {
-	double sum = 0;
+	return simd_dot(px->values, py->values, min(px->dim, py->dim));
+}
 
-	int dim = min(px.dim, py.dim);
-	for (int i = 0; i < dim; i++)
-	{
-		sum += px.values[i] * py.values[i];
-	}
-	return sum;
+double Kernel::dot(const svm_node &px, const svm_node &py)
+{
+	return simd_dot(px.values, py.values, min(px.dim, py.dim));
 }
 #else
 double Kernel::dot(const svm_node *px, const svm_node *py)
@@ -5647,16 +7257,11 @@ double Kernel::k_function(const svm_node *x, const svm_node *y,
 		{
 			double sum = 0;
 #ifdef _DENSE_REP
-			int dim = min(x->dim, y->dim), i;
-			for (i = 0; i < dim; i++)
-			{
-				double d = x->values[i] - y->values[i];
-				sum += d*d;
-			}
-			for (; i < x->dim; i++)
-				sum += x->values[i] * x->values[i];
-			for (; i < y->dim; i++)
-				sum += y->values[i] * y->values[i];
+			int dim = min(x->dim, y->dim);
+			sum = simd_squared_distance(x->values, y->values, dim);
+			// whichever vector is longer contributes its remaining squares
+			sum += simd_squared_norm(x->values + dim, x->dim - dim);
+			sum += simd_squared_norm(y->values + dim, y->dim - dim);
 #else
 			while(x->index != -1 && y->index !=-1)
 			{
@@ -5709,6 +7314,66 @@ double Kernel::k_function(const svm_node *x, const svm_node *y,
 	}
 }
 
+#ifdef _DENSE_REP
+// out[j] = dot(xi, rows[j]) for j < count, four rows per blocked sweep
+void Kernel::dot_rows(const svm_node &xi, const svm_node *rows, int count, double *out)
+{
+	int j;
+	for(j=0;j+4<=count;j+=4)
+	{
+		const svm_feature *block[4] = { rows[j].values, rows[j+1].values, rows[j+2].values, rows[j+3].values };
+		int n = min(min(xi.dim, min(rows[j].dim, rows[j+1].dim)), min(rows[j+2].dim, rows[j+3].dim));
+		simd_dot4(xi.values, block, n, out+j);
+		// rows with more shared features than the block minimum
+		for(int k=0;k<4;k++)
+		{
+			int dim = min(xi.dim, rows[j+k].dim);
+			if(dim > n)
+				out[j+k] += simd_dot(xi.values+n, block[k]+n, dim-n);
+		}
+	}
+	for(;j<count;j++)
+		out[j] = dot(xi, rows[j]);
+}
+
+// out[i] = K(x, sv[i]) for all l support vectors; with sv_norm the RBF
+// distance is |x|^2 + |sv_i|^2 - 2 x.sv_i, so it shares the dot product sweep
+void Kernel::k_function_row(const svm_node *x, const svm_node *sv, const double *sv_norm,
+			  int l, const svm_parameter& param, double *out)
+{
+	int row_type = -1;
+	switch(param.kernel_type)
+	{
+		case LINEAR:
+		case WIDE_LINEAR_OPENCL:
+			row_type = LINEAR;
+			break;
+		case POLY:
+		case WIDE_POLY_OPENCL:
+			row_type = POLY;
+			break;
+		case SIGMOID:
+		case WIDE_SIGMOID_OPENCL:
+			row_type = SIGMOID;
+			break;
+		case RBF:
+		case WIDE_RBF_OPENCL:
+			if(sv_norm)
+				row_type = RBF;
+			break;
+	}
+	if(row_type < 0)
+	{
+		for(int i=0;i<l;i++)
+			out[i] = k_function(x, sv+i, param);
+		return;
+	}
+	dot_rows(*x, sv, l, out);
+	double x_norm = row_type == RBF ? dot(x,x) : 0;
+	select_row_transform(row_type, param.degree)(out, l, param.gamma, param.coef0, param.degree, x_norm, sv_norm);
+}
+#endif
+
 #ifdef CL_SVM
 		double Kernel::wide_k_function( const svm_node * x, const svm_node * y,
 								const svm_parameter & param, double * svmCoefficients  )
@@ -5794,6 +7459,12 @@ protected:
 	double *G_bar;		// gradient, if we treat free variables as 0
 	int l;
 	bool unshrink;	// XXX
+	// which sides keep G up to date, see svm_set_solver_mode; both when the
+	// copies are being checked against each other
+	bool gradient_on_host;
+	bool gradient_on_device;
+	bool gradient_checked;
+	bool selection_on_device;
 
 	double get_C(int i)
 	{
@@ -5812,21 +7483,82 @@ protected:
 	bool is_free(int i) { return alpha_status[i] == FREE; }
 	void swap_index(int i, int j);
 	void reconstruct_gradient();
+	void check_gradient_copies(int len, const char *where);
 	virtual int select_working_set(int &i, int &j);
+	int select_working_set_device(int &i, int &j);
+	// whether the problem has the single equality constraint y^T alpha =
+	// delta that the device selection and the block solver assume
+	virtual bool one_constraint() { return true; }
+	int predict_working_set(int i, int j, int *next);
+	// adds its selections to wss_time and wss_count, as the pair loop does
+	int solve_working_sets(int max_iter, int shrinking, LONGLONG &wss_time, LONGLONG &wss_count);
+	int select_working_block(int *B, int q, int kept);
+	int select_partners(int *B, int first, int n, Qfloat **column);
+	int solve_block(int n, const int *B, const double *Q_BB, double *a, double *g);
+
+	// working set scans over [begin,end): up to two maxima and one minimum
+	// with their indices, ties going to the later index as in the serial loops
+	struct wss_part
+	{
+		double max[2];
+		int max_idx[2];
+		double min;
+		int min_idx;
+	};
+	typedef void (Solver::*wss_scan)(int begin, int end, wss_part &part);
+	// inputs of the second order scans, set before scan_working_set
+	const Qfloat *wss_Q[2];
+	int wss_i[2];
+	double wss_Gmax[2];
+	void scan_working_set(wss_scan scan, wss_part &out);
 	virtual double calculate_rho();
 	virtual void do_shrinking();
 private:
 	bool be_shrunk(int i, double Gmax1, double Gmax2);	
+	void scan_i(int begin, int end, wss_part &part);
+	void scan_j(int begin, int end, wss_part &part);
 };
 
+// keeps the cap largest values seen in val, in decreasing order, with their
+// indices
+static void keep_largest(double v, int t, double *val, int *index, int &count, int cap)
+{
+	if(count == cap && v <= val[count-1])
+		return;
+	int k = count < cap ? count++ : cap-1;
+	for(;k>0 && val[k-1] < v;k--)
+	{
+		val[k] = val[k-1];
+		index[k] = index[k-1];
+	}
+	val[k] = v;
+	index[k] = t;
+}
+
+// guesses for the next working set: the largest violators -y_t*G_t in I_up,
+// other than the pair being updated
+int Solver::predict_working_set(int i, int j, int *next)
+{
+#ifdef _OPENMP
+	int depth = min(prefetch_depth, PREFETCH_MAX), n = 0;
+	double score[PREFETCH_MAX];
+	for(int t=0;t<active_size && depth>0;t++)
+		if(t != i && t != j && (y[t]==+1 ? !is_upper_bound(t) : !is_lower_bound(t)))
+			keep_largest(-y[t]*G[t],t,score,next,n,depth);
+	return n;
+#else
+	// nothing to overlap with
+	return 0;
+#endif
+}
+
 void Solver::swap_index(int i, int j)
 {
 	Q->swap_index(i,j);
 	// TODO: duplicate y swap
 	swap(y[i],y[j]);
 	swap(G[i],G[j]);
-	// duplicate work on the GPU
-	if ( 0 != ((QMatrix*)Q)->swap_objective_function( i, j ) )
+	if ( gradient_on_device && 0 != ((QMatrix*)Q)->swap_objective_function( i, j ) )
 	{
 		// TODO: Deal with this error
 		fprintf( stderr, "ERROR SWAPPING OBJECTIVE FUNCTION ON GPU\n" );
@@ -5839,6 +7571,44 @@ void Solver::swap_index(int i, int j)
 	swap(G_bar[i],G_bar[j]);
 }
 
+// debugging, see svm_set_check_gradient: G[0..len) against the device copy
+void Solver::check_gradient_copies(int len, const char *where)
+{
+	if ( gradient_checked && 0 != ((QMatrix*)Q)->check_objective_function( len, G ) )
+	{
+		fprintf( stderr, "ERROR, OBJECTIVE FUNCTIONS DO NOT MATCH %s\n", where );
+		exit( -1 );
+	}
+}
+
+// gradient updates are split over the workers in contiguous blocks once they
+// are this many times parallel_threshold long (65536 by default): an element
+// is one multiply-add, where the kernel loops pay a whole kernel value
+#define GRADIENT_PARALLEL_SCALE 64
+
+// G[0..n) += alpha*Q_i + beta*Q_j, or just alpha*Q_i when Q_j is NULL
+static void update_gradient(double *G, int n, const Qfloat *Q_i, double alpha, const Qfloat *Q_j, double beta)
+{
+	int parts = 1;
+#ifdef _OPENMP
+	if(n >= (long long)GRADIENT_PARALLEL_SCALE*parallel_threshold)
+		parts = worker_count();
+#endif
+	// G may start anywhere in a cache line (callers pass &G[active_size]);
+	// blocks after the first start on a line so no two workers share one
+	int skew = (int)(((size_t)G/sizeof(double))&7);
+#pragma omp parallel for num_threads(parts) if(parts > 1) schedule(static,1)
+	for(int t=0;t<parts;t++)
+	{
+		int begin = t == 0 ? 0 : max((((int)((long long)n*t/parts)+skew) & ~7)-skew, 0);
+		int end = t == parts-1 ? n : max((((int)((long long)n*(t+1)/parts)+skew) & ~7)-skew, 0);
+		if(Q_j)
+			simd_axpy2(G+begin,Q_i+begin,alpha,Q_j+begin,beta,end-begin);
+		else
+			simd_axpy(G+begin,Q_i+begin,alpha,end-begin);
+	}
+}
+
 void Solver::reconstruct_gradient()
 {
 	// debugging
@@ -5859,16 +7629,8 @@ void Solver::reconstruct_gradient()
 		exit( -1 );
 	}*/
 	
-	double * G_dup;
-	//G_dup = (double*) malloc( sizeof(double) * l );
-	
-	//if ( 0 != Q->retrieve_objective_function( active_size, l, &(G_dup[active_size]) ) )
-	if ( 0 != ((QMatrix*)Q)->retrieve_objective_function( active_size, l, &(G[active_size]) ) )
-	{
-		// TODO: Deal with this error
-		fprintf( stderr, "ERROR: FAILED TO RETRIEVE G_DUP\n" );
-		exit( -1 );
-	}
+	// the inactive part is rebuilt from G_bar below on the host whichever
+	// side keeps G, there is nothing to read back for it
 	
 	// debugging
 	/*for ( j = active_size; j < l; j++ )
@@ -5886,10 +7648,14 @@ void Solver::reconstruct_gradient()
 		//G_dup[j] = G_bar[j] + p[j];
 	}
 	
+	int *free_index = Malloc(int,active_size);
+	double *free_alpha = Malloc(double,active_size);
 	for(j=0;j<active_size;j++)
 	{
 		if(is_free(j))
 		{
+			free_index[nr_free] = j;
+			free_alpha[nr_free] = alpha[j];
 			nr_free++;
 		}
 	}
@@ -5904,49 +7670,37 @@ void Solver::reconstruct_gradient()
 		for(i=active_size;i<l;i++)
 		{
 			const Qfloat *Q_i = Q->get_Q(i,active_size);
-			for(j=0;j<active_size;j++)
-			{
-				if(is_free(j))
-				{
-					G[i] += alpha[j] * Q_i[j];
-					//G_dup[i] += alpha[j] * Q_i[j];
-				}
-			}
+			G[i] += simd_gather_dot(free_index,free_alpha,nr_free,Q_i);
 		}
 	}
 	else
 	{
-		for(i=0;i<active_size;i++)
+		// two free columns per pass over G, the cache always holds two
+		int n = l-active_size;
+		for(i=0;i+1<nr_free;i+=2)
 		{
-			if(is_free(i))
-			{
-				const Qfloat *Q_i = Q->get_Q(i,l);
-				double alpha_i = alpha[i];
-				for(j=active_size;j<l;j++)
-				{
-					G[j] += alpha_i * Q_i[j];
-					//G_dup[j] += alpha_i * Q_i[j];
-				}
-			}
+			const Qfloat *Q_i = Q->get_Q(free_index[i],l);
+			const Qfloat *Q_j = Q->get_Q(free_index[i+1],l);
+			update_gradient(&G[active_size],n,&Q_i[active_size],free_alpha[i],&Q_j[active_size],free_alpha[i+1]);
+		}
+		if(i < nr_free)
+		{
+			const Qfloat *Q_i = Q->get_Q(free_index[i],l);
+			update_gradient(&G[active_size],n,&Q_i[active_size],free_alpha[i],NULL,0);
 		}
 	}
+	free(free_index);
+	free(free_alpha);
 	
-	// duplicate work on GPU
-	//if ( 0 != Q->set_objective_function( active_size, l, &(G_dup[active_size]) ) )
-	if ( 0 != ((QMatrix*)Q)->set_objective_function( active_size, l, &(G[active_size]) ) )
+	// hand it to the device
+	if ( gradient_on_device && 0 != ((QMatrix*)Q)->set_objective_function( active_size, l, &(G[active_size]) ) )
 	{
 		// TODO: Deal with this error
 		fprintf( stderr, "ERROR SETTING G_DUP DATA\n" );
 		exit( -1 );
 	}
 	
-	// check duplicated GPU work
-	/*if ( 0 != Q->check_objective_function( l, G ) )
-	{
-		// TODO: Deal with this error
-		fprintf( stderr, "ERROR, OBJECTIVE FUNCTIONS DO NOT MATCH AFTER RECONSTRUCTION\n" );
-		exit( -1 );
-	}*/
+	check_gradient_copies( l, "AFTER RECONSTRUCTION" );
 	
 	/*if ( 0 != Q->initialize_objective_function( l, G ) )
 	{
@@ -5956,6 +7710,101 @@ void Solver::reconstruct_gradient()
 	}*/
 }
 
+// the analytic two-variable step of SMO: a_i and a_j move along
+// y_i a_i + y_j a_j = const to the minimum, clipped to [0,C_i] x [0,C_j]
+static void smo_step(bool same_sign, double G_i, double G_j, double QD_i, double QD_j, double Q_ij,
+		     double C_i, double C_j, double &a_i, double &a_j)
+{
+	if(!same_sign)
+	{
+		double quad_coef = QD_i+QD_j+2*Q_ij;
+		if (quad_coef <= 0)
+			quad_coef = TAU;
+		double delta = (-G_i-G_j)/quad_coef;
+		double diff = a_i - a_j;
+		a_i += delta;
+		a_j += delta;
+		
+		if(diff > 0)
+		{
+			if(a_j < 0)
+			{
+				a_j = 0;
+				a_i = diff;
+			}
+		}
+		else
+		{
+			if(a_i < 0)
+			{
+				a_i = 0;
+				a_j = -diff;
+			}
+		}
+		if(diff > C_i - C_j)
+		{
+			if(a_i > C_i)
+			{
+				a_i = C_i;
+				a_j = C_i - diff;
+			}
+		}
+		else
+		{
+			if(a_j > C_j)
+			{
+				a_j = C_j;
+				a_i = C_j + diff;
+			}
+		}
+	}
+	else
+	{
+		double quad_coef = QD_i+QD_j-2*Q_ij;
+		if (quad_coef <= 0)
+		{
+			quad_coef = TAU;
+		}
+		double delta = (G_i-G_j)/quad_coef;
+		double sum = a_i + a_j;
+		a_i -= delta;
+		a_j += delta;
+
+		if(sum > C_i)
+		{
+			if(a_i > C_i)
+			{
+				a_i = C_i;
+				a_j = sum - C_i;
+			}
+		}
+		else
+		{
+			if(a_j < 0)
+			{
+				a_j = 0;
+				a_i = sum;
+			}
+		}
+		if(sum > C_j)
+		{
+			if(a_j > C_j)
+			{
+				a_j = C_j;
+				a_i = sum - C_j;
+			}
+		}
+		else
+		{
+			if(a_i < 0)
+			{
+				a_i = 0;
+				a_j = sum;
+			}
+		}
+	}
+}
+
 void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 		   double *alpha_, double Cp, double Cn, double eps,
 		   SolutionInfo* si, int shrinking)
@@ -5971,6 +7820,15 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 	this->Cn = Cn;
 	this->eps = eps;
 	unshrink = false;
+	// the device copy needs a matrix the device kernels understand, and the
+	// device-only mode a working set selection that can run there
+	{
+		bool device = Q.device_gradient();
+		selection_on_device = solver_mode == SOLVER_DEVICE && device && one_constraint();
+		gradient_checked = check_gradient && device;
+		gradient_on_device = selection_on_device || gradient_checked;
+		gradient_on_host = !selection_on_device || gradient_checked;
+	}
 	profileDecls;
 	LONGLONG wssTime = 0;
 	LONGLONG reconstructionTime = 0;
@@ -6013,71 +7871,60 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 			G_bar[i] = 0;
 		}
 		
-		// duplicate work on GPU
-		startTimer();
-		if ( 0 != ((QMatrix*)(&Q))->initialize_objective_function( l, p ) )
-		{
-			// TODO: Deal with this error
-			fprintf( stderr, "ERROR INITIALIZING GPU OBJECTIVE FUNCTION\n" );
-			exit( -1 );
-		}
-		stopTimer();
-		pureCommunicationTime += calculateTime();
-		if ( 0 != ((QMatrix*)(&Q))->check_objective_function( active_size, G ) )
+		if ( gradient_on_device )
 		{
-			// TODO: Deal with this error
-			fprintf( stderr, "ERROR, OBJECTIVE FUNCTIONS DO NOT MATCH AFTER ASSIGNING P\n" );
-			exit( -1 );
+			startTimer();
+			if ( 0 != ((QMatrix*)(&Q))->initialize_objective_function( l, p ) )
+			{
+				// TODO: Deal with this error
+				fprintf( stderr, "ERROR INITIALIZING GPU OBJECTIVE FUNCTION\n" );
+				exit( -1 );
+			}
+			stopTimer();
+			pureCommunicationTime += calculateTime();
+			check_gradient_copies( l, "AFTER ASSIGNING P" );
 		}
 		for(i=0;i<l;i++)
 		{
 			if(!is_lower_bound(i))
 			{
-				startTimer();
-				const Qfloat *Q_i = Q.get_Q(i,l);
-				stopTimer();
-				kernelMatrixTime += calculateTime();
-				kernelMatrixCount++;
 				double alpha_i = alpha[i];
-				int j;
-				startTimer();
-				for(j=0;j<l;j++)
-				{
-					G[j] += alpha_i*Q_i[j];
-				}
-				stopTimer();
-				serialGTime += calculateTime();
-				// duplicate work on GPU
-				startTimer();
-				if ( 0 != ((QMatrix*)(&Q))->update_objective_function( l, alpha_i, 0.0, i, i ) )
+				// the host column is only needed for a host G or for G_bar
+				if(gradient_on_host || is_upper_bound(i))
 				{
-					// TODO: Deal with this error
-					fprintf( stderr, "ERROR UPDATING GPU OBJECTIVE FUNCTION\n" );
-					exit( -1 );
+					startTimer();
+					const Qfloat *Q_i = Q.get_Q(i,l);
+					stopTimer();
+					kernelMatrixTime += calculateTime();
+					kernelMatrixCount++;
+					if(gradient_on_host)
+					{
+						startTimer();
+						update_gradient(G,l,Q_i,alpha_i,NULL,0);
+						stopTimer();
+						serialGTime += calculateTime();
+					}
+					if(is_upper_bound(i))
+						update_gradient(G_bar,l,Q_i,get_C(i),NULL,0);
 				}
-				stopTimer();
-				objectiveFunctionUpdateTime += calculateTime();
-				objectiveFunctionUpdateCount++;
-				
-				if(is_upper_bound(i))
+				if ( gradient_on_device )
 				{
-					for(j=0;j<l;j++)
+					startTimer();
+					if ( 0 != ((QMatrix*)(&Q))->update_objective_function( l, alpha_i, 0.0, i, i ) )
 					{
-						G_bar[j] += get_C(i) * Q_i[j];
+						// TODO: Deal with this error
+						fprintf( stderr, "ERROR UPDATING GPU OBJECTIVE FUNCTION\n" );
+						exit( -1 );
 					}
+					stopTimer();
+					objectiveFunctionUpdateTime += calculateTime();
+					objectiveFunctionUpdateCount++;
 				}
 			}
 		}
 	}
 
-	// check duplicated GPU work
-	/*if ( 0 != Q.check_objective_function( active_size, G ) )
-	{
-		// TODO: Deal with this error
-		fprintf( stderr, "ERROR, OBJECTIVE FUNCTIONS DO NOT MATCH AT INITIALIZATION\n" );
-		exit( -1 );
-	}
-	fprintf( stdout, "PASSED CHECK AT INITIALIZATION\n" );*/
+	check_gradient_copies( l, "AT INITIALIZATION" );
 	
 	// optimization step
 	
@@ -6085,6 +7932,11 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 	int max_iter = max(10000000, l>INT_MAX/100 ? INT_MAX : 100*l);
 	int counter = min(l,1000)+1;
 
+	// larger working sets first, see svm_set_working_set_size; the pair loop
+	// below then starts at the optimum and only confirms it
+	if(working_set_size > 2 && !selection_on_device && one_constraint())
+		iter = solve_working_sets(max_iter, shrinking, wssTime, wssCount);
+
 	while(iter < max_iter)
 	{
 		// show progress and do shrinking
@@ -6092,7 +7944,18 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 		if(--counter == 0)
 		{
 			counter = min(l,1000);
-			if(shrinking) do_shrinking();
+			if(shrinking)
+			{
+				// shrinking reads the active part of G, a device-only G comes
+				// back for it once every counter iterations
+				if ( !gradient_on_host && 0 != ((QMatrix*)(&Q))->retrieve_objective_function( 0, active_size, G ) )
+				{
+					// TODO: Deal with this error
+					fprintf( stderr, "FAILED TO RETRIEVE G FUNCTION FOR SHRINKING\n" );
+					exit( -1 );
+				}
+				do_shrinking();
+			}
 			info(".");
 		}
 
@@ -6156,96 +8019,7 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 		double old_alpha_i = alpha[i];
 		double old_alpha_j = alpha[j];
 
-		if(y[i]!=y[j])
-		{
-			double quad_coef = QD[i]+QD[j]+2*Q_i[j];
-			if (quad_coef <= 0)
-				quad_coef = TAU;
-			// MARK: CPU USE OF G
-			double delta = (-G[i]-G[j])/quad_coef;
-			double diff = alpha[i] - alpha[j];
-			alpha[i] += delta;
-			alpha[j] += delta;
-			
-			if(diff > 0)
-			{
-				if(alpha[j] < 0)
-				{
-					alpha[j] = 0;
-					alpha[i] = diff;
-				}
-			}
-			else
-			{
-				if(alpha[i] < 0)
-				{
-					alpha[i] = 0;
-					alpha[j] = -diff;
-				}
-			}
-			if(diff > C_i - C_j)
-			{
-				if(alpha[i] > C_i)
-				{
-					alpha[i] = C_i;
-					alpha[j] = C_i - diff;
-				}
-			}
-			else
-			{
-				if(alpha[j] > C_j)
-				{
-					alpha[j] = C_j;
-					alpha[i] = C_j + diff;
-				}
-			}
-		}
-		else
-		{
-			double quad_coef = QD[i]+QD[j]-2*Q_i[j];
-			if (quad_coef <= 0)
-			{
-				quad_coef = TAU;
-			}
-			// MARK: CPU USE OF G
-			double delta = (G[i]-G[j])/quad_coef;
-			double sum = alpha[i] + alpha[j];
-			alpha[i] -= delta;
-			alpha[j] += delta;
-
-			if(sum > C_i)
-			{
-				if(alpha[i] > C_i)
-				{
-					alpha[i] = C_i;
-					alpha[j] = sum - C_i;
-				}
-			}
-			else
-			{
-				if(alpha[j] < 0)
-				{
-					alpha[j] = 0;
-					alpha[i] = sum;
-				}
-			}
-			if(sum > C_j)
-			{
-				if(alpha[j] > C_j)
-				{
-					alpha[j] = C_j;
-					alpha[i] = sum - C_j;
-				}
-			}
-			else
-			{
-				if(alpha[i] < 0)
-				{
-					alpha[i] = 0;
-					alpha[j] = sum;
-				}
-			}
-		}
+		smo_step(y[i] == y[j], G[i], G[j], QD[i], QD[j], Q_i[j], C_i, C_j, alpha[i], alpha[j]);
 
 		
 		// update G
@@ -6253,25 +8027,47 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 		double delta_alpha_i = alpha[i] - old_alpha_i;
 		double delta_alpha_j = alpha[j] - old_alpha_j;
 		
+		// the columns the next selection is likely to want are computed on a
+		// second thread meanwhile
+		int next[PREFETCH_MAX];
+		int nr_next = gradient_on_host ? predict_working_set(i,j,next) : 0;
+		
 		// this can be optimized iff the Q and G values are stored (possibly mirrored) on the GPU
 		startTimer();
-		for(int k=0;k<active_size;k++)
+		if(gradient_on_host && active_size >= (long long)GRADIENT_PARALLEL_SCALE*parallel_threshold)
+		{
+			// long enough to keep every worker busy, and the prefetch after
+			// it gets them all as well
+			update_gradient(G,active_size,Q_i,delta_alpha_i,Q_j,delta_alpha_j);
+			for(int k=0;k<nr_next;k++)
+				Q.prefetch_Q(next[k],active_size);
+		}
+		else if(gradient_on_host)
 		{
-			G[k] += Q_i[k]*delta_alpha_i + Q_j[k]*delta_alpha_j;
+#pragma omp parallel sections num_threads(2) if(nr_next > 0)
+			{
+#pragma omp section
+				simd_axpy2(G,Q_i,delta_alpha_i,Q_j,delta_alpha_j,active_size);
+#pragma omp section
+				for(int k=0;k<nr_next;k++)
+					Q.prefetch_Q(next[k],active_size);
+			}
 		}
 		stopTimer();
 		serialGTime += calculateTime();
-		// duplicate work on the GPU
-		startTimer();
-		if ( 0 != ((QMatrix*)(&Q))->update_objective_function( active_size, delta_alpha_i, delta_alpha_j, i, j ) )
+		if ( gradient_on_device )
 		{
-			// TODO: Deal with this error
-			fprintf( stderr, "ERROR UPDATING OBJECTIVE FUNCTION ON GPU MID ITERATION: %i, %i\n", i, j );
-			exit( -1 );
+			startTimer();
+			if ( 0 != ((QMatrix*)(&Q))->update_objective_function( active_size, delta_alpha_i, delta_alpha_j, i, j ) )
+			{
+				// TODO: Deal with this error
+				fprintf( stderr, "ERROR UPDATING OBJECTIVE FUNCTION ON GPU MID ITERATION: %i, %i\n", i, j );
+				exit( -1 );
+			}
+			stopTimer();
+			objectiveFunctionUpdateTime += calculateTime();
+			objectiveFunctionUpdateCount++;
 		}
-		stopTimer();
-		objectiveFunctionUpdateTime += calculateTime();
-		objectiveFunctionUpdateCount++;
 		
 		// update alpha_status and G_bar
 
@@ -6280,7 +8076,6 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 			bool uj = is_upper_bound(j);
 			update_alpha_status(i);
 			update_alpha_status(j);
-			int k;
 			if(ui != is_upper_bound(i))
 			{
 				startTimer();
@@ -6288,12 +8083,7 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 				stopTimer();
 				kernelMatrixTime += calculateTime();
 				kernelMatrixCount++;
-				if(ui)
-					for(k=0;k<l;k++)
-						G_bar[k] -= C_i * Q_i[k];
-				else
-					for(k=0;k<l;k++)
-						G_bar[k] += C_i * Q_i[k];
+				update_gradient(G_bar,l,Q_i,ui ? -C_i : C_i,NULL,0);
 			}
 
 			if(uj != is_upper_bound(j))
@@ -6303,24 +8093,12 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 				stopTimer();
 				kernelMatrixTime += calculateTime();
 				kernelMatrixCount++;
-				if(uj)
-					for(k=0;k<l;k++)
-						G_bar[k] -= C_j * Q_j[k];
-				else
-					for(k=0;k<l;k++)
-						G_bar[k] += C_j * Q_j[k];
+				update_gradient(G_bar,l,Q_j,uj ? -C_j : C_j,NULL,0);
 			}
 		}
 
 
-		// check duplicated GPU work
-		/*if ( 0 != Q.check_objective_function( active_size, G ) )
-		{
-			// TODO: Deal with this error
-			fprintf( stderr, "ERROR, OBJECTIVE FUNCTIONS DO NOT MATCH AT END OF ITERATION %i\n", iter );
-			exit( -1 );
-		}*/
-		
+		check_gradient_copies( active_size, "AT END OF ITERATION" );
 	}
 
 	// check duplicated GPU work
@@ -6347,27 +8125,24 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 		fprintf(stderr,"\nWARNING: reaching max number of iterations\n");
 	}
 
-	// check duplicated GPU work
-	/*if ( 0 != Q.check_objective_function( l, G ) )
-	{
-		// TODO: Deal with this error
-		fprintf( stderr, "ERROR, OBJECTIVE FUNCTIONS DO NOT MATCH RIGHT AFTER RECONSTRUCTING GRADIENT\n" );
-		exit( -1 );
-	}*/
+	check_gradient_copies( active_size, "RIGHT AFTER RECONSTRUCTING GRADIENT" );
 	
 	// calculate rho
 
 	// HERE: READ G BACK TO CPU, CONSIDER MOVING RHO CALC AND V CALC TO GPU
 	
-	startTimer();
-	if ( 0 != ((QMatrix*)(&Q))->retrieve_objective_function( 0, l, G ) )
+	if ( !gradient_on_host )
 	{
-		// TODO: Deal with this error
-		fprintf( stderr, "FAILED TO RETRIEVE G FUNCTION AT END OF SMO\n" );
-		exit( -1 );
+		startTimer();
+		if ( 0 != ((QMatrix*)(&Q))->retrieve_objective_function( 0, l, G ) )
+		{
+			// TODO: Deal with this error
+			fprintf( stderr, "FAILED TO RETRIEVE G FUNCTION AT END OF SMO\n" );
+			exit( -1 );
+		}
+		stopTimer();
+		pureCommunicationTime += calculateTime();
 	}
-	stopTimer();
-	pureCommunicationTime += calculateTime();
 	
 		// REPORT PROFILING
 	fprintf( stdout, "PROFILING RESULT:S\n" );
@@ -6377,6 +8152,14 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 	fprintf( stdout, "OBJ	TIME: %llu, COUNT: %llu	PER: %lf\n", objectiveFunctionUpdateTime, objectiveFunctionUpdateCount, ((double)objectiveFunctionUpdateTime)/((double)objectiveFunctionUpdateCount) );
 	fprintf( stdout, "COMM	TIME: %llu\n", pureCommunicationTime );
 	fprintf( stdout, "SG	TIME: %llu\n", serialGTime );
+	{
+		svm_metrics run;
+		memset(&run, 0, sizeof(run));
+		run.wss_time = wssTime*1e-6;
+		run.wss_count = wssCount;
+		run.iterations = iter;
+		merge_metrics(run);
+	}
 	
 	// MARK: CPU USE OF G
 	si->rho = calculate_rho();
@@ -6391,35 +8174,226 @@ void Solver::Solve(int l, const QMatrix& Q, const double *p_, const schar *y_,
 			v += alpha[i] * (G[i] + p[i]);
 		}
 
-		si->obj = v/2;
+		si->obj = v/2;
+	}
+
+	// put back the solution
+	{
+		for(int i=0;i<l;i++)
+			alpha_[active_set[i]] = alpha[i];
+	}
+
+	// juggle everything back
+	/*{
+		for(int i=0;i<l;i++)
+			while(active_set[i] != i)
+				swap_index(i,active_set[i]);
+				// or Q.swap_index(i,active_set[i]);
+	}*/
+
+	si->upper_bound_p = Cp;
+	si->upper_bound_n = Cn;
+
+	info("\noptimization finished, #iter = %d\n",iter);
+
+	delete[] p;
+	delete[] y;
+	delete[] alpha;
+	delete[] alpha_status;
+	delete[] active_set;
+	delete[] G;
+	delete[] G_bar;
+}
+
+// active sets at least this many times parallel_threshold long (32768 by
+// default) are scanned by all workers, each taking one contiguous block;
+// merging the blocks in order keeps the serial result
+#define WSS_PARALLEL_SCALE 32
+#define WSS_MAX_PARTS 64
+
+void Solver::scan_working_set(wss_scan scan, wss_part &out)
+{
+	wss_part part[WSS_MAX_PARTS];
+	int parts = 1;
+#ifdef _OPENMP
+	if(active_size >= (long long)WSS_PARALLEL_SCALE*parallel_threshold)
+		parts = min(worker_count(), WSS_MAX_PARTS);
+#endif
+#pragma omp parallel for num_threads(parts) if(parts > 1) schedule(static,1)
+	for(int t=0;t<parts;t++)
+	{
+		part[t].max[0] = part[t].max[1] = -INF;
+		part[t].max_idx[0] = part[t].max_idx[1] = -1;
+		part[t].min = INF;
+		part[t].min_idx = -1;
+		(this->*scan)((int)((long long)active_size*t/parts), (int)((long long)active_size*(t+1)/parts), part[t]);
+	}
+
+	out = part[0];
+	for(int t=1;t<parts;t++)
+	{
+		for(int k=0;k<2;k++)
+			if(part[t].max[k] >= out.max[k])
+			{
+				out.max[k] = part[t].max[k];
+				out.max_idx[k] = part[t].max_idx[k];
+			}
+		if(part[t].min <= out.min)
+		{
+			out.min = part[t].min;
+			out.min_idx = part[t].min_idx;
+		}
+	}
+}
+
+// max[0]: -y_t*G_t over I_up
+void Solver::scan_i(int begin, int end, wss_part &part)
+{
+	double Gmax = -INF;
+	int Gmax_idx = -1;
+	for(int t=begin;t<end;t++)
+	{
+		if(y[t]==+1)	
+		{
+			if(!is_upper_bound(t))
+			{
+				if(-G[t] >= Gmax)
+				{
+					Gmax = -G[t];
+					Gmax_idx = t;
+				}
+			}
+		}
+		else
+		{
+			if(!is_lower_bound(t))
+			{
+				if(G[t] >= Gmax)
+				{
+					Gmax = G[t];
+					Gmax_idx = t;
+				}
+			}
+		}
+	}
+	part.max[0] = Gmax;
+	part.max_idx[0] = Gmax_idx;
+}
+
+// max[0]: y_j*G_j over I_low (Gmax2, without index); min: the objective
+// decrease of pairing wss_i[0] with j
+void Solver::scan_j(int begin, int end, wss_part &part)
+{
+	int i = wss_i[0];
+	const Qfloat *Q_i = wss_Q[0];
+	double Gmax = wss_Gmax[0];
+	double Gmax2 = -INF;
+	int Gmin_idx = -1;
+	double obj_diff_min = INF;
+
+	// for GPU: y, alpha_status, Gmax, QD, i_selection (define TAU on GPU)
+	// this is going to be another block based minimization
+	for(int j=begin;j<end;j++)
+	{
+		// we'll have to write y out to the GPU again, should really cache that
+		if(y[j]==+1)
+		{
+			// have to write alpha_status out to the GPU, should cache that maybe
+			if (!is_lower_bound(j))
+			{
+				// G is already on the GPU, Gmax doesn't take a lot to write
+				double grad_diff=Gmax+G[j];
+				// Gmax2 can be created on the GPU
+				if (G[j] >= Gmax2)
+				{
+					Gmax2 = G[j];
+				}
+				if (grad_diff > 0)
+				{
+					double obj_diff;
+					// have to push QD out to the GPU (Q_i should already be there)
+					double quad_coef = QD[i]+QD[j]-2.0*y[i]*Q_i[j];
+					if (quad_coef > 0)
+					{
+						obj_diff = -(grad_diff*grad_diff)/quad_coef;
+					}
+					else
+					{
+						// should push TAU as a definition? Maybe an argument?
+						obj_diff = -(grad_diff*grad_diff)/TAU;
+					}
+					// obj_diff_min can be calculate entirely on the GPU
+					if (obj_diff <= obj_diff_min)
+					{
+						Gmin_idx=j;
+						obj_diff_min = obj_diff;
+					}
+				}
+			}
+		}
+		else
+		{
+			// have to write alpha_status out to the GPU, should cache that maybe
+			if (!is_upper_bound(j))
+			{
+				// G is already on the GPU, Gmax doesn't take a lot to write
+				double grad_diff= Gmax-G[j];
+				if (-G[j] >= Gmax2)
+				{
+					Gmax2 = -G[j];
+				}
+				if (grad_diff > 0)
+				{
+					double obj_diff; 
+					double quad_coef = QD[i]+QD[j]+2.0*y[i]*Q_i[j];
+					if (quad_coef > 0)
+					{
+						obj_diff = -(grad_diff*grad_diff)/quad_coef;
+					}
+					else
+					{
+						obj_diff = -(grad_diff*grad_diff)/TAU;
+					}
+
+					if (obj_diff <= obj_diff_min)
+					{
+						Gmin_idx=j;
+						obj_diff_min = obj_diff;
+					}
+				}
+			}
+		}
 	}
+	part.max[0] = Gmax2;
+	part.min = obj_diff_min;
+	part.min_idx = Gmin_idx;
+}
 
-	// put back the solution
+// the same selection on the device copy of G, which also sends back G[i]
+// and G[j], the only entries the alpha update reads
+int Solver::select_working_set_device(int &out_i, int &out_j)
+{
+	int i, j;
+	double Gmax, Gmax2;
+	if ( 0 != ((QMatrix*)Q)->select_working_set_i( y, alpha_status, active_size, i, Gmax ) )
 	{
-		for(int i=0;i<l;i++)
-			alpha_[active_set[i]] = alpha[i];
+		// TODO: Deal with this error
+		fprintf( stderr, "ERROR SELECTING I ON THE GPU\n" );
+		exit( -1 );
 	}
-
-	// juggle everything back
-	/*{
-		for(int i=0;i<l;i++)
-			while(active_set[i] != i)
-				swap_index(i,active_set[i]);
-				// or Q.swap_index(i,active_set[i]);
-	}*/
-
-	si->upper_bound_p = Cp;
-	si->upper_bound_n = Cn;
-
-	info("\noptimization finished, #iter = %d\n",iter);
-
-	delete[] p;
-	delete[] y;
-	delete[] alpha;
-	delete[] alpha_status;
-	delete[] active_set;
-	delete[] G;
-	delete[] G_bar;
+	if(i == -1)
+		return 1;
+	if ( 0 != ((QMatrix*)Q)->select_working_set_j( y, alpha_status, Gmax, i, (double*)QD, active_size, j, Gmax2, G ) )
+	{
+		// TODO: Deal with this error
+		fprintf( stderr, "ERROR WHILE SELECTING J ON GPU\n" );
+		exit( -1 );
+	}
+	if(Gmax+Gmax2 < eps || j == -1)
+		return 1;
+	out_i = i;
+	out_j = j;
+	return 0;
 }
 
 // return 1 if already optimal, return 0 otherwise
@@ -6431,11 +8405,10 @@ int Solver::select_working_set(int &out_i, int &out_j)
 	//    (if quadratic coefficeint <= 0, replace it with tau)
 	//    -y_j*grad(f)_j < -y_i*grad(f)_i, j in I_low(\alpha)
 	
-	double Gmax = -INF;
-	double Gmax2 = -INF;
-	int Gmax_idx = -1;
-	int Gmin_idx = -1;
-	double obj_diff_min = INF;
+	if(selection_on_device)
+		return select_working_set_device(out_i, out_j);
+
+	wss_part found;
 
 	// In cuSVM, this part is broken up in two levels. 
 	// Each block (255 threads) is tasked with selecting
@@ -6449,35 +8422,9 @@ int Solver::select_working_set(int &out_i, int &out_j)
 	// this is maximum selection
 	
 	// find i that maximizes gradient
-	{
-	
-		for(int t=0;t<active_size;t++)
-		{
-			if(y[t]==+1)	
-			{
-				if(!is_upper_bound(t))
-				{
-					if(-G[t] >= Gmax)
-					{
-						Gmax = -G[t];
-						Gmax_idx = t;
-					}
-				}
-			}
-			else
-			{
-				if(!is_lower_bound(t))
-				{
-					if(G[t] >= Gmax)
-					{
-						Gmax = G[t];
-						Gmax_idx = t;
-					}
-				}
-			}
-		}
-
-	}
+	scan_working_set(&Solver::scan_i, found);
+	double Gmax = found.max[0];
+	int Gmax_idx = found.max_idx[0];
 	
 	// save it
 	int i = Gmax_idx;
@@ -6513,82 +8460,12 @@ int Solver::select_working_set(int &out_i, int &out_j)
 	}
 
 	// find j that minimizes decrease in objective value
-	{
-	
-		// for GPU: y, alpha_status, Gmax, QD, i_selection (define TAU on GPU)
-		// this is going to be another block based minimization
-		for(int j=0;j<active_size;j++)
-		{
-			// we'll have to write y out to the GPU again, should really cache that
-			if(y[j]==+1)
-			{
-				// have to write alpha_status out to the GPU, should cache that maybe
-				if (!is_lower_bound(j))
-				{
-					// G is already on the GPU, Gmax doesn't take a lot to write
-					double grad_diff=Gmax+G[j];
-					// Gmax2 can be created on the GPU
-					if (G[j] >= Gmax2)
-					{
-						Gmax2 = G[j];
-					}
-					if (grad_diff > 0)
-					{
-						double obj_diff;
-						// have to push QD out to the GPU (Q_i should already be there)
-						double quad_coef = QD[i]+QD[j]-2.0*y[i]*Q_i[j];
-						if (quad_coef > 0)
-						{
-							obj_diff = -(grad_diff*grad_diff)/quad_coef;
-						}
-						else
-						{
-							// should push TAU as a definition? Maybe an argument?
-							obj_diff = -(grad_diff*grad_diff)/TAU;
-						}
-						// obj_diff_min can be calculate entirely on the GPU
-						if (obj_diff <= obj_diff_min)
-						{
-							Gmin_idx=j;
-							obj_diff_min = obj_diff;
-						}
-					}
-				}
-			}
-			else
-			{
-				// have to write alpha_status out to the GPU, should cache that maybe
-				if (!is_upper_bound(j))
-				{
-					// G is already on the GPU, Gmax doesn't take a lot to write
-					double grad_diff= Gmax-G[j];
-					if (-G[j] >= Gmax2)
-					{
-						Gmax2 = -G[j];
-					}
-					if (grad_diff > 0)
-					{
-						double obj_diff; 
-						double quad_coef = QD[i]+QD[j]+2.0*y[i]*Q_i[j];
-						if (quad_coef > 0)
-						{
-							obj_diff = -(grad_diff*grad_diff)/quad_coef;
-						}
-						else
-						{
-							obj_diff = -(grad_diff*grad_diff)/TAU;
-						}
-
-						if (obj_diff <= obj_diff_min)
-						{
-							Gmin_idx=j;
-							obj_diff_min = obj_diff;
-						}
-					}
-				}
-			}
-		}
-	}
+	wss_i[0] = i;
+	wss_Q[0] = Q_i;
+	wss_Gmax[0] = Gmax;
+	scan_working_set(&Solver::scan_j, found);
+	double Gmax2 = found.max[0];
+	int Gmin_idx = found.min_idx;
 
 	int dup_j;
 	double gmax2_dup;
@@ -6627,6 +8504,334 @@ int Solver::select_working_set(int &out_i, int &out_j)
 	return 0;
 }
 
+// decomposition with working sets of up to working_set_size variables. Each
+// outer iteration picks a block (the largest first order violators, then the
+// second order partner of each, as select_working_set would pair them),
+// fetches the columns of its n variables once (the missing ones in a single
+// sweep over x), runs SMO on the n x n part
+// alone and then applies the alpha changes to G from those columns, one pass
+// per column pair instead of one per SMO step. The q columns held for the
+// block outlive it: up to half of the block, its free variables, stays for
+// the next one, and any variable selected again while its column is still
+// held reuses it, so the kernel cache size matters less. Returns the SMO
+// steps taken, which count against max_iter like those of the pair loop
+int Solver::solve_working_sets(int max_iter, int shrinking, LONGLONG &wss_time, LONGLONG &wss_count)
+{
+	profileDecls;
+	int q = working_set_size;
+	int B[WORKING_SET_MAX];
+	int changed[WORKING_SET_MAX];
+	double a[WORKING_SET_MAX];
+	double g[WORKING_SET_MAX];
+	double delta[WORKING_SET_MAX];
+	Qfloat *column[WORKING_SET_MAX];	// column of B[t]
+	int slot_var[WORKING_SET_MAX];		// variable whose column a slot holds, -1 for none
+	bool slot_used[WORKING_SET_MAX];
+	int fetch[WORKING_SET_MAX];
+	Qfloat *fetch_column[WORKING_SET_MAX];
+	double *Q_BB = new double[q*q];
+	Qfloat *slot = new Qfloat[(size_t)q*l];
+	int kept = 0;
+	int block_size = 0;	// active_size the held columns were fetched with
+	int iter = 0;
+	int t, k, s;
+	// shrink about as often, in SMO steps, as the pair loop does
+	int period = max(min(l,1000)*2/q, 1);
+	int counter = period+1;
+
+	for(s=0;s<q;s++)
+		slot_var[s] = -1;
+
+	while(iter < max_iter)
+	{
+		if(--counter == 0)
+		{
+			counter = period;
+			if(shrinking)
+			{
+				do_shrinking();
+				// shrinking swaps variables, so the positions kept in B
+				// and slot_var may now name inactive ones
+				kept = 0;
+				for(s=0;s<q;s++)
+					slot_var[s] = -1;
+			}
+			info(".");
+		}
+
+		startTimer();
+		int n = select_working_block(B,q,kept);
+		stopTimer();
+		wss_time += calculateTime();
+		wss_count++;
+		if(n == 0)
+		{
+			// reconstruct the whole gradient
+			reconstruct_gradient();
+			// reset active set size and check
+			active_size = l;
+			info("*");
+			startTimer();
+			n = select_working_block(B,q,0);
+			stopTimer();
+			wss_time += calculateTime();
+			wss_count++;
+			if(n == 0)
+				break;
+			counter = 1;	// do shrinking next iteration
+		}
+
+		// shrinking reorders the active set, and unshrinking lengthens it
+		if(active_size != block_size)
+		{
+			for(s=0;s<q;s++)
+				slot_var[s] = -1;
+			block_size = active_size;
+		}
+
+		// reuse the columns still held, fetch the others into free slots;
+		// first for the variables selected so far, then for their partners
+		for(s=0;s<q;s++)
+			slot_used[s] = false;
+		int first = 0;
+		for(;;)
+		{
+			int nr_fetch = 0;
+			for(t=first;t<n;t++)
+			{
+				column[t] = NULL;
+				for(s=0;s<q;s++)
+					if(slot_var[s] == B[t])
+					{
+						column[t] = slot+(size_t)s*l;
+						slot_used[s] = true;
+						break;
+					}
+			}
+			for(t=first;t<n;t++)
+				if(column[t] == NULL)
+				{
+					for(s=0;slot_used[s];s++);
+					slot_used[s] = true;
+					slot_var[s] = B[t];
+					column[t] = slot+(size_t)s*l;
+					fetch[nr_fetch] = B[t];
+					fetch_column[nr_fetch++] = column[t];
+				}
+			Q->get_Q_block(fetch,nr_fetch,active_size,fetch_column);
+			if(first > 0)
+				break;
+			first = n;
+			n = select_partners(B,kept,n,column);
+			if(n == first)
+				break;
+		}
+
+		for(t=0;t<n;t++)
+		{
+			for(k=0;k<n;k++)
+				Q_BB[t*n+k] = column[t][B[k]];
+			a[t] = alpha[B[t]];
+			g[t] = G[B[t]];
+		}
+
+		int steps = solve_block(n,B,Q_BB,a,g);
+		if(steps == 0)
+			break;
+		iter += steps;
+
+		// update G, two columns per pass
+		int nr_changed = 0;
+		for(t=0;t<n;t++)
+		{
+			delta[t] = a[t] - alpha[B[t]];
+			if(delta[t] != 0)
+				changed[nr_changed++] = t;
+		}
+		for(k=0;k<nr_changed;k+=2)
+		{
+			int t1 = changed[k];
+			int t2 = k+1 < nr_changed ? changed[k+1] : t1;
+			double delta_2 = t2 != t1 ? delta[t2] : 0;
+			update_gradient(G,active_size,column[t1],delta[t1],t2 != t1 ? column[t2] : NULL,delta_2);
+			if ( gradient_on_device && 0 != ((QMatrix*)Q)->update_objective_function( active_size, delta[t1], delta_2, B[t1], B[t2] ) )
+			{
+				// TODO: Deal with this error
+				fprintf( stderr, "ERROR UPDATING OBJECTIVE FUNCTION ON GPU FOR A WORKING SET\n" );
+				exit( -1 );
+			}
+		}
+
+		// update alpha, alpha_status and G_bar; G_bar needs whole columns,
+		// which the held ones only are while nothing is shrunk
+		for(k=0;k<nr_changed;k++)
+		{
+			t = changed[k];
+			int b = B[t];
+			bool u = is_upper_bound(b);
+			alpha[b] = a[t];
+			update_alpha_status(b);
+			if(u != is_upper_bound(b))
+			{
+				const Qfloat *Q_b = active_size == l ? column[t] : Q->get_Q(b,l);
+				update_gradient(G_bar,l,Q_b,u ? -get_C(b) : get_C(b),NULL,0);
+			}
+		}
+
+		check_gradient_copies( active_size, "AFTER A WORKING SET" );
+
+		// keep the free variables, the likeliest to move again
+		kept = 0;
+		for(t=0;t<n && kept<q/2;t++)
+			if(is_free(B[t]))
+				B[kept++] = B[t];
+	}
+
+	delete[] Q_BB;
+	delete[] slot;
+	return iter;
+}
+
+// first order selection: after the kept variables already in B, up to
+// half of the remaining room goes to the largest violators -y_t*G_t in I_up;
+// return the new size of B, or 0 if already optimal
+int Solver::select_working_block(int *B, int q, int kept)
+{
+	double up_val[WORKING_SET_MAX];
+	int up[WORKING_SET_MAX];
+	int nr_up = 0;
+	double Gmax2 = -INF;
+	int t, k, n;
+
+	for(t=0;t<active_size;t++)
+	{
+		if(y[t]==+1 ? !is_upper_bound(t) : !is_lower_bound(t))
+			keep_largest(-y[t]*G[t],t,up_val,up,nr_up,q);
+		if(y[t]==+1 ? !is_lower_bound(t) : !is_upper_bound(t))
+			Gmax2 = max(Gmax2, y[t]*G[t]);
+	}
+	if(nr_up == 0 || up_val[0]+Gmax2 < eps)
+		return 0;
+
+	n = kept;
+	int last = kept+max((q-kept)/2,1);
+	for(k=0;k<nr_up && n<last && up_val[k]+Gmax2 >= eps;k++)
+	{
+		for(t=0;t<n && B[t] != up[k];t++);
+		if(t == n)
+			B[n++] = up[k];
+	}
+	return n;
+}
+
+// second order partners for B[first..n): for each, the variable of I_low
+// not in B yet that select_working_set would pair it with, given its column
+int Solver::select_partners(int *B, int first, int n, Qfloat **column)
+{
+	int m = n;
+	for(int r=first;r<n;r++)
+	{
+		int i = B[r];
+		const Qfloat *Q_i = column[r];
+		double Gmax = -y[i]*G[i];
+		double obj_diff_min = INF;
+		int j = -1;
+		for(int t=0;t<active_size;t++)
+			if(y[t]==+1 ? !is_lower_bound(t) : !is_upper_bound(t))
+			{
+				double grad_diff = Gmax+y[t]*G[t];
+				if(grad_diff > 0)
+				{
+					double quad_coef = QD[i]+QD[t]-2.0*y[i]*y[t]*Q_i[t];
+					double obj_diff = -(grad_diff*grad_diff)/(quad_coef > 0 ? quad_coef : TAU);
+					if(obj_diff <= obj_diff_min)
+					{
+						int k;
+						for(k=0;k<m && B[k] != t;k++);
+						if(k == m)
+						{
+							j = t;
+							obj_diff_min = obj_diff;
+						}
+					}
+				}
+			}
+		if(j != -1)
+			B[m++] = j;
+	}
+	return m;
+}
+
+// SMO on the n variables of B alone, with the same selection as
+// select_working_set; Q_BB is their n x n block of Q, and a and g their
+// alphas and gradient, updated in place. Returns the steps taken
+int Solver::solve_block(int n, const int *B, const double *Q_BB, double *a, double *g)
+{
+	int steps = 0;
+	// a step costs O(n) here against O(active_size) outside, so the block
+	// may as well be solved well
+	int max_steps = 100*n;
+
+	while(steps < max_steps)
+	{
+		double Gmax = -INF;
+		double Gmax2 = -INF;
+		double obj_diff_min = INF;
+		int i = -1, j = -1;
+		int t;
+
+		for(t=0;t<n;t++)
+		{
+			int b = B[t];
+			if(y[b]==+1 ? a[t] < get_C(b) : a[t] > 0)
+				if(-y[b]*g[t] >= Gmax)
+				{
+					Gmax = -y[b]*g[t];
+					i = t;
+				}
+		}
+		if(i == -1)
+			break;
+
+		const double *Q_i = &Q_BB[i*n];
+		double QD_i = QD[B[i]];
+		for(t=0;t<n;t++)
+		{
+			int b = B[t];
+			if(y[b]==+1 ? a[t] > 0 : a[t] < get_C(b))
+			{
+				double v = y[b]*g[t];
+				double grad_diff = Gmax+v;
+				if(v >= Gmax2)
+					Gmax2 = v;
+				if(grad_diff > 0)
+				{
+					double quad_coef = QD_i+QD[b]-2.0*y[B[i]]*y[b]*Q_i[t];
+					double obj_diff = -(grad_diff*grad_diff)/(quad_coef > 0 ? quad_coef : TAU);
+					if(obj_diff <= obj_diff_min)
+					{
+						j = t;
+						obj_diff_min = obj_diff;
+					}
+				}
+			}
+		}
+		if(Gmax+Gmax2 < eps || j == -1)
+			break;
+
+		double old_a_i = a[i];
+		double old_a_j = a[j];
+		smo_step(y[B[i]] == y[B[j]], g[i], g[j], QD_i, QD[B[j]], Q_i[j], get_C(B[i]), get_C(B[j]), a[i], a[j]);
+		double delta_i = a[i] - old_a_i;
+		double delta_j = a[j] - old_a_j;
+		const double *Q_j = &Q_BB[j*n];
+		for(t=0;t<n;t++)
+			g[t] += Q_i[t]*delta_i + Q_j[t]*delta_j;
+		steps++;
+	}
+	return steps;
+}
+
 bool Solver::be_shrunk(int i, double Gmax1, double Gmax2)
 {
 	if(is_upper_bound(i))
@@ -6768,32 +8973,23 @@ public:
 private:
 	SolutionInfo *si;
 	int select_working_set(int &i, int &j);
+	bool one_constraint() { return false; }
 	double calculate_rho();
 	bool be_shrunk(int i, double Gmax1, double Gmax2, double Gmax3, double Gmax4);
 	void do_shrinking();
+	void scan_i(int begin, int end, wss_part &part);
+	void scan_j(int begin, int end, wss_part &part);
 };
 
-// return 1 if already optimal, return 0 otherwise
-int Solver_NU::select_working_set(int &out_i, int &out_j)
+// max[0]: -G_t over I_up with y_t = +1, max[1]: G_t over I_up with y_t = -1
+void Solver_NU::scan_i(int begin, int end, wss_part &part)
 {
-	// return i,j such that y_i = y_j and
-	// i: maximizes -y_i * grad(f)_i, i in I_up(\alpha)
-	// j: minimizes the decrease of obj value
-	//    (if quadratic coefficeint <= 0, replace it with tau)
-	//    -y_j*grad(f)_j < -y_i*grad(f)_i, j in I_low(\alpha)
-
 	double Gmaxp = -INF;
-	double Gmaxp2 = -INF;
 	int Gmaxp_idx = -1;
-
 	double Gmaxn = -INF;
-	double Gmaxn2 = -INF;
 	int Gmaxn_idx = -1;
 
-	int Gmin_idx = -1;
-	double obj_diff_min = INF;
-
-	for(int t=0;t<active_size;t++)
+	for(int t=begin;t<end;t++)
 		if(y[t]==+1)
 		{
 			if(!is_upper_bound(t))
@@ -6810,19 +9006,27 @@ int Solver_NU::select_working_set(int &out_i, int &out_j)
 				{
 					Gmaxn = G[t];
 					Gmaxn_idx = t;
-				}
-		}
-
-	int ip = Gmaxp_idx;
-	int in = Gmaxn_idx;
-	const Qfloat *Q_ip = NULL;
-	const Qfloat *Q_in = NULL;
-	if(ip != -1) // NULL Q_ip not accessed: Gmaxp=-INF if ip=-1
-		Q_ip = Q->get_Q(ip,active_size);
-	if(in != -1)
-		Q_in = Q->get_Q(in,active_size);
+				}
+		}
+	part.max[0] = Gmaxp;
+	part.max_idx[0] = Gmaxp_idx;
+	part.max[1] = Gmaxn;
+	part.max_idx[1] = Gmaxn_idx;
+}
+
+// max[0], max[1]: Gmaxp2 and Gmaxn2 (without index); min: the objective
+// decrease of pairing j with wss_i[0] (y_j = +1) or wss_i[1] (y_j = -1)
+void Solver_NU::scan_j(int begin, int end, wss_part &part)
+{
+	int ip = wss_i[0], in = wss_i[1];
+	const Qfloat *Q_ip = wss_Q[0], *Q_in = wss_Q[1];
+	double Gmaxp = wss_Gmax[0], Gmaxn = wss_Gmax[1];
+	double Gmaxp2 = -INF;
+	double Gmaxn2 = -INF;
+	int Gmin_idx = -1;
+	double obj_diff_min = INF;
 
-	for(int j=0;j<active_size;j++)
+	for(int j=begin;j<end;j++)
 	{
 		if(y[j]==+1)
 		{
@@ -6873,6 +9077,47 @@ int Solver_NU::select_working_set(int &out_i, int &out_j)
 			}
 		}
 	}
+	part.max[0] = Gmaxp2;
+	part.max[1] = Gmaxn2;
+	part.min = obj_diff_min;
+	part.min_idx = Gmin_idx;
+}
+
+// return 1 if already optimal, return 0 otherwise
+int Solver_NU::select_working_set(int &out_i, int &out_j)
+{
+	// return i,j such that y_i = y_j and
+	// i: maximizes -y_i * grad(f)_i, i in I_up(\alpha)
+	// j: minimizes the decrease of obj value
+	//    (if quadratic coefficeint <= 0, replace it with tau)
+	//    -y_j*grad(f)_j < -y_i*grad(f)_i, j in I_low(\alpha)
+
+	wss_part found;
+	scan_working_set(static_cast<wss_scan>(&Solver_NU::scan_i), found);
+	double Gmaxp = found.max[0];
+	int Gmaxp_idx = found.max_idx[0];
+	double Gmaxn = found.max[1];
+	int Gmaxn_idx = found.max_idx[1];
+
+	int ip = Gmaxp_idx;
+	int in = Gmaxn_idx;
+	const Qfloat *Q_ip = NULL;
+	const Qfloat *Q_in = NULL;
+	if(ip != -1) // NULL Q_ip not accessed: Gmaxp=-INF if ip=-1
+		Q_ip = Q->get_Q(ip,active_size);
+	if(in != -1)
+		Q_in = Q->get_Q(in,active_size);
+
+	wss_i[0] = ip;
+	wss_i[1] = in;
+	wss_Q[0] = Q_ip;
+	wss_Q[1] = Q_in;
+	wss_Gmax[0] = Gmaxp;
+	wss_Gmax[1] = Gmaxn;
+	scan_working_set(static_cast<wss_scan>(&Solver_NU::scan_j), found);
+	double Gmaxp2 = found.max[0];
+	double Gmaxn2 = found.max[1];
+	int Gmin_idx = found.min_idx;
 
 	if(max(Gmaxp+Gmaxp2,Gmaxn+Gmaxn2) < eps)
 		return 1;
@@ -7014,28 +9259,29 @@ double Solver_NU::calculate_rho()
 class SVC_Q: public Kernel
 { 
 public:
-	SVC_Q(const svm_problem& prob, const svm_parameter& param, const schar *y_)
-	:Kernel(prob.l, prob.x, param)
+	SVC_Q(const svm_problem& prob, const svm_parameter& param, const schar *y_, shared_rows *shared)
+	:Kernel(prob.l, prob.x, param, shared)
 	{
 		clone(y,y_,prob.l);
-		cache = new Cache(prob.l,(long int)(param.cache_size*(1<<20)));
+		cache = new Cache(prob.l,(long int)(param.cache_size*(1<<20)),cache_precision_for(param.kernel_type));
 		QD = new double[prob.l];
-		for(int i=0;i<prob.l;i++)
-			QD[i] = (this->*kernel_function)(i,i);
+		fill_diagonal(QD);
+	}
+	
+	void prefetch_Q(int i, int len) const
+	{
+		if(cache->can_prefetch())
+			fill_Q(i,len,true);
 	}
 	
 	Qfloat *get_Q(int i, int len) const
 	{
-		Qfloat *data;
-		int start, j;
-		if((start = cache->get_data(i,&data,len)) < len)
-		{
-			for(j=start;j<len;j++)
-			{
-				data[j] = (Qfloat)(y[i]*y[j]*(this->*kernel_function)(i,j));
-			}
-		}
-		return data;
+		return fill_Q(i,len,false);
+	}
+
+	void get_Q_block(const int *B, int n, int len, Qfloat **columns) const
+	{
+		fill_Q_block(cache,y,B,n,len,columns);
 	}
 
 	double *get_QD() const
@@ -7061,36 +9307,90 @@ private:
 	schar *y;
 	Cache *cache;
 	double *QD;
+
+	Qfloat *fill_Q(int i, int len, bool prefetch) const
+	{
+		Qfloat *data;
+		int start, j;
+		if((start = cache->get_data(i,&data,len,prefetch)) < len)
+		{
+			kernel_row(i,start,len,row_buffer);
+			for(j=start;j<len;j++)
+			{
+				data[j] = (Qfloat)(y[i]*y[j]*row_buffer[j]);
+			}
+			cache->put_data(i,data,start,len);
+		}
+		return data;
+	}
 };
 
 class ONE_CLASS_Q: public Kernel
 {
 public:
-	ONE_CLASS_Q(const svm_problem& prob, const svm_parameter& param)
-	:Kernel(prob.l, prob.x, param)
+	ONE_CLASS_Q(const svm_problem& prob, const svm_parameter& param, shared_rows *shared)
+	:Kernel(prob.l, prob.x, param, shared)
 	{
 	
 		// debugging
 		fprintf( stdout, "Constructing one class\n" );
 	
-		cache = new Cache(prob.l,(long int)(param.cache_size*(1<<20)));
+		cache = new Cache(prob.l,(long int)(param.cache_size*(1<<20)),cache_precision_for(param.kernel_type));
 		QD = new double[prob.l];
-		for(int i=0;i<prob.l;i++)
-		{
-			QD[i] = (this->*kernel_function)(i,i);
-		}
+		fill_diagonal(QD);
+	}
+	
+	void prefetch_Q(int i, int len) const
+	{
+		// the OpenCL queue stays with the solver thread
+		if(cache->can_prefetch() && !wideKernelInUse)
+			fill_Q(i,len,true);
 	}
 	
 	Qfloat *get_Q(int i, int len) const
 	{
 		// debugging
 		//fprintf( stdout, "Getting Q\n" );
+		return fill_Q(i,len,false);
+	}
+
+	void get_Q_block(const int *B, int n, int len, Qfloat **columns) const
+	{
+		if(wideKernelInUse)
+			QMatrix::get_Q_block(B,n,len,columns);
+		else
+			fill_Q_block(cache,NULL,B,n,len,columns);
+	}
+
+	double *get_QD() const
+	{
+		return QD;
+	}
+
+	void swap_index(int i, int j) const
+	{
+		cache->swap_index(i,j);
+		Kernel::swap_index(i,j);
+		swap(QD[i],QD[j]);
+	}
+
+	~ONE_CLASS_Q()
+	{
+		delete cache;
+		delete[] QD;
+	}
+private:
+	Cache *cache;
+	double *QD;
+
+	Qfloat *fill_Q(int i, int len, bool prefetch) const
+	{
 		Qfloat *data;
 		double * doubleData;
 		int start, j;
 		// we can insert parallelism here
 		// turn off caching for now
-		if((start = cache->get_data(i,&data,len)) < len)
+		if((start = cache->get_data(i,&data,len,prefetch)) < len)
 		//data = (Qfloat*) malloc( sizeof(Qfloat) * len );
 		//start = 0;
 		{
@@ -7120,55 +9420,36 @@ public:
 			else
 			#endif
 			{
+				kernel_row(i,start,len,row_buffer);
 				for(j=start;j<len;j++)
 				{
-					data[j] = (Qfloat)(this->*kernel_function)(i,j);
+					data[j] = (Qfloat)row_buffer[j];
 				}
 			}
+			cache->put_data(i,data,start,len);
 		}
 		return data;
 	}
-
-	double *get_QD() const
-	{
-		return QD;
-	}
-
-	void swap_index(int i, int j) const
-	{
-		cache->swap_index(i,j);
-		Kernel::swap_index(i,j);
-		swap(QD[i],QD[j]);
-	}
-
-	~ONE_CLASS_Q()
-	{
-		delete cache;
-		delete[] QD;
-	}
-private:
-	Cache *cache;
-	double *QD;
 };
 
 class SVR_Q: public Kernel
 { 
 public:
-	SVR_Q(const svm_problem& prob, const svm_parameter& param)
-	:Kernel(prob.l, prob.x, param)
+	SVR_Q(const svm_problem& prob, const svm_parameter& param, shared_rows *shared)
+	:Kernel(prob.l, prob.x, param, shared)
 	{
 		l = prob.l;
-		cache = new Cache(l,(long int)(param.cache_size*(1<<20)));
+		cache = new Cache(l,(long int)(param.cache_size*(1<<20)),cache_precision_for(param.kernel_type));
 		QD = new double[2*l];
 		sign = new schar[2*l];
 		index = new int[2*l];
+		fill_diagonal(QD);
 		for(int k=0;k<l;k++)
 		{
 			sign[k] = 1;
 			sign[k+l] = -1;
 			index[k] = k;
 			index[k+l] = k;
-			QD[k] = (this->*kernel_function)(k,k);
 			QD[k+l] = QD[k];
 		}
 		buffer[0] = new Qfloat[2*l];
@@ -7182,6 +9463,26 @@ public:
 		swap(index[i],index[j]);
 		swap(QD[i],QD[j]);
 	}
+
+	// the device kernels index an l x l matrix, this one is 2l x 2l
+	bool device_gradient() const
+	{
+		return false;
+	}
+	
+	// fills the cache only: get_Q would overwrite a buffer the solver is reading
+	void prefetch_Q(int i, int) const
+	{
+		Qfloat *data;
+		int real_i = index[i];
+		if(cache->can_prefetch() && cache->get_data(real_i,&data,l,true) < l)
+		{
+			kernel_row(real_i,0,l,row_buffer);
+			for(int j=0;j<l;j++)
+				data[j] = (Qfloat)row_buffer[j];
+			cache->put_data(real_i,data,0,l);
+		}
+	}
 	
 	Qfloat *get_Q(int i, int len) const
 	{
@@ -7189,8 +9490,10 @@ public:
 		int j, real_i = index[i];
 		if(cache->get_data(real_i,&data,l) < l)
 		{
+			kernel_row(real_i,0,l,row_buffer);
 			for(j=0;j<l;j++)
-				data[j] = (Qfloat)(this->*kernel_function)(real_i,j);
+				data[j] = (Qfloat)row_buffer[j];
+			cache->put_data(real_i,data,0,l);
 		}
 
 		// reorder and copy
@@ -7260,9 +9563,29 @@ private:
 // construct and solve various formulations
 //
 
+// a warm start clipped to [0,C] can break y^T alpha = 0; scaling the heavier
+// side down restores it and stays inside the box
+static void balance_warm_start(int l, const schar *y, double *alpha)
+{
+	double sum_p = 0, sum_n = 0;
+	int i;
+	for(i=0;i<l;i++)
+		if(y[i] > 0) sum_p += alpha[i]; else sum_n += alpha[i];
+	if(sum_p == sum_n)
+		return;
+	for(i=0;i<l;i++)
+	{
+		if(sum_p > sum_n && y[i] > 0)
+			alpha[i] *= sum_n/sum_p;
+		else if(sum_n > sum_p && y[i] < 0)
+			alpha[i] *= sum_p/sum_n;
+	}
+}
+
 static void solve_c_svc(
 	const svm_problem *prob, const svm_parameter* param,
-	double *alpha, Solver::SolutionInfo* si, double Cp, double Cn)
+	double *alpha, Solver::SolutionInfo* si, double Cp, double Cn,
+	const double *init_alpha, shared_rows *shared)
 {
 	int l = prob->l;
 	double *minus_ones = new double[l];
@@ -7275,10 +9598,15 @@ static void solve_c_svc(
 		alpha[i] = 0;
 		minus_ones[i] = -1;
 		if(prob->y[i] > 0) y[i] = +1; else y[i] = -1;
+		if(init_alpha)
+			alpha[i] = max(0.0, min(y[i] > 0 ? Cp : Cn, y[i]*init_alpha[i]));
 	}
+	if(init_alpha)
+		balance_warm_start(l, y, alpha);
 
+	SVC_Q Q(*prob,*param,y,shared);
 	Solver s;
-	s.Solve(l, SVC_Q(*prob,*param,y), minus_ones, y,
+	s.Solve(l, Q, minus_ones, y,
 		alpha, Cp, Cn, param->eps, si, param->shrinking);
 
 	double sum_alpha=0;
@@ -7290,6 +9618,7 @@ static void solve_c_svc(
 
 	for(i=0;i<l;i++)
 		alpha[i] *= y[i];
+	Q.nystrom_expansion(l, alpha);
 
 	delete[] minus_ones;
 	delete[] y;
@@ -7297,7 +9626,7 @@ static void solve_c_svc(
 
 static void solve_nu_svc(
 	const svm_problem *prob, const svm_parameter *param,
-	double *alpha, Solver::SolutionInfo* si)
+	double *alpha, Solver::SolutionInfo* si, shared_rows *shared)
 {
 	int i;
 	int l = prob->l;
@@ -7331,8 +9660,9 @@ static void solve_nu_svc(
 	for(i=0;i<l;i++)
 		zeros[i] = 0;
 
+	SVC_Q Q(*prob,*param,y,shared);
 	Solver_NU s;
-	s.Solve(l, SVC_Q(*prob,*param,y), zeros, y,
+	s.Solve(l, Q, zeros, y,
 		alpha, 1.0, 1.0, param->eps, si,  param->shrinking);
 	double r = si->r;
 
@@ -7340,6 +9670,7 @@ static void solve_nu_svc(
 
 	for(i=0;i<l;i++)
 		alpha[i] *= y[i]/r;
+	Q.nystrom_expansion(l, alpha);
 
 	si->rho /= r;
 	si->obj /= (r*r);
@@ -7352,7 +9683,7 @@ static void solve_nu_svc(
 
 static void solve_one_class(
 	const svm_problem *prob, const svm_parameter *param,
-	double *alpha, Solver::SolutionInfo* si)
+	double *alpha, Solver::SolutionInfo* si, shared_rows *shared)
 {
 	int l = prob->l;
 	double *zeros = new double[l];
@@ -7380,9 +9711,11 @@ static void solve_one_class(
 		ones[i] = 1;
 	}
 
+	ONE_CLASS_Q Q(*prob,*param,shared);
 	Solver s;
-	s.Solve(l, ONE_CLASS_Q(*prob,*param), zeros, ones,
+	s.Solve(l, Q, zeros, ones,
 		alpha, 1.0, 1.0, param->eps, si, param->shrinking);
+	Q.nystrom_expansion(l, alpha);
 
 	delete[] zeros;
 	delete[] ones;
@@ -7390,7 +9723,7 @@ static void solve_one_class(
 
 static void solve_epsilon_svr(
 	const svm_problem *prob, const svm_parameter *param,
-	double *alpha, Solver::SolutionInfo* si)
+	double *alpha, Solver::SolutionInfo* si, const double *init_alpha, shared_rows *shared)
 {
 	int l = prob->l;
 	double *alpha2 = new double[2*l];
@@ -7407,10 +9740,20 @@ static void solve_epsilon_svr(
 		alpha2[i+l] = 0;
 		linear_term[i+l] = param->p + prob->y[i];
 		y[i+l] = -1;
+
+		// the coefficient is alpha - alpha*, at most one of them non-zero
+		if(init_alpha)
+		{
+			alpha2[i] = min(param->C, max(0.0, init_alpha[i]));
+			alpha2[i+l] = min(param->C, max(0.0, -init_alpha[i]));
+		}
 	}
+	if(init_alpha)
+		balance_warm_start(2*l, y, alpha2);
 
+	SVR_Q Q(*prob,*param,shared);
 	Solver s;
-	s.Solve(2*l, SVR_Q(*prob,*param), linear_term, y,
+	s.Solve(2*l, Q, linear_term, y,
 		alpha2, param->C, param->C, param->eps, si, param->shrinking);
 
 	double sum_alpha = 0;
@@ -7420,6 +9763,7 @@ static void solve_epsilon_svr(
 		sum_alpha += fabs(alpha[i]);
 	}
 	info("nu = %f\n",sum_alpha/(param->C*l));
+	Q.nystrom_expansion(l, alpha);
 
 	delete[] alpha2;
 	delete[] linear_term;
@@ -7428,7 +9772,7 @@ static void solve_epsilon_svr(
 
 static void solve_nu_svr(
 	const svm_problem *prob, const svm_parameter *param,
-	double *alpha, Solver::SolutionInfo* si)
+	double *alpha, Solver::SolutionInfo* si, shared_rows *shared)
 {
 	int l = prob->l;
 	double C = param->C;
@@ -7450,14 +9794,16 @@ static void solve_nu_svr(
 		y[i+l] = -1;
 	}
 
+	SVR_Q Q(*prob,*param,shared);
 	Solver_NU s;
-	s.Solve(2*l, SVR_Q(*prob,*param), linear_term, y,
+	s.Solve(2*l, Q, linear_term, y,
 		alpha2, C, C, param->eps, si, param->shrinking);
 
 	info("epsilon = %f\n",-si->r);
 
 	for(i=0;i<l;i++)
 		alpha[i] = alpha2[i] - alpha2[i+l];
+	Q.nystrom_expansion(l, alpha);
 
 	delete[] alpha2;
 	delete[] linear_term;
@@ -7473,28 +9819,30 @@ struct decision_function
 	double rho;	
 };
 
+// init_alpha, when not NULL, holds the starting coefficients in the layout
+// of decision_function::alpha; shared is the outermost call's row cache
 static decision_function svm_train_one(
 	const svm_problem *prob, const svm_parameter *param,
-	double Cp, double Cn)
+	double Cp, double Cn, const double *init_alpha, shared_rows *shared)
 {
 	double *alpha = Malloc(double,prob->l);
 	Solver::SolutionInfo si;
 	switch(param->svm_type)
 	{
 		case C_SVC:
-			solve_c_svc(prob,param,alpha,&si,Cp,Cn);
+			solve_c_svc(prob,param,alpha,&si,Cp,Cn,init_alpha,shared);
 			break;
 		case NU_SVC:
-			solve_nu_svc(prob,param,alpha,&si);
+			solve_nu_svc(prob,param,alpha,&si,shared);
 			break;
 		case ONE_CLASS:
-			solve_one_class(prob,param,alpha,&si);
+			solve_one_class(prob,param,alpha,&si,shared);
 			break;
 		case EPSILON_SVR:
-			solve_epsilon_svr(prob,param,alpha,&si);
+			solve_epsilon_svr(prob,param,alpha,&si,init_alpha,shared);
 			break;
 		case NU_SVR:
-			solve_nu_svr(prob,param,alpha,&si);
+			solve_nu_svr(prob,param,alpha,&si,shared);
 			break;
 	}
 
@@ -7719,9 +10067,14 @@ static void multiclass_probability(int k, double **r, double *p)
 }
 
 // Cross-validation decision values for probability estimates
+static svm_model *train_model(const svm_problem *prob, const svm_parameter *param, const double *init_alpha,
+			      const int *init_label, shared_rows *shared);
+static void cross_validation(const svm_problem *prob, const svm_parameter *param, int nr_fold, double *target,
+			     shared_rows *shared);
+
 static void svm_binary_svc_probability(
 	const svm_problem *prob, const svm_parameter *param,
-	double Cp, double Cn, double& probA, double& probB)
+	double Cp, double Cn, double& probA, double& probB, shared_rows *shared)
 {
 	int i;
 	int nr_fold = 5;
@@ -7791,7 +10144,7 @@ static void svm_binary_svc_probability(
 			subparam.weight_label[1]=-1;
 			subparam.weight[0]=Cp;
 			subparam.weight[1]=Cn;
-			struct svm_model *submodel = svm_train(&subprob,&subparam);
+			struct svm_model *submodel = train_model(&subprob,&subparam,NULL,NULL,shared);
 			for(j=begin;j<end;j++)
 			{
 #ifdef _DENSE_REP
@@ -7815,7 +10168,7 @@ static void svm_binary_svc_probability(
 
 // Return parameter of a Laplace distribution 
 static double svm_svr_probability(
-	const svm_problem *prob, const svm_parameter *param)
+	const svm_problem *prob, const svm_parameter *param, shared_rows *shared)
 {
 	int i;
 	int nr_fold = 5;
@@ -7824,7 +10177,7 @@ static double svm_svr_probability(
 
 	svm_parameter newparam = *param;
 	newparam.probability = 0;
-	svm_cross_validation(prob,&newparam,nr_fold,ymv);
+	cross_validation(prob,&newparam,nr_fold,ymv,shared);
 	for(i=0;i<prob->l;i++)
 	{
 		ymv[i]=prob->y[i]-ymv[i];
@@ -7926,7 +10279,28 @@ static void svm_group_classes(const svm_problem *prob, int *nr_class_ret, int **
 //
 // Interface functions
 //
-svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
+//
+// Prediction state derived from the SVs: squared norms for RBF models,
+// so svm_predict_values needs one dot product per SV
+//
+static void svm_model_precompute(svm_model *model)
+{
+	model->sv_norm = NULL;
+#ifdef _DENSE_REP
+	int kernel_type = model->param.kernel_type;
+	if((kernel_type == RBF || kernel_type == WIDE_RBF_OPENCL) && model->l > 0)
+	{
+		model->sv_norm = Malloc(double,model->l);
+		for(int i=0;i<model->l;i++)
+			model->sv_norm[i] = simd_squared_norm(model->SV[i].values, model->SV[i].dim);
+	}
+#endif
+}
+
+// init_alpha and init_label as documented for svm_train_warm, NULL for a
+// cold start
+static svm_model *train_model(const svm_problem *prob, const svm_parameter *param, const double *init_alpha,
+			      const int *init_label, shared_rows *shared)
 {
 	svm_model *model = Malloc(svm_model,1);
 	model->param = *param;
@@ -7948,10 +10322,10 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 		    param->svm_type == NU_SVR))
 		{
 			model->probA = Malloc(double,1);
-			model->probA[0] = svm_svr_probability(prob,param);
+			model->probA[0] = svm_svr_probability(prob,param,shared);
 		}
 
-		decision_function f = svm_train_one(prob,param,0,0);
+		decision_function f = svm_train_one(prob,param,0,0,init_alpha,shared);
 		model->rho = Malloc(double,1);
 		model->rho[0] = f.rho;
 
@@ -8000,6 +10374,29 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 		for(i=0;i<l;i++)
 			x[i] = prob->x[perm[i]];
 
+		// row order of init_alpha's classes: init_class[i] is where label[i]
+		// sits in init_label, which has to name the same classes
+		int *init_class = NULL;
+		if(init_alpha)
+		{
+			init_class = Malloc(int,nr_class);
+			for(i=0;i<nr_class;i++)
+			{
+				int j = i;
+				if(init_label)
+					for(j=0;j<nr_class && init_label[j] != label[i];j++);
+				if(j == nr_class)
+				{
+					fprintf(stderr,"warning: class label %d is not in the warm start labels, starting cold\n", label[i]);
+					free(init_class);
+					init_class = NULL;
+					init_alpha = NULL;
+					break;
+				}
+				init_class[i] = j;
+			}
+		}
+
 		// calculate weighted C
 
 		double *weighted_C = Malloc(double, nr_class);
@@ -8058,9 +10455,26 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 				}
 
 				if(param->probability)
-					svm_binary_svc_probability(&sub_prob,param,weighted_C[i],weighted_C[j],probA[p],probB[p]);
-
-				f[p] = svm_train_one(&sub_prob,param,weighted_C[i],weighted_C[j]);
+					svm_binary_svc_probability(&sub_prob,param,weighted_C[i],weighted_C[j],probA[p],probB[p],shared);
+
+				// in init_alpha's order a < b, class a coefficients of the
+				// pair are in row b-1 and class b ones in row a, as in
+				// sv_coef; when that order puts j first the signs flip
+				double *sub_alpha = NULL;
+				if(init_alpha)
+				{
+					int a = min(init_class[i],init_class[j]), b = max(init_class[i],init_class[j]);
+					double sign = init_class[i] < init_class[j] ? 1 : -1;
+					size_t row_i = (size_t)(init_class[i] == a ? b-1 : a)*l;
+					size_t row_j = (size_t)(init_class[j] == a ? b-1 : a)*l;
+					sub_alpha = Malloc(double,sub_prob.l);
+					for(k=0;k<ci;k++)
+						sub_alpha[k] = sign*init_alpha[row_i+perm[si+k]];
+					for(k=0;k<cj;k++)
+						sub_alpha[ci+k] = sign*init_alpha[row_j+perm[sj+k]];
+				}
+				f[p] = svm_train_one(&sub_prob,param,weighted_C[i],weighted_C[j],sub_alpha,shared);
+				free(sub_alpha);
 				for(k=0;k<ci;k++)
 					if(!nonzero[si+k] && fabs(f[p].alpha[k]) > 0)
 						nonzero[si+k] = true;
@@ -8175,6 +10589,7 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 		free(start);
 		free(x);
 		free(weighted_C);
+		free(init_class);
 		free(nonzero);
 		for(i=0;i<nr_class*(nr_class-1)/2;i++)
 			free(f[i].alpha);
@@ -8182,11 +10597,35 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 		free(nz_count);
 		free(nz_start);
 	}
+	svm_model_precompute(model);
+	return model;
+}
+
+svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
+{
+	shared_rows *shared = shared_rows_create(prob,param);
+	svm_model *model = train_model(prob,param,NULL,NULL,shared);
+	shared_rows_destroy(shared);
+	return model;
+}
+
+svm_model *svm_train_warm(const svm_problem *prob, const svm_parameter *param, const double *init_alpha,
+			  const int *init_label)
+{
+	if(init_alpha && param->svm_type != C_SVC && param->svm_type != EPSILON_SVR)
+	{
+		fprintf(stderr,"warning: warm start is only supported for C-SVC and epsilon-SVR, starting cold\n");
+		init_alpha = NULL;
+	}
+	shared_rows *shared = shared_rows_create(prob,param);
+	svm_model *model = train_model(prob,param,init_alpha,init_label,shared);
+	shared_rows_destroy(shared);
 	return model;
 }
 
 // Stratified cross validation
-void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, int nr_fold, double *target)
+static void cross_validation(const svm_problem *prob, const svm_parameter *param, int nr_fold, double *target,
+			     shared_rows *shared)
 {
 	int i;
 	int *fold_start;
@@ -8290,7 +10729,7 @@ void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, i
 			subprob.y[k] = prob->y[perm[j]];
 			++k;
 		}
-		struct svm_model *submodel = svm_train(&subprob,param);
+		struct svm_model *submodel = train_model(&subprob,param,NULL,NULL,shared);
 		if(param->probability && 
 		   (param->svm_type == C_SVC || param->svm_type == NU_SVC))
 		{
@@ -8318,6 +10757,13 @@ void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, i
 	free(perm);	
 }
 
+void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, int nr_fold, double *target)
+{
+	shared_rows *shared = shared_rows_create(prob,param);
+	cross_validation(prob,param,nr_fold,target,shared);
+	shared_rows_destroy(shared);
+}
+
 
 int svm_get_svm_type(const svm_model *model)
 {
@@ -8395,14 +10841,16 @@ double svm_predict_values(const svm_model *model, const svm_node *x, double* dec
 			}
 			sum = predictionKernel->wide_k_function( x, model->SV, model->param, model->sv_coef[0] );
 		#else
-			for(i=0;i<model->l;i++)
-			{
 #ifdef _DENSE_REP
-				sum += sv_coef[i] * Kernel::k_function(x,model->SV+i,model->param);
+			double *kvalue = Malloc(double,model->l);
+			Kernel::k_function_row(x,model->SV,model->sv_norm,model->l,model->param,kvalue);
+			for(i=0;i<model->l;i++)
+				sum += sv_coef[i] * kvalue[i];
+			free(kvalue);
 #else
+			for(i=0;i<model->l;i++)
 				sum += sv_coef[i] * Kernel::k_function(x,model->SV[i],model->param);
 #endif
-			}
 		#endif
 		sum -= model->rho[0];
 		*dec_values = sum;
@@ -8423,14 +10871,12 @@ double svm_predict_values(const svm_model *model, const svm_node *x, double* dec
 		int l = model->l;
 		
 		double *kvalue = Malloc(double,l);
-		for(i=0;i<l;i++)
-		{
 #ifdef _DENSE_REP
-			kvalue[i] = Kernel::k_function(x,model->SV+i,model->param);
+		Kernel::k_function_row(x,model->SV,model->sv_norm,l,model->param,kvalue);
 #else
+		for(i=0;i<l;i++)
 			kvalue[i] = Kernel::k_function(x,model->SV[i],model->param);
 #endif
-		}
 
 		int *start = Malloc(int,nr_class);
 		start[0] = 0;
@@ -8632,7 +11078,13 @@ int svm_save_model(const char *model_file_name, const svm_model *model)
 		if(param.kernel_type == PRECOMPUTED)
 			fprintf(fp,"0:%d ",(int)(p->values[0]));
 		else
-			for (int j = 0; j < p->dim; j++)
+		{
+			// rows are padded to the widest one; svm_load_model pads them
+			// again, so the trailing zeros need not be written for every SV
+			int dim = p->dim;
+			while(dim > 1 && p->values[dim-1] == 0)
+				--dim;
+			for (int j = 0; j < dim; j++)
 			{
 				//if (p->values[j] != 0.0)
 				if ( 0 != j )
@@ -8640,6 +11092,7 @@ int svm_save_model(const char *model_file_name, const svm_model *model)
 					fprintf(fp,"%d:%.8g ",j, p->values[j]);
 				}
 			}
+		}
 #else
 		const svm_node *p = SV[i];
 
@@ -8701,6 +11154,7 @@ svm_model *svm_load_model(const char *model_file_name)
 	model->sv_indices = NULL;
 	model->label = NULL;
 	model->nSV = NULL;
+	model->sv_norm = NULL;
 
 	char cmd[81];
 	while(1)
@@ -8885,7 +11339,7 @@ svm_model *svm_load_model(const char *model_file_name)
 	{
 		readline(fp);
 
-		model->SV[i].values = Malloc(double, elements);
+		model->SV[i].values = Malloc(svm_feature, elements);
 		model->SV[i].dim = 0;
 
 		p = strtok(line, " \t");
@@ -8911,6 +11365,11 @@ svm_model *svm_load_model(const char *model_file_name)
 			}
 			model->SV[i].values[(*d)++] = strtod(val,&endptr);
 		}
+		// svm_save_model drops trailing zeros; every SV gets the full width back
+		while (*d < elements)
+		{
+			model->SV[i].values[(*d)++] = 0.0;
+		}
 		//model->SV[i].dim--;
 	}
 #else
@@ -8955,6 +11414,7 @@ svm_model *svm_load_model(const char *model_file_name)
 		return NULL;
 
 	model->free_sv = 1;	// XXX
+	svm_model_precompute(model);
 	return model;
 }
 
@@ -8995,6 +11455,9 @@ void svm_free_model_content(svm_model* model_ptr)
 
 	free(model_ptr->nSV);
 	model_ptr->nSV = NULL;
+
+	free(model_ptr->sv_norm);
+	model_ptr->sv_norm = NULL;
 }
 
 void svm_free_and_destroy_model(svm_model** model_ptr_ptr)
@@ -9077,6 +11540,9 @@ const char *svm_check_parameter(const svm_problem *prob, const svm_parameter *pa
 	   param->probability != 1)
 		return "probability != 0 and probability != 1";
 
+	if(param->nystrom_landmarks < 0)
+		return "nystrom_landmarks < 0";
+
 	if(param->probability == 1 &&
 	   svm_type == ONE_CLASS)
 		return "one-class SVM probability output not supported yet";
@@ -9154,3 +11620,146 @@ void svm_set_print_string_function(void (*print_func)(const char *))
 		svm_print_string = print_func;
 }
 
+void svm_get_metrics(svm_metrics *metrics_)
+{
+#pragma omp critical(svm_metrics)
+	*metrics_ = metrics;
+}
+
+void svm_reset_metrics()
+{
+#pragma omp critical(svm_metrics)
+	memset(&metrics, 0, sizeof(metrics));
+}
+
+int svm_save_metrics(const char *file_name)
+{
+	FILE *fp = fopen(file_name,"w");
+	if(fp==NULL) return -1;
+
+	svm_metrics totals;
+	svm_get_metrics(&totals);
+
+	char *old_locale = strdup(setlocale(LC_ALL, NULL));
+	setlocale(LC_ALL, "C");
+
+	fprintf(fp,"{\n");
+	fprintf(fp,"\t\"cache_hits\": %llu,\n", totals.cache_hits);
+	fprintf(fp,"\t\"cache_misses\": %llu,\n", totals.cache_misses);
+	fprintf(fp,"\t\"cache_evictions\": %llu,\n", totals.cache_evictions);
+	fprintf(fp,"\t\"cache_bytes\": %llu,\n", totals.cache_bytes);
+	fprintf(fp,"\t\"gpu_cache_hits\": %llu,\n", totals.gpu_cache_hits);
+	fprintf(fp,"\t\"gpu_cache_misses\": %llu,\n", totals.gpu_cache_misses);
+	fprintf(fp,"\t\"gpu_cache_invalidations\": %llu,\n", totals.gpu_cache_invalidations);
+	fprintf(fp,"\t\"transfer_bytes\": %llu,\n", totals.transfer_bytes);
+	fprintf(fp,"\t\"pool_hits\": %llu,\n", totals.pool_hits);
+	fprintf(fp,"\t\"pool_misses\": %llu,\n", totals.pool_misses);
+	fprintf(fp,"\t\"pool_bytes\": %llu,\n", totals.pool_bytes);
+	fprintf(fp,"\t\"wss_count\": %llu,\n", totals.wss_count);
+	fprintf(fp,"\t\"iterations\": %llu,\n", totals.iterations);
+	fprintf(fp,"\t\"column_fill_time\": %.6f,\n", totals.column_fill_time);
+	fprintf(fp,"\t\"wss_time\": %.6f\n", totals.wss_time);
+	fprintf(fp,"}\n");
+
+	setlocale(LC_ALL, old_locale);
+	free(old_locale);
+
+	if (ferror(fp) != 0 || fclose(fp) != 0) return -1;
+	else return 0;
+}
+
+void svm_set_prefetch(int depth)
+{
+	prefetch_depth = max(min(depth, PREFETCH_MAX), 0);
+}
+
+void svm_set_solver_mode(int mode)
+{
+	solver_mode = (mode == SOLVER_DEVICE) ? SOLVER_DEVICE : SOLVER_CPU;
+}
+
+void svm_set_check_gradient(int check)
+{
+	check_gradient = check != 0;
+}
+
+void svm_set_working_set_size(int size)
+{
+	working_set_size = max(2, min(size, WORKING_SET_MAX)) & ~1;
+}
+
+void svm_set_nystrom_sampling(int sampling)
+{
+	nystrom_sampling = sampling == NYSTROM_KMEANS ? NYSTROM_KMEANS : NYSTROM_RANDOM;
+}
+
+void svm_set_kernel_store(const char *directory)
+{
+	free(kernel_store_dir);
+	kernel_store_dir = directory ? strdup(directory) : NULL;
+}
+
+void svm_set_shared_cache_size(double size)
+{
+	shared_cache_size = size;
+}
+
+void svm_set_gpu_cache_size(double size)
+{
+	gpu_cache_size = size;
+}
+
+void svm_set_cache_huge_pages(int enable)
+{
+	cache_huge_pages = enable;
+}
+
+void svm_set_numa_policy(int policy)
+{
+	numa_policy = (policy == NUMA_INTERLEAVE || policy == NUMA_PARTITION) ? policy : NUMA_OFF;
+}
+
+void svm_set_cache_precision(int precision)
+{
+	cache_precision = (precision == CACHE_FP16 || precision == CACHE_BF16) ? precision : CACHE_FLOAT32;
+}
+
+void svm_set_transform_mode(int mode)
+{
+	transform_mode = (mode == TRANSFORM_FAST) ? TRANSFORM_FAST : TRANSFORM_EXACT;
+}
+
+void svm_set_num_threads(int nr_thread, int min_parallel_len)
+{
+	nr_threads = nr_thread;
+	if(min_parallel_len > 0)
+		parallel_threshold = min_parallel_len;
+}
+
+#ifdef _DENSE_REP
+svm_feature *svm_alloc_feature_matrix(int rows, int cols)
+{
+	size_t size = sizeof(svm_feature)*(size_t)rows*(size_t)cols;
+	if(size == 0)
+		size = SVM_MATRIX_ALIGNMENT;
+	void *matrix;
+#ifdef _WIN32
+	matrix = _aligned_malloc(size, SVM_MATRIX_ALIGNMENT);
+#else
+	if(posix_memalign(&matrix, SVM_MATRIX_ALIGNMENT, size) != 0)
+		return NULL;
+#endif
+	numa_place(matrix, numa_policy, 1, size, rows, sizeof(svm_feature)*(size_t)cols);
+	return (svm_feature *)matrix;
+}
+
+void svm_free_feature_matrix(svm_feature *matrix)
+{
+#ifdef _WIN32
+	_aligned_free(matrix);
+#else
+	free(matrix);
+#endif
+}
+#endif
+
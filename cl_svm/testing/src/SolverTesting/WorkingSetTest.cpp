@@ -0,0 +1,155 @@
+// Trains the same sparse RBF problem with plain SMO (-Q 2) and with larger
+// working sets, shrinking on, and checks that every run reaches the same
+// objective and rho. The set is large and C high enough for shrinking to
+// swap variables while the block solver still keeps some of them for its
+// next block, which used to let it move shrunk variables.
+//
+// usage: WorkingSetTest
+// returns 0 if every working set size agrees with plain SMO
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "svm.h"
+
+#define ROWS		3000
+#define FEATURES	500
+#define NONZEROS	12
+
+// fixed-seed generator, so every run trains on the same set
+static unsigned long long state = 3345678901ULL;
+
+static double uniform()
+{
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return (double)(state >> 11)/9007199254740992.0;
+}
+
+static int index_of[ROWS][NONZEROS];
+static double value_of[ROWS][NONZEROS];
+
+// x_a.x_b over the non-zeros
+static double sparse_dot( int a, int b )
+{
+	double sum = 0;
+	for( int i = 0; i < NONZEROS; i++ )
+		for( int j = 0; j < NONZEROS; j++ )
+			if( index_of[a][i] == index_of[b][j] )
+				sum += value_of[a][i]*value_of[b][j];
+	return sum;
+}
+
+// the solver reports obj from its own gradient, the copy a variable moved
+// while shrunk would corrupt
+static double solver_obj;
+
+static void print_solver( const char *s )
+{
+	const char *p = strstr( s, "obj = " );
+	if( p )
+		sscanf( p, "obj = %lf", &solver_obj );
+}
+
+// 1/2 a'Qa - e'a of a two-class C-SVC model, from its SVs
+static double dual_objective( const svm_model *model, const int *sv_index )
+{
+	double obj = 0;
+	for( int i = 0; i < model->l; i++ )
+	{
+		int a = sv_index[i]-1;
+		double ci = model->sv_coef[0][i];
+		for( int j = 0; j < model->l; j++ )
+		{
+			int b = sv_index[j]-1;
+			double d = sparse_dot( a, a )+sparse_dot( b, b )-2*sparse_dot( a, b );
+			obj += 0.5*ci*model->sv_coef[0][j]*exp( -model->param.gamma*d );
+		}
+		obj -= fabs( ci );
+	}
+	return obj;
+}
+
+int main()
+{
+	static svm_feature matrix[ROWS][FEATURES+1];
+	static svm_node x[ROWS];
+	static double y[ROWS];
+	int i, k;
+
+	for( i = 0; i < ROWS; i++ )
+	{
+		// alternating labels; a feature whose index is a multiple of 7 is
+		// larger in the positive class, any other in the negative one
+		y[i] = i%2 ? 1 : -1;
+		for( k = 0; k < NONZEROS; k++ )
+		{
+			int index;
+			do
+				index = 1+(int)( uniform()*( FEATURES-1 ) );
+			while( matrix[i][index] != 0 );
+			double shift = ( index%7 == 0 ) == ( y[i] > 0 ) ? 0.5 : 0;
+			matrix[i][index] = (svm_feature)( 0.001+uniform()+shift );
+			index_of[i][k] = index;
+			value_of[i][k] = matrix[i][index];
+		}
+		x[i].dim = FEATURES+1;
+		x[i].values = matrix[i];
+	}
+
+	svm_problem prob;
+	prob.l = ROWS;
+	prob.y = y;
+	prob.x = x;
+
+	svm_parameter param;
+	memset( &param, 0, sizeof( param ) );
+	param.svm_type = C_SVC;
+	param.kernel_type = RBF;
+	param.degree = 3;
+	param.gamma = 1.0/FEATURES;
+	param.cache_size = 100;
+	param.C = 300;
+	param.eps = 1e-3;
+	param.shrinking = 1;
+
+	svm_set_print_string_function( &print_solver );
+	const char *error = svm_check_parameter( &prob, &param );
+	if( error )
+	{
+		fprintf( stderr, "ERROR: %s\n", error );
+		return 1;
+	}
+
+	static int sv_index[ROWS];
+	double obj_smo = 0, rho_smo = 0, solver_obj_smo = 0;
+	int failures = 0;
+	const int sizes[] = { 2, 4, 16, 64 };
+	for( int s = 0; s < (int)( sizeof( sizes )/sizeof( sizes[0] ) ); s++ )
+	{
+		svm_set_working_set_size( sizes[s] );
+		svm_model *model = svm_train( &prob, &param );
+		svm_get_sv_indices( model, sv_index );
+		double obj = dual_objective( model, sv_index );
+		double rho = model->rho[0];
+		if( s == 0 )
+		{
+			obj_smo = obj;
+			rho_smo = rho;
+			solver_obj_smo = solver_obj;
+		}
+		// every run stops within eps of the optimum, not on it; the solver's
+		// obj differs from the model's by the float rounding of the cache,
+		// so each is compared with its plain SMO counterpart
+		bool ok = fabs( obj-obj_smo ) <= 1e-6*fabs( obj_smo ) &&
+			  fabs( solver_obj-solver_obj_smo ) <= 1e-6*fabs( solver_obj_smo ) &&
+			  fabs( rho-rho_smo ) <= 1e-3*fmax( fabs( rho_smo ), 1.0 );
+		fprintf( stdout, "working set %2d: obj = %f (solver %f), rho = %f%s\n", sizes[s], obj, solver_obj, rho, ok ? "" : "  MISMATCH" );
+		if( !ok )
+			++failures;
+		svm_free_and_destroy_model( &model );
+	}
+	svm_set_working_set_size( 2 );
+	return failures ? 1 : 0;
+}